@@ -1,16 +1,158 @@
 #include "preHeader.h"
 #include "renderer/renderSystem.h"
+#include "renderer/renderSystemConfig.h"
+#include "renderer/strokeLog.h"
+#include "renderer/vertexKdTree.h"
+#include "renderer/frameProfiler.h"
+#include "renderer/traceRecorder.h"
 
 using namespace TextureSynthesis;
 
 int main(int argc, char** argv)
 {
+	// -record <log> saves the session input, -replay <log> plays it back and exits,
+	// -timing <csv> writes the per stroke stage timings of a replay,
+	// -benchKdTree <points> times the vertex kd-tree on random points on one thread and exits.
+	// -spiralStroke <points> writes a log of one spiral path of that many points to the -record path and exits,
+	// replay it with -timing to benchmark long strokes.
+	// -headless <frames> renders offscreen without a window, 0 frames runs until the replay ends,
+	// -frameDir <dir> saves every headless frame, -size <width>x<height> overrides WindowSize,
+	// -profile <csv> appends the rolling per pass CPU and GPU time statistics every second,
+	// -trace <json> sets where T dumps the event trace and dumps it at exit, in builds with TEXTUREBRUSH_TRACE,
+	// -onDemand <0|1> and -maxFps <fps> override RenderMode, redrawing only on changes and capping the frame rate
+	string recordPath, replayPath, timingPath, frameDir, profilePath, tracePath;
+	int benchPointNum = 0;
+	int spiralPointNum = 0;
+	int headlessFrameNum = -1;
+	for (int argIdx = 1; argIdx + 1 < argc; argIdx += 2)
+	{
+		string arg(argv[argIdx]);
+		if (arg == "-record")
+		{
+			recordPath = argv[argIdx + 1];
+		}
+		else if (arg == "-replay")
+		{
+			replayPath = argv[argIdx + 1];
+		}
+		else if (arg == "-timing")
+		{
+			timingPath = argv[argIdx + 1];
+		}
+		else if (arg == "-benchKdTree")
+		{
+			benchPointNum = atoi(argv[argIdx + 1]);
+		}
+		else if (arg == "-spiralStroke")
+		{
+			spiralPointNum = atoi(argv[argIdx + 1]);
+		}
+		else if (arg == "-headless")
+		{
+			headlessFrameNum = atoi(argv[argIdx + 1]);
+		}
+		else if (arg == "-frameDir")
+		{
+			frameDir = argv[argIdx + 1];
+		}
+		else if (arg == "-profile")
+		{
+			profilePath = argv[argIdx + 1];
+		}
+		else if (arg == "-trace")
+		{
+			tracePath = argv[argIdx + 1];
+			CTraceRecorder::Instance()->setDumpPath(tracePath);
+		}
+		else if (arg == "-onDemand" || arg == "-maxFps")
+		{
+			int onDemand;
+			float maxFrameRate;
+			CRenderSystemConfig::getSysCfgInstance()->getRenderMode(onDemand, maxFrameRate);
+			if (arg == "-onDemand")
+			{
+				onDemand = atoi(argv[argIdx + 1]);
+			}
+			else
+			{
+				maxFrameRate = (float)atof(argv[argIdx + 1]);
+			}
+			CRenderSystemConfig::getSysCfgInstance()->setRenderMode(onDemand, maxFrameRate);
+		}
+		else if (arg == "-size")
+		{
+			int width, height;
+			if (sscanf(argv[argIdx + 1], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+			{
+				CRenderSystemConfig::getSysCfgInstance()->setWinSize(width, height);
+			}
+			else
+			{
+				cout << "WARNING: Invalid size " << argv[argIdx + 1] << " ignored!" << endl;
+			}
+		}
+		else
+		{
+			cout << "WARNING: Unknown argument " << arg << " ignored!" << endl;
+		}
+	}
+
+	if (benchPointNum > 0)
+	{
+		CVertexKdTree::benchmark(benchPointNum, 100000, 1);
+		return 0;
+	}
+
+	if (spiralPointNum > 0)
+	{
+		if (recordPath.empty())
+		{
+			cout << "ERROR: -spiralStroke needs a -record path to write the log to!" << endl;
+			return 1;
+		}
+
+		return CStrokeLog::Instance()->writeSpiralStroke(recordPath, spiralPointNum) ? 0 : 1;
+	}
+
+	if (headlessFrameNum >= 0)
+	{
+		if (headlessFrameNum == 0 && replayPath.empty())
+		{
+			cout << "ERROR: Headless mode needs a frame count or a stroke log to replay!" << endl;
+			return 1;
+		}
+
+		CRenderSystem::Instance()->setHeadless(headlessFrameNum, frameDir);
+	}
 
 	CRenderSystem::Instance()->initRenderSystem();
 
+	if (!profilePath.empty())
+	{
+		CFrameProfiler::Instance()->startExport(profilePath);
+	}
+
+	if (!replayPath.empty())
+	{
+		if (!CStrokeLog::Instance()->startReplay(replayPath, timingPath))
+		{
+			CRenderSystem::Instance()->cleanSystem();
+			return 1;
+		}
+	}
+	else if (!recordPath.empty())
+	{
+		CStrokeLog::Instance()->startRecording(recordPath);
+	}
+
 	CRenderSystem::Instance()->render();
 
 	CRenderSystem::Instance()->cleanSystem();
 
+	if (!tracePath.empty())
+	{
+		CTraceRecorder::Instance()->dump(tracePath);
+	}
+
 	return 0;
 }
\ No newline at end of file
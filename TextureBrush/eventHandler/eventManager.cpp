@@ -1,5 +1,9 @@
 #include "eventManager.h"
 
+#include "../renderer/strokeLog.h"
+#include "../renderer/traceRecorder.h"
+#include "../renderer/renderSystem.h"
+
 using namespace TextureSynthesis;
 
 CEventManager* CEventManager::getEventManagerInstance()
@@ -59,6 +63,17 @@ void CEventManager::registerMouseListener(int mouseCode, MouseListener* pListene
 
 void CEventManager::keyCallback(GLFWwindow* pWindow, int key, int scancode, int action, int mods)
 {
+	TRACE_SCOPE("keyCallback");
+
+	// Live input is ignored while a stroke log is replayed
+	if (pWindow != NULL && CStrokeLog::Instance()->isReplaying())
+	{
+		return;
+	}
+
+	CStrokeLog::Instance()->recordKey(key, action);
+	CRenderSystem::Instance()->requestRedraw(RDF_INPUT);
+
 	int keyCodeOffset = key - 1;
 	if (action == GLFW_PRESS)
 	{
@@ -82,6 +97,17 @@ void CEventManager::keyCallback(GLFWwindow* pWindow, int key, int scancode, int
 
 void CEventManager::mouseButtonCallback(GLFWwindow* pWindow, int button, int action, int mods)
 {
+	TRACE_SCOPE("mouseButtonCallback");
+
+	// Live input is ignored while a stroke log is replayed
+	if (pWindow != NULL && CStrokeLog::Instance()->isReplaying())
+	{
+		return;
+	}
+
+	CStrokeLog::Instance()->recordButton(button, action);
+	CRenderSystem::Instance()->requestRedraw(RDF_INPUT);
+
 	if (action == GLFW_PRESS)
 	{
 		if (getEventManagerInstance()->m_pMouseListener[button] != NULL)
@@ -100,6 +126,16 @@ void CEventManager::mouseButtonCallback(GLFWwindow* pWindow, int button, int act
 
 void CEventManager::mousePosCallback(GLFWwindow* pWindow, double x, double y)
 {
+	TRACE_SCOPE("mousePosCallback");
+
+	// Live input is ignored while a stroke log is replayed
+	if (pWindow != NULL && CStrokeLog::Instance()->isReplaying())
+	{
+		return;
+	}
+
+	CStrokeLog::Instance()->recordMove(x, y);
+
 	for (int mouseIdx = 0; mouseIdx <= GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1; ++mouseIdx)
 	{
 		if (getEventManagerInstance()->m_pMouseListener[mouseIdx] != NULL)
@@ -111,6 +147,17 @@ void CEventManager::mousePosCallback(GLFWwindow* pWindow, double x, double y)
 
 void CEventManager::mouseWheelCallback(GLFWwindow* pWindow, double x, double y)
 {
+	TRACE_SCOPE("mouseWheelCallback");
+
+	// Live input is ignored while a stroke log is replayed
+	if (pWindow != NULL && CStrokeLog::Instance()->isReplaying())
+	{
+		return;
+	}
+
+	CStrokeLog::Instance()->recordWheel(y);
+	CRenderSystem::Instance()->requestRedraw(RDF_INPUT);
+
 	for (int mouseIdx = 0; mouseIdx <= GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1; ++mouseIdx)
 	{
 		if (getEventManagerInstance()->m_pMouseListener[mouseIdx] != NULL)
@@ -118,4 +165,14 @@ void CEventManager::mouseWheelCallback(GLFWwindow* pWindow, double x, double y)
 			getEventManagerInstance()->m_pMouseListener[mouseIdx]->mouseWheel(y);
 		}
 	}
+}
+
+void CEventManager::windowRefreshCallback(GLFWwindow* pWindow)
+{
+	CRenderSystem::Instance()->requestRedraw(RDF_WINDOW);
+}
+
+void CEventManager::windowSizeCallback(GLFWwindow* pWindow, int width, int height)
+{
+	CRenderSystem::Instance()->requestRedraw(RDF_WINDOW);
 }
\ No newline at end of file
@@ -22,6 +22,10 @@ public:
 	static void mousePosCallback(GLFWwindow* pWindow, double x, double y);
 	static void mouseWheelCallback(GLFWwindow* pWindow, double x, double y);
 
+	// Exposed or resized windows have to be redrawn in on demand mode
+	static void windowRefreshCallback(GLFWwindow* pWindow);
+	static void windowSizeCallback(GLFWwindow* pWindow, int width, int height);
+
 protected:
 	CEventManager();
 
@@ -29,8 +33,8 @@ private:
 	bool m_keyPressed[GLFW_KEY_LAST];
 	KeyListener* m_pKeyListeners[GLFW_KEY_LAST];
 
-	bool m_mousePressed[GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1];
-	MouseListener* m_pMouseListener[GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1];
+	bool m_mousePressed[GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1 + 1];
+	MouseListener* m_pMouseListener[GLFW_MOUSE_BUTTON_LAST - GLFW_MOUSE_BUTTON_1 + 1];
 
 	int m_wheelPos;
 };
@@ -143,12 +143,14 @@ double Geo2D::GetCubicBeizerArcLength(double t, const glm::vec2 & p0, const glm:
 double Geo2D::CubicBeizerArcLengthTo_t(double l, const glm::vec2 & p0, const glm::vec2 & p1, const glm::vec2 & p2, const glm::vec2 & p3)
 {
 	std::vector<double> ll; 
-	for(int i = 0;i<1000;i++)
+	for(int i = 0;i<=1000;i++)
 	{
 		double t = i / 1000.0;
 		ll.push_back(Geo2D::GetCubicBeizerArcLength(t,p0,p1,p2,p3));
 	}
 	
+	if(l >= ll[1000]) return 1.0;
+
 	double ans = 0.5;
 
 	for(int i = 0;i<1000;i++)
@@ -214,4 +216,205 @@ double Geo2D::RefineProjection_(double t, double dist, double precision, const g
 	if(next_t <=1 && next_dist < dist) { return Geo2D::RefineProjection_(next_t,next_dist,precision,p,p0,p1,p2,p3); }
 
 	return Geo2D::RefineProjection_(t,dist,precision/2,p,p0,p1,p2,p3);
-}
\ No newline at end of file
+}
+
+void Geo2D::FitCubicBeziers(std::vector<std::vector<glm::vec2>> & beziers, const std::vector<glm::vec2> & pts, double tolerance)
+{
+	beziers.clear();
+
+	int n = pts.size();
+	if(n < 2) return;
+
+	glm::vec2 tHat1 = pts[1] - pts[0];
+	glm::vec2 tHat2 = pts[n - 2] - pts[n - 1];
+	tHat1 = glm::normalize(tHat1);
+	tHat2 = glm::normalize(tHat2);
+
+	Geo2D::FitCubicBezier_(beziers,pts,0,n - 1,tHat1,tHat2,tolerance * tolerance);
+}
+
+void Geo2D::FitCubicBezier_(std::vector<std::vector<glm::vec2>> & beziers, const std::vector<glm::vec2> & pts, int first, int last, const glm::vec2 & tHat1, const glm::vec2 & tHat2, double tolerance)
+{
+	std::vector<glm::vec2> bezier(4);
+
+	// Two points, place the inner control points on the end tangents
+	if(last - first == 1)
+	{
+		float dist = glm::length(pts[last] - pts[first]) / 3.0f;
+		bezier[0] = pts[first];
+		bezier[3] = pts[last];
+		bezier[1] = bezier[0] + tHat1 * dist;
+		bezier[2] = bezier[3] + tHat2 * dist;
+		beziers.push_back(bezier);
+		return;
+	}
+
+	// Chord length parameterization
+	std::vector<double> u(last - first + 1);
+	u[0] = 0.0;
+	for(int i = first + 1;i<=last;i++)
+	{
+		u[i - first] = u[i - first - 1] + glm::length(pts[i] - pts[i - 1]);
+	}
+	for(int i = first + 1;i<=last;i++)
+	{
+		u[i - first] = u[i - first] / u[last - first];
+	}
+
+	Geo2D::GenerateBezier_(bezier,pts,first,last,u,tHat1,tHat2);
+
+	int splitPoint;
+	double maxError = Geo2D::ComputeMaxError_(splitPoint,pts,first,last,bezier,u);
+	if(maxError < tolerance)
+	{
+		beziers.push_back(bezier);
+		return;
+	}
+
+	// Close enough, try to improve the parameterization before splitting
+	if(maxError < tolerance * 4.0)
+	{
+		for(int iter = 0;iter<4;iter++)
+		{
+			for(int i = first;i<=last;i++)
+			{
+				u[i - first] = Geo2D::NewtonRaphsonRootFind_(bezier,pts[i],u[i - first]);
+			}
+
+			Geo2D::GenerateBezier_(bezier,pts,first,last,u,tHat1,tHat2);
+			maxError = Geo2D::ComputeMaxError_(splitPoint,pts,first,last,bezier,u);
+			if(maxError < tolerance)
+			{
+				beziers.push_back(bezier);
+				return;
+			}
+		}
+	}
+
+	// Split at the point of max error and fit each part
+	glm::vec2 tHatCenter = pts[splitPoint - 1] - pts[splitPoint + 1];
+	if(glm::length(tHatCenter) < 0.000001f)
+	{
+		tHatCenter = pts[splitPoint - 1] - pts[splitPoint];
+	}
+	tHatCenter = glm::normalize(tHatCenter);
+
+	Geo2D::FitCubicBezier_(beziers,pts,first,splitPoint,tHat1,tHatCenter,tolerance);
+	Geo2D::FitCubicBezier_(beziers,pts,splitPoint,last,-tHatCenter,tHat2,tolerance);
+}
+
+void Geo2D::GenerateBezier_(std::vector<glm::vec2> & bezier, const std::vector<glm::vec2> & pts, int first, int last, const std::vector<double> & u, const glm::vec2 & tHat1, const glm::vec2 & tHat2)
+{
+	double C[2][2] = {{0.0,0.0},{0.0,0.0}};
+	double X[2] = {0.0,0.0};
+
+	glm::vec2 p0 = pts[first];
+	glm::vec2 p3 = pts[last];
+
+	// Least squares for the lengths of the end tangents
+	for(int i = first;i<=last;i++)
+	{
+		double t  = u[i - first];
+		double mt = 1.0 - t;
+		double b0 = mt * mt * mt;
+		double b1 = 3.0 * t * mt * mt;
+		double b2 = 3.0 * t * t * mt;
+		double b3 = t * t * t;
+
+		glm::vec2 a1 = tHat1 * (float)b1;
+		glm::vec2 a2 = tHat2 * (float)b2;
+
+		C[0][0] += glm::dot(a1,a1);
+		C[0][1] += glm::dot(a1,a2);
+		C[1][1] += glm::dot(a2,a2);
+
+		glm::vec2 tmp = pts[i] - (p0 * (float)(b0 + b1) + p3 * (float)(b2 + b3));
+		X[0] += glm::dot(a1,tmp);
+		X[1] += glm::dot(a2,tmp);
+	}
+	C[1][0] = C[0][1];
+
+	double det_C0_C1 = C[0][0] * C[1][1] - C[1][0] * C[0][1];
+	double det_C0_X  = C[0][0] * X[1] - C[1][0] * X[0];
+	double det_X_C1  = X[0] * C[1][1] - X[1] * C[0][1];
+
+	double alpha_l = (det_C0_C1 == 0.0) ? 0.0 : det_X_C1 / det_C0_C1;
+	double alpha_r = (det_C0_C1 == 0.0) ? 0.0 : det_C0_X / det_C0_C1;
+
+	// Fall back to the heuristic when the solution is degenerate
+	double segLength = glm::length(p3 - p0);
+	double epsilon = 1.0e-6 * segLength;
+	if(alpha_l < epsilon || alpha_r < epsilon)
+	{
+		alpha_l = alpha_r = segLength / 3.0;
+	}
+
+	bezier[0] = p0;
+	bezier[3] = p3;
+	bezier[1] = p0 + tHat1 * (float)alpha_l;
+	bezier[2] = p3 + tHat2 * (float)alpha_r;
+}
+
+double Geo2D::NewtonRaphsonRootFind_(const std::vector<glm::vec2> & bezier, const glm::vec2 & p, double u)
+{
+	glm::vec2 q, q1, q2;
+	Geo2D::PointOnCubicBezier_deCasteljau(q,u,bezier[0],bezier[1],bezier[2],bezier[3]);
+	Geo2D::DerivativeOnCubicBezier(q1,u,bezier[0],bezier[1],bezier[2],bezier[3]);
+	Geo2D::SecondDerivativeOnCubicBezier(q2,u,bezier[0],bezier[1],bezier[2],bezier[3]);
+
+	glm::vec2 d = q - p;
+	double numerator   = glm::dot(d,q1);
+	double denominator = glm::dot(q1,q1) + glm::dot(d,q2);
+	if(fabs(denominator) < 1.0e-12) return u;
+
+	return u - numerator / denominator;
+}
+
+double Geo2D::ComputeMaxError_(int & splitPoint, const std::vector<glm::vec2> & pts, int first, int last, const std::vector<glm::vec2> & bezier, const std::vector<double> & u)
+{
+	splitPoint = (last - first + 1) / 2 + first;
+
+	double maxDist = 0.0;
+	for(int i = first + 1;i<last;i++)
+	{
+		glm::vec2 q;
+		Geo2D::PointOnCubicBezier_deCasteljau(q,u[i - first],bezier[0],bezier[1],bezier[2],bezier[3]);
+		glm::vec2 d = q - pts[i];
+		double dist = glm::dot(d,d);
+		if(dist >= maxDist)
+		{
+			maxDist = dist;
+			splitPoint = i;
+		}
+	}
+	return maxDist;
+}
+
+void Geo2D::ResampleCubicBeziers(std::vector<glm::vec2> & pts, const std::vector<std::vector<glm::vec2>> & beziers, double spacing)
+{
+	pts.clear();
+	if(beziers.empty()) return;
+
+	pts.push_back(beziers[0][0]);
+
+	// Distance carried over from the previous segment to the next sample
+	double carry = spacing;
+	for(int b = 0;b<beziers.size();b++)
+	{
+		const std::vector<glm::vec2> & bz = beziers[b];
+		double length = Geo2D::GetCubicBeizerArcLength(1.0,bz[0],bz[1],bz[2],bz[3]);
+
+		double l = carry;
+		while(l < length)
+		{
+			double t = Geo2D::CubicBeizerArcLengthTo_t(l,bz[0],bz[1],bz[2],bz[3]);
+			glm::vec2 pt;
+			Geo2D::PointOnCubicBezier_deCasteljau(pt,t,bz[0],bz[1],bz[2],bz[3]);
+			pts.push_back(pt);
+			l += spacing;
+		}
+		carry = l - length;
+	}
+
+	pts.push_back(beziers[beziers.size() - 1][3]);
+}
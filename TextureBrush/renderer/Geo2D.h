@@ -45,4 +45,15 @@ public:
 	/* refer to http://pomax.github.io/bezierinfo/#arclength */
 	static double		GetCubicBeizerArcLength(double t, const glm::vec2 & p0, const glm::vec2 & p1, const glm::vec2 & p2, const glm::vec2 & p3);
 	static double		CubicBeizerArcLengthTo_t(double l, const glm::vec2 & p0, const glm::vec2 & p1, const glm::vec2 & p2, const glm::vec2 & p3);
+
+	/* fitting of piecewise cubic bezier curves to sampled points */
+	/* refer to Philip J. Schneider, An Algorithm for Automatically Fitting Digitized Curves, Graphics Gems 1990 */
+	static void			FitCubicBeziers(std::vector<std::vector<glm::vec2>> & beziers, const std::vector<glm::vec2> & pts, double tolerance);
+	static void			ResampleCubicBeziers(std::vector<glm::vec2> & pts, const std::vector<std::vector<glm::vec2>> & beziers, double spacing);
+
+private:
+	static void			FitCubicBezier_(std::vector<std::vector<glm::vec2>> & beziers, const std::vector<glm::vec2> & pts, int first, int last, const glm::vec2 & tHat1, const glm::vec2 & tHat2, double tolerance);
+	static void			GenerateBezier_(std::vector<glm::vec2> & bezier, const std::vector<glm::vec2> & pts, int first, int last, const std::vector<double> & u, const glm::vec2 & tHat1, const glm::vec2 & tHat2);
+	static double		NewtonRaphsonRootFind_(const std::vector<glm::vec2> & bezier, const glm::vec2 & p, double u);
+	static double		ComputeMaxError_(int & splitPoint, const std::vector<glm::vec2> & pts, int first, int last, const std::vector<glm::vec2> & bezier, const std::vector<double> & u);
 };
\ No newline at end of file
@@ -12,7 +12,11 @@
 #include "screenPassVBO.h"
 #include "shaderProgram.h"
 #include "shaderManager.h"
+#include "frameUniformBuffer.h"
 #include "geodesicMesh.h"
+#include "meshBVH.h"
+#include "vertexKdTree.h"
+#include "strokeLayers.h"
 
 using namespace TextureSynthesis;
 
@@ -29,10 +33,13 @@ CPixelBufferObject* CBrushGlobalRes::s_pPixelBuffer = NULL;
 CShaderProgram* CBrushGlobalRes::s_pTrackProgram = NULL;
 CShaderProgram* CBrushGlobalRes::s_pShowMarkProgram = NULL;
 CShaderProgram* CBrushGlobalRes::s_pFinalRenderProgram = NULL;
+CFrameUniformBuffer* CBrushGlobalRes::s_pFrameUniformBuffer = NULL;
 
 CScreenPassVBO* CBrushGlobalRes::s_pScreenRenderPassVBO = NULL;
 
 CGeodesicMesh* CBrushGlobalRes::s_pGeodesicMesh = NULL;
+CMeshBVH* CBrushGlobalRes::s_pSmoothMeshBVH = NULL;
+CVertexKdTree* CBrushGlobalRes::s_pSmoothMeshKdTree = NULL;
 
 CImage2D * CBrushGlobalRes::s_pSourceImg = NULL;
 CGLTexture* CBrushGlobalRes::s_pGLTexture = NULL;
@@ -63,6 +70,12 @@ void CBrushGlobalRes::initGlobalResource()
 	// Setup geodesic mesh
 	s_pGeodesicMesh = new CGeodesicMesh(s_pSmoothMesh);
 
+	// Both run on the thread pool shared with the software pick pass
+	s_pSmoothMeshBVH = new CMeshBVH();
+	s_pSmoothMeshBVH->build(s_pSmoothMesh);
+	s_pSmoothMeshKdTree = new CVertexKdTree();
+	s_pSmoothMeshKdTree->build(s_pSmoothMesh);
+
 	s_totalTriangleNum = s_pFlatMesh->getTriNum();
 
 	float *pMarkedTriIdx = new float[s_pFlatMesh->getTriNum() * 3];
@@ -76,14 +89,32 @@ void CBrushGlobalRes::initGlobalResource()
 	
 	SAFE_DELETE_ARRAY(pMarkedTriIdx);
 
+	// Composited stroke distance and local texcoord per vertex, created up front so their vertex buffer storage is allocated once
+	float *pGeoDis = new float[s_pSmoothMesh->getVerNum()];
+	vec2 *pTexcoord = new vec2[s_pSmoothMesh->getVerNum()];
+	for (int idx = 0; idx < s_pSmoothMesh->getVerNum(); ++idx)
+	{
+		pGeoDis[idx] = STROKE_DIS_NONE;
+		pTexcoord[idx] = CStrokeLayers::unpackTexcoord(STROKE_TEXCOORD_INVALID);
+	}
+	s_pSmoothMesh->setPropFloat(pGeoDis, s_pSmoothMesh->getVerNum());
+	s_pSmoothMesh->setPropFloat2(pTexcoord, s_pSmoothMesh->getVerNum());
+
+	SAFE_DELETE_ARRAY(pGeoDis);
+	SAFE_DELETE_ARRAY(pTexcoord);
+
 	s_pFlatMeshVBO = new CVertexBufferObject(s_pFlatMesh, VBOBM_BASICTRIANGLE | VBOBM_FLOAT_PROP);
-	s_pSmoothMeshVBO = new CVertexBufferObject(s_pSmoothMesh);
+	s_pSmoothMeshVBO = new CVertexBufferObject(s_pSmoothMesh, VBOBM_NORMALTRIANGLE | VBOBM_FLOAT_PROP | VBOBM_FLOAT2_PROP);
 	s_pScreenRenderPassVBO = new CScreenPassVBO();
 
 	s_pFrameBuffer = new CFrameBufferObject(winWidth, winHeight, 0);
-	s_pFrameBuffer->genTextureAndAttach(TEXELFMT_RGBA, TEXELTYPE_USIGNED_BYTE);
+	// Triangle index and packed barycentric coordinates of the pick pass
+	s_pFrameBuffer->genTextureAndAttach(TEXELFMT_RED_INTEGER, TEXELTYPE_USIGNED_INT);
+	s_pFrameBuffer->genTextureAndAttach(TEXELFMT_RED_INTEGER, TEXELTYPE_USIGNED_INT);
 
 	// Init shader programs
+	s_pFrameUniformBuffer = new CFrameUniformBuffer();
+
 	s_pTrackProgram = new CShaderProgram();
 	s_pTrackProgram->attachShader(CShaderManager::ST_VERTEX, "shaders/triangleTrack.vert");
 	s_pTrackProgram->attachShader(CShaderManager::ST_FRAGMENT, "shaders/triangleTrack.frag");
@@ -91,6 +122,7 @@ void CBrushGlobalRes::initGlobalResource()
 
 	s_pFinalRenderProgram = new CShaderProgram();
 	s_pFinalRenderProgram->attachShader(CShaderManager::ST_VERTEX, "shaders/basicPerpixelShading.vert");
+	s_pFinalRenderProgram->attachShader(CShaderManager::ST_GEOMETRY, "shaders/basicPerpixelShading.geom");
 	s_pFinalRenderProgram->attachShader(CShaderManager::ST_FRAGMENT, "shaders/basicPerpixelShading.frag");
 	s_pFinalRenderProgram->linkProgram();
 
@@ -115,8 +147,11 @@ void CBrushGlobalRes::releaseGlobalResource()
 	SAFE_DELETE(s_pTrackProgram);
 	SAFE_DELETE(s_pShowMarkProgram);
 	SAFE_DELETE(s_pFinalRenderProgram);
+	SAFE_DELETE(s_pFrameUniformBuffer);
 
 	SAFE_DELETE(s_pGeodesicMesh);
+	SAFE_DELETE(s_pSmoothMeshBVH);
+	SAFE_DELETE(s_pSmoothMeshKdTree);
 
 	SAFE_DELETE(s_pSourceImg);
 	SAFE_DELETE(s_pGLTexture);
@@ -13,7 +13,10 @@ class CScreenPassVBO;
 class CFrameBufferObject;
 class CPixelBufferObject;
 class CShaderProgram;
+class CFrameUniformBuffer;
 class CGeodesicMesh;
+class CMeshBVH;
+class CVertexKdTree;
 
 class CBrushGlobalRes
 {
@@ -36,8 +39,15 @@ public:
 	static CShaderProgram* s_pShowMarkProgram;
 	static CShaderProgram* s_pFinalRenderProgram;
 
+	// View constants shared by all programs
+	static CFrameUniformBuffer* s_pFrameUniformBuffer;
+
 	static CGeodesicMesh* s_pGeodesicMesh;
 
+	// Triangles of the smooth mesh for picking and proximity queries on CPU
+	static CMeshBVH* s_pSmoothMeshBVH;
+	static CVertexKdTree* s_pSmoothMeshKdTree;
+
 	static CImage2D* s_pSourceImg;
 	static CGLTexture* s_pGLTexture;
 
@@ -1,10 +1,13 @@
 #include "camera.h"
 
+#include <cmath>
+#include <cstring>
+
 #include "renderSystemConfig.h"
 
 using namespace TextureSynthesis;
 
-CCamera::CCamera()
+CCamera::CCamera() : m_viewport(0), m_position(0.0f), m_version(0)
 {
 	CRenderSystemConfig::getSysCfgInstance()->getCameraMView(m_lookX, m_lookY, m_lookZ, m_head, m_pitch, m_radius);
 	CRenderSystemConfig::getSysCfgInstance()->getCameraProj(m_fov, m_nearPlane, m_farPlane);
@@ -12,4 +15,60 @@ CCamera::CCamera()
 	m_focal.x = m_lookX;
 	m_focal.y = m_lookY;
 	m_focal.z = m_lookZ;
-};
\ No newline at end of file
+
+	for (int paramIdx = 0; paramIdx < 11; ++paramIdx)
+	{
+		m_builtParams[paramIdx] = -1.0f;
+	}
+};
+
+// Same matrices as gluPerspective and gluLookAt, built on the CPU so nothing reads them back from GL
+void CCamera::updateMatrices(int width, int height)
+{
+	float params[11] = { m_fov, m_nearPlane, m_farPlane, m_head, m_pitch, m_radius, m_lookX, m_lookY, m_lookZ, (float)width, (float)height };
+	if (memcmp(params, m_builtParams, sizeof(params)) == 0)
+	{
+		return;
+	}
+	memcpy(m_builtParams, params, sizeof(params));
+
+	m_viewport = ivec4(0, 0, width, height);
+
+	// Window aspect (assumes square pixels)
+	float aspectRatio = (float)width / (float)height;
+	float f = 1.0f / std::tan(glm::radians(m_fov) * 0.5f);
+
+	m_projMat = mat4(0.0f);
+	m_projMat[0][0] = f / aspectRatio;
+	m_projMat[1][1] = f;
+	m_projMat[2][2] = (m_farPlane + m_nearPlane) / (m_nearPlane - m_farPlane);
+	m_projMat[2][3] = -1.0f;
+	m_projMat[3][2] = 2.0f * m_farPlane * m_nearPlane / (m_nearPlane - m_farPlane);
+
+	m_position = vec3(m_lookX + m_radius * std::cos(glm::radians(m_head)) * std::sin(glm::radians(m_pitch)),
+		m_lookY + m_radius * std::sin(glm::radians(m_head)),
+		m_lookZ + m_radius * std::cos(glm::radians(m_head)) * std::cos(glm::radians(m_pitch)));
+
+	vec3 lookAt(m_lookX, m_lookY, m_lookZ);
+	vec3 up(0.0f, (std::cos(glm::radians(m_head)) > 0.0f) ? 1.0f : -1.0f, 0.0f);
+
+	vec3 forward = glm::normalize(lookAt - m_position);
+	vec3 side = glm::normalize(glm::cross(forward, up));
+	vec3 camUp = glm::cross(side, forward);
+
+	m_modelviewMat = mat4(1.0f);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_modelviewMat[axis][0] = side[axis];
+		m_modelviewMat[axis][1] = camUp[axis];
+		m_modelviewMat[axis][2] = -forward[axis];
+	}
+	m_modelviewMat[3][0] = -glm::dot(side, m_position);
+	m_modelviewMat[3][1] = -glm::dot(camUp, m_position);
+	m_modelviewMat[3][2] = glm::dot(forward, m_position);
+
+	m_invModelviewMat = glm::inverse(m_modelviewMat);
+	m_invProjMat = glm::inverse(m_projMat);
+
+	++m_version;
+}
\ No newline at end of file
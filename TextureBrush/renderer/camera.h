@@ -20,6 +20,17 @@ public:
 	void resetLookAt(){m_lookX = m_focal.x; m_lookY = m_focal.y; m_lookZ = m_focal.z;}
 	void setFocal(const float& x, const float& y, const float& z) {m_focal.x = x; m_focal.y = y; m_focal.z = z;}
 
+	// Rebuild the matrices if a parameter or the viewport changed since the last call, which bumps the version
+	void updateMatrices(int width, int height);
+
+	const mat4& getModelviewMat(){ return m_modelviewMat; }
+	const mat4& getProjMat(){ return m_projMat; }
+	const mat4& getInvModelviewMat(){ return m_invModelviewMat; }
+	const mat4& getInvProjMat(){ return m_invProjMat; }
+	const ivec4& getViewport(){ return m_viewport; }
+	const vec3& getPosition(){ return m_position; }
+	uint getVersion(){ return m_version; }
+
 public:
 	float m_fov, m_nearPlane, m_farPlane;
 
@@ -27,6 +38,16 @@ public:
 		  m_lookX, m_lookY, m_lookZ;
 
 	vec3 m_focal;
+
+private:
+	// Parameters and viewport size the matrices were built from
+	float m_builtParams[11];
+
+	mat4 m_modelviewMat, m_projMat;
+	mat4 m_invModelviewMat, m_invProjMat;
+	ivec4 m_viewport;
+	vec3 m_position;
+	uint m_version;
 };
 
 } // end namespace
\ No newline at end of file
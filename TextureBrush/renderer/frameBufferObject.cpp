@@ -1,7 +1,70 @@
 #include "frameBufferObject.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
+GLuint CFrameBufferObject::s_defaultFrameBuffer = 0;
+
+// Sized internal format a texture of the given format and type is renderable with
+static GLint internalFormat(TexelFormat vFmt, TexelType vType)
+{
+	switch (vFmt)
+	{
+	case TEXELFMT_RED_INTEGER:
+		switch (vType)
+		{
+		case TEXELTYPE_BYTE:
+			return GL_R8I;
+		case TEXELTYPE_USIGNED_BYTE:
+			return GL_R8UI;
+		case TEXELTYPE_SHORT:
+			return GL_R16I;
+		case TEXELTYPE_USIGNED_SHORT:
+			return GL_R16UI;
+		case TEXELTYPE_INT:
+			return GL_R32I;
+		case TEXELTYPE_USIGNED_INT:
+			return GL_R32UI;
+		default:
+			break;
+		}
+		break;
+	case TEXELFMT_RGB:
+	case TEXELFMT_BGR:
+		switch (vType)
+		{
+		case TEXELTYPE_USIGNED_BYTE:
+			return GL_RGB8;
+		case TEXELTYPE_HALF_FLOAT:
+			return GL_RGB16F;
+		case TEXELTYPE_FLOAT:
+			return GL_RGB32F;
+		default:
+			break;
+		}
+		break;
+	case TEXELFMT_RGBA:
+	case TEXELFMT_BGRA:
+		switch (vType)
+		{
+		case TEXELTYPE_USIGNED_BYTE:
+			return GL_RGBA8;
+		case TEXELTYPE_HALF_FLOAT:
+			return GL_RGBA16F;
+		case TEXELTYPE_FLOAT:
+			return GL_RGBA32F;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+
+	cout << "WARNING: No sized internal format for texel format " << vFmt << " and type " << vType << ", leaving it to the driver!" << endl;
+	return vFmt;
+}
+
 CFrameBufferObject::CFrameBufferObject(int width, int height, int colorTexNum): m_bufWidth(width), 
 m_bufHeight(height), m_colorTextureNum(colorTexNum), m_curAttachIdx(0)
 {
@@ -12,6 +75,12 @@ m_bufHeight(height), m_colorTextureNum(colorTexNum), m_curAttachIdx(0)
 
 CFrameBufferObject::~CFrameBufferObject()
 {
+	for (int idx = 0; idx < m_colorTextureNum; ++idx)
+	{
+		CGLStateCache::Instance()->forgetTexture(m_colorTex[idx]);
+	}
+	CGLStateCache::Instance()->forgetFrameBuffer(m_frameBuffer);
+
 	glDeleteTextures(m_colorTextureNum, m_colorTex);
 	glDeleteRenderbuffers(1, &m_depthBuffer);
 	glDeleteFramebuffers(1, &m_frameBuffer);
@@ -19,24 +88,24 @@ CFrameBufferObject::~CFrameBufferObject()
 
 void CFrameBufferObject::attachRenderTexture(GLuint texId, int attachId)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, m_frameBuffer);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachId, GL_TEXTURE_2D, texId, 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, s_defaultFrameBuffer);
 }
 
 void CFrameBufferObject::genTextureAndAttach(TexelFormat vFmt, TexelType vType)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, m_frameBuffer);
 
 	glGenTextures(1, &m_colorTex[m_curAttachIdx]);
-	glBindTexture(GL_TEXTURE_2D, m_colorTex[m_curAttachIdx]);
+	CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, m_colorTex[m_curAttachIdx]);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, m_bufWidth, m_bufHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(vFmt, vType), m_bufWidth, m_bufHeight, 0, vFmt, vType, NULL);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + m_curAttachIdx, GL_TEXTURE_2D, m_colorTex[m_curAttachIdx], 0);
 
@@ -45,8 +114,16 @@ void CFrameBufferObject::genTextureAndAttach(TexelFormat vFmt, TexelType vType)
 	++m_curAttachIdx;
 	++m_colorTextureNum;
 
+	// Fragment outputs go to every attached texture
+	GLenum drawBuffers[16];
+	for (int idx = 0; idx < m_curAttachIdx; ++idx)
+	{
+		drawBuffers[idx] = GL_COLOR_ATTACHMENT0 + idx;
+	}
+	glDrawBuffers(m_curAttachIdx, drawBuffers);
+
 	glFlush();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, s_defaultFrameBuffer);
 }
 
 void CFrameBufferObject::checkFBOStatus()
@@ -63,7 +140,7 @@ void CFrameBufferObject::checkFBOStatus()
 
 void CFrameBufferObject::activate()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, m_frameBuffer);
 	
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -71,13 +148,18 @@ void CFrameBufferObject::activate()
 
 void CFrameBufferObject::deactivate()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, s_defaultFrameBuffer);
+}
+
+void CFrameBufferObject::bindForRead()
+{
+	CGLStateCache::Instance()->bindFrameBuffer(GL_READ_FRAMEBUFFER, m_frameBuffer);
 }
 
 void CFrameBufferObject::genFrameBufferObject()
 {
 	glGenFramebuffers(1, &m_frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, m_frameBuffer);
 	cout << "Info: New frame buffer generated with ID " << m_frameBuffer << endl;
 
 	// Generate depth buffer
@@ -93,7 +175,7 @@ void CFrameBufferObject::genFrameBufferObject()
 		for (int idx = 0; idx < m_colorTextureNum; ++idx)
 		{
 			//glActiveTexture(GL_TEXTURE0 + idx);
-			glBindTexture(GL_TEXTURE_2D, m_colorTex[idx]);
+			CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, m_colorTex[idx]);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -106,7 +188,7 @@ void CFrameBufferObject::genFrameBufferObject()
 		}
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, s_defaultFrameBuffer);
 }
 
 void CFrameBufferObject::genColorTextures()
@@ -115,7 +197,7 @@ void CFrameBufferObject::genColorTextures()
 
 	for (int idx = 0; idx < m_colorTextureNum; ++idx)
 	{
-		glBindTexture(GL_TEXTURE_2D, m_colorTex[idx]);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, m_colorTex[idx]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -22,6 +22,15 @@ public:
 	void activate();
 	void deactivate();
 
+	// Bind as read frame buffer only, keeping its content
+	void bindForRead();
+
+	GLuint getFrameBuffer(){ return m_frameBuffer; }
+
+	// Frame buffer bound by deactivate, the window unless rendering offscreen
+	static void setDefaultFrameBuffer(GLuint frameBuffer){ s_defaultFrameBuffer = frameBuffer; }
+	static GLuint getDefaultFrameBuffer(){ return s_defaultFrameBuffer; }
+
 private:
 	void genFrameBufferObject();
 	void genColorTextures();
@@ -36,6 +45,8 @@ private:
 	int m_curAttachIdx;
 	int m_colorTextureNum;
 	int m_bufWidth, m_bufHeight;
+
+	static GLuint s_defaultFrameBuffer;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "frameProfiler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "renderUtilities.h"
+#include "viewer.h"
+#include "camera.h"
+#include "glStateCache.h"
+
+using namespace TextureSynthesis;
+
+// About ten seconds at 60 fps
+static const int s_profileRingSize = 600;
+
+// Bars are scaled so a 60 fps frame budget spans s_hudBudgetWidth pixels
+static const float s_hudBudgetMs = 1000.0f / 60.0f;
+static const float s_hudBudgetWidth = 200.0f;
+
+static const char* s_stageNames[PFS_TOTALNUM] =
+{
+	"frame", "pick_pass", "pick_readback", "publish", "fill_pass", "present",
+	"stroke_condition", "stroke_pick", "stroke_unproject", "stroke_seed", "stroke_march", "stroke_parametrize", "stroke_upload",
+	"geodesic_march", "input_latency"
+};
+
+// Swapping blocks on the display rather than on queued GL work, the stroke stages are not bracketed by queries
+static const bool s_stageHasGpu[PFS_TOTALNUM] =
+{
+	true, true, true, true, true, false,
+	false, false, false, false, false, false, false,
+	false, false
+};
+
+CFrameProfiler* CFrameProfiler::Instance()
+{
+	static CFrameProfiler *s_pFrameProfiler = NULL;
+
+	if (s_pFrameProfiler == NULL)
+	{
+		s_pFrameProfiler = new CFrameProfiler();
+	}
+
+	return s_pFrameProfiler;
+}
+
+CFrameProfiler::CFrameProfiler() : m_queriesCreated(false), m_timerQuerySupported(false), m_querySet(0), m_droppedQueryNum(0),
+	m_showHUD(false), m_titleChanged(false), m_lastTitleTime(0.0), m_startTime(CRenderUtilities::getTime()), m_lastExportTime(0.0)
+{
+	for (int stageIdx = 0; stageIdx < PFS_TOTALNUM; ++stageIdx)
+	{
+		m_cpuRings[stageIdx].sampleVec.resize(s_profileRingSize);
+		m_cpuRings[stageIdx].headIdx = 0;
+		m_cpuRings[stageIdx].sampleNum = 0;
+
+		m_gpuRings[stageIdx].sampleVec.resize(s_profileRingSize);
+		m_gpuRings[stageIdx].headIdx = 0;
+		m_gpuRings[stageIdx].sampleNum = 0;
+
+		m_passStartTime[stageIdx] = 0.0;
+
+		for (int setIdx = 0; setIdx < 2; ++setIdx)
+		{
+			m_queryIds[setIdx][stageIdx][0] = 0;
+			m_queryIds[setIdx][stageIdx][1] = 0;
+			m_queryIssued[setIdx][stageIdx] = false;
+		}
+	}
+}
+
+CFrameProfiler::~CFrameProfiler()
+{
+	if (m_queriesCreated && m_timerQuerySupported)
+	{
+		glDeleteQueries(2 * PFS_TOTALNUM * 2, &m_queryIds[0][0][0]);
+	}
+}
+
+const char* CFrameProfiler::getStageName(ProfileStage stage)
+{
+	return s_stageNames[stage];
+}
+
+void CFrameProfiler::beginFrame()
+{
+	// Queries need the context, which exists once the first frame starts
+	if (!m_queriesCreated)
+	{
+		m_queriesCreated = true;
+		m_timerQuerySupported = glewIsSupported("GL_ARB_timer_query") != 0;
+		if (m_timerQuerySupported)
+		{
+			glGenQueries(2 * PFS_TOTALNUM * 2, &m_queryIds[0][0][0]);
+		}
+		else
+		{
+			cout << "WARNING: GL_ARB_timer_query isn't supported, only CPU times are profiled!" << endl;
+		}
+	}
+
+	// The set issued two frames ago is reused for this frame, read it back first
+	m_querySet = 1 - m_querySet;
+	collectGpuSamples(m_querySet);
+
+	beginPass(PFS_FRAME);
+}
+
+void CFrameProfiler::endFrame()
+{
+	endPass(PFS_FRAME);
+
+	if (!m_csvPath.empty() && CRenderUtilities::getTime() - m_lastExportTime >= 1.0)
+	{
+		writeStats();
+	}
+}
+
+void CFrameProfiler::beginPass(ProfileStage stage)
+{
+	m_passStartTime[stage] = CRenderUtilities::getTime();
+
+	if (m_timerQuerySupported && s_stageHasGpu[stage])
+	{
+		glQueryCounter(m_queryIds[m_querySet][stage][0], GL_TIMESTAMP);
+	}
+}
+
+void CFrameProfiler::endPass(ProfileStage stage)
+{
+	if (m_timerQuerySupported && s_stageHasGpu[stage])
+	{
+		glQueryCounter(m_queryIds[m_querySet][stage][1], GL_TIMESTAMP);
+		m_queryIssued[m_querySet][stage] = true;
+	}
+
+	addCpuSample(stage, CRenderUtilities::getTime() - m_passStartTime[stage]);
+}
+
+void CFrameProfiler::addCpuSample(ProfileStage stage, double seconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	addSample(m_cpuRings[stage], float(seconds * 1000.0));
+}
+
+void CFrameProfiler::collectGpuSamples(int querySet)
+{
+	for (int stageIdx = 0; stageIdx < PFS_TOTALNUM; ++stageIdx)
+	{
+		if (!m_queryIssued[querySet][stageIdx])
+		{
+			continue;
+		}
+		m_queryIssued[querySet][stageIdx] = false;
+
+		// Waiting on a late result would stall the frame, the sample is dropped instead
+		GLint available = 0;
+		glGetQueryObjectiv(m_queryIds[querySet][stageIdx][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			++m_droppedQueryNum;
+			continue;
+		}
+
+		GLuint64 beginTime = 0, endTime = 0;
+		glGetQueryObjectui64v(m_queryIds[querySet][stageIdx][0], GL_QUERY_RESULT, &beginTime);
+		glGetQueryObjectui64v(m_queryIds[querySet][stageIdx][1], GL_QUERY_RESULT, &endTime);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		addSample(m_gpuRings[stageIdx], float(double(endTime - beginTime) / 1000000.0));
+	}
+}
+
+void CFrameProfiler::addSample(ProfileSampleRing &ring, float ms)
+{
+	ring.sampleVec[ring.headIdx] = ms;
+	ring.headIdx = (ring.headIdx + 1) % s_profileRingSize;
+	ring.sampleNum = std::min(ring.sampleNum + 1, s_profileRingSize);
+}
+
+// Nearest rank percentiles of the samples in the window
+void CFrameProfiler::computeStats(const ProfileSampleRing &ring, ProfileStats &stats)
+{
+	stats.sampleNum = ring.sampleNum;
+	stats.mean = stats.p50 = stats.p95 = stats.p99 = 0.0f;
+	if (ring.sampleNum == 0)
+	{
+		return;
+	}
+
+	vector<float> sortedVec(ring.sampleVec.begin(), ring.sampleVec.begin() + ring.sampleNum);
+	std::sort(sortedVec.begin(), sortedVec.end());
+
+	double sum = 0.0;
+	for (int idx = 0; idx < sortedVec.size(); ++idx)
+	{
+		sum += sortedVec[idx];
+	}
+	stats.mean = float(sum / ring.sampleNum);
+
+	int n = ring.sampleNum;
+	stats.p50 = sortedVec[std::max(int(ceil(0.50 * n)) - 1, 0)];
+	stats.p95 = sortedVec[std::max(int(ceil(0.95 * n)) - 1, 0)];
+	stats.p99 = sortedVec[std::max(int(ceil(0.99 * n)) - 1, 0)];
+}
+
+void CFrameProfiler::getStats(ProfileStage stage, bool gpu, ProfileStats &stats)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	computeStats(gpu ? m_gpuRings[stage] : m_cpuRings[stage], stats);
+}
+
+void CFrameProfiler::drawHUD(GLFWwindow *pWindow, const string &winTitle)
+{
+	if (!m_showHUD)
+	{
+		if (m_titleChanged && pWindow != NULL)
+		{
+			glfwSetWindowTitle(pWindow, winTitle.c_str());
+			m_titleChanged = false;
+		}
+		return;
+	}
+
+	ProfileStats cpuStats[PFS_TOTALNUM], gpuStats[PFS_TOTALNUM];
+	for (int stageIdx = 0; stageIdx < PFS_TOTALNUM; ++stageIdx)
+	{
+		getStats(ProfileStage(stageIdx), false, cpuStats[stageIdx]);
+		getStats(ProfileStage(stageIdx), true, gpuStats[stageIdx]);
+	}
+
+	// There's no text rendering, the numbers go to the window title twice a second
+	double curTime = CRenderUtilities::getTime();
+	if (pWindow != NULL && curTime - m_lastTitleTime >= 0.5)
+	{
+		m_lastTitleTime = curTime;
+		m_titleChanged = true;
+
+		char statText[256];
+		float frameMs = cpuStats[PFS_FRAME].mean;
+		sprintf(statText, " | %.1f fps | frame cpu %.2f gpu %.2f ms | pick %.2f | fill %.2f | p99 %.2f ms | gl %d skipped %d",
+			frameMs > 0.0f ? 1000.0f / frameMs : 0.0f, cpuStats[PFS_FRAME].p50, gpuStats[PFS_FRAME].p50,
+			gpuStats[PFS_PICK_PASS].p50, gpuStats[PFS_FILL_PASS].p50, cpuStats[PFS_FRAME].p99,
+			CGLStateCache::Instance()->getLastIssuedNum(), CGLStateCache::Instance()->getLastSkippedNum());
+		glfwSetWindowTitle(pWindow, (winTitle + statText).c_str());
+	}
+
+	ivec4 viewport = CViewer::getViewerInstance()->getCamera()->getViewport();
+
+	// The depth and polygon state changed here are popped back to what the state cache shadows,
+	// the program isn't part of the attribute stack
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+	CGLStateCache::Instance()->useProgram(0);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, viewport[2], viewport[3], 0.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	// One row per stage, median CPU bar in orange above median GPU bar in green
+	const float left = 10.0f, top = 10.0f, barHeight = 4.0f, rowHeight = 12.0f;
+	float pxPerMs = s_hudBudgetWidth / s_hudBudgetMs;
+
+	glBegin(GL_QUADS);
+	glColor4f(0.0f, 0.0f, 0.0f, 0.5f);
+	glVertex2f(left - 4.0f, top - 4.0f);
+	glVertex2f(left + 2.0f * s_hudBudgetWidth + 4.0f, top - 4.0f);
+	glVertex2f(left + 2.0f * s_hudBudgetWidth + 4.0f, top + rowHeight * PFS_TOTALNUM);
+	glVertex2f(left - 4.0f, top + rowHeight * PFS_TOTALNUM);
+
+	for (int stageIdx = 0; stageIdx < PFS_TOTALNUM; ++stageIdx)
+	{
+		float y = top + rowHeight * stageIdx;
+		float cpuWidth = std::min(cpuStats[stageIdx].p50 * pxPerMs, 2.0f * s_hudBudgetWidth);
+		float gpuWidth = std::min(gpuStats[stageIdx].p50 * pxPerMs, 2.0f * s_hudBudgetWidth);
+
+		glColor3f(1.0f, 0.6f, 0.1f);
+		glVertex2f(left, y);
+		glVertex2f(left + cpuWidth, y);
+		glVertex2f(left + cpuWidth, y + barHeight);
+		glVertex2f(left, y + barHeight);
+
+		glColor3f(0.2f, 0.9f, 0.3f);
+		glVertex2f(left, y + barHeight);
+		glVertex2f(left + gpuWidth, y + barHeight);
+		glVertex2f(left + gpuWidth, y + 2.0f * barHeight);
+		glVertex2f(left, y + 2.0f * barHeight);
+	}
+	glEnd();
+
+	// Frame budget mark
+	glBegin(GL_LINES);
+	glColor3f(1.0f, 0.2f, 0.2f);
+	glVertex2f(left + s_hudBudgetWidth, top - 4.0f);
+	glVertex2f(left + s_hudBudgetWidth, top + rowHeight * PFS_TOTALNUM);
+	glEnd();
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+}
+
+bool CFrameProfiler::startExport(const string &csvPath)
+{
+	std::ofstream csvFile(csvPath.c_str());
+	if (!csvFile)
+	{
+		cout << "ERROR: Can't write profile " << csvPath << "!" << endl;
+		return false;
+	}
+
+	csvFile << "time_s,stage,source,samples,mean_ms,p50_ms,p95_ms,p99_ms" << endl;
+
+	m_csvPath = csvPath;
+	m_lastExportTime = CRenderUtilities::getTime();
+
+	return true;
+}
+
+void CFrameProfiler::writeStats()
+{
+	if (m_csvPath.empty())
+	{
+		return;
+	}
+
+	m_lastExportTime = CRenderUtilities::getTime();
+
+	std::ofstream csvFile(m_csvPath.c_str(), std::ios::app);
+	if (!csvFile)
+	{
+		cout << "ERROR: Can't write profile " << m_csvPath << "!" << endl;
+		m_csvPath.clear();
+		return;
+	}
+
+	for (int stageIdx = 0; stageIdx < PFS_TOTALNUM; ++stageIdx)
+	{
+		for (int source = 0; source < 2; ++source)
+		{
+			ProfileStats stats;
+			getStats(ProfileStage(stageIdx), source == 1, stats);
+			if (stats.sampleNum == 0)
+			{
+				continue;
+			}
+
+			csvFile << m_lastExportTime - m_startTime << "," << s_stageNames[stageIdx] << "," << (source == 1 ? "gpu" : "cpu") << ","
+				<< stats.sampleNum << "," << stats.mean << "," << stats.p50 << "," << stats.p95 << "," << stats.p99 << endl;
+		}
+	}
+}
+
+CProfileScope::CProfileScope(ProfileStage stage) : m_stage(stage), m_startTime(CRenderUtilities::getTime())
+{
+}
+
+CProfileScope::~CProfileScope()
+{
+	CFrameProfiler::Instance()->addCpuSample(m_stage, CRenderUtilities::getTime() - m_startTime);
+}
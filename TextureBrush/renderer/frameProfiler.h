@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../preHeader.h"
+
+#include <mutex>
+
+namespace TextureSynthesis
+{
+
+enum ProfileStage
+{
+	// Render loop passes, timed on CPU and with GL timestamps on GPU
+	PFS_FRAME = 0,
+	PFS_PICK_PASS,
+	PFS_PICK_READBACK,
+	PFS_PUBLISH,
+	PFS_FILL_PASS,
+	PFS_PRESENT,
+
+	// Compute stages of a stroke in StrokeStage order, then geodesic marching, CPU only
+	PFS_STROKE_CONDITION,
+	PFS_STROKE_PICK,
+	PFS_STROKE_UNPROJECT,
+	PFS_STROKE_SEED,
+	PFS_STROKE_MARCH,
+	PFS_STROKE_PARAMETRIZE,
+	PFS_STROKE_UPLOAD,
+	PFS_GEODESIC_MARCH,
+
+	// From the first input of a frame to its present, CPU only
+	PFS_INPUT_LATENCY,
+	PFS_TOTALNUM
+};
+
+// Rolling window of the latest samples of one stage, in milliseconds
+struct ProfileSampleRing
+{
+	vector<float> sampleVec;
+	int headIdx;
+	int sampleNum;
+};
+
+struct ProfileStats
+{
+	int sampleNum;
+	float mean, p50, p95, p99;
+};
+
+// Per stage CPU and GPU timings of the render loop and stroke computation. GPU passes are
+// bracketed by timestamp queries in two sets, a set is read back a frame after it was issued
+// if its results are available, so the pipeline never waits on them. CPU samples may come
+// from any thread.
+class CFrameProfiler
+{
+public:
+	static CFrameProfiler* Instance();
+	virtual ~CFrameProfiler();
+
+	void beginFrame();
+	void endFrame();
+
+	// Render thread only, passes may nest but a stage is timed once per frame
+	void beginPass(ProfileStage stage);
+	void endPass(ProfileStage stage);
+
+	void addCpuSample(ProfileStage stage, double seconds);
+
+	void getStats(ProfileStage stage, bool gpu, ProfileStats &stats);
+
+	// Bars of the median CPU and GPU time per stage in the top left corner, statistics in the window title
+	void drawHUD(GLFWwindow *pWindow, const string &winTitle);
+	void toggleHUD(){ m_showHUD = !m_showHUD; }
+
+	// Append the statistics of the rolling windows to the CSV every second and at exit
+	bool startExport(const string &csvPath);
+	void writeStats();
+
+	// GPU samples whose queries weren't done two frames later
+	int getDroppedQueryNum(){ return m_droppedQueryNum; }
+
+	static const char* getStageName(ProfileStage stage);
+
+protected:
+	CFrameProfiler();
+
+	void collectGpuSamples(int querySet);
+	void addSample(ProfileSampleRing &ring, float ms);
+	static void computeStats(const ProfileSampleRing &ring, ProfileStats &stats);
+
+private:
+	std::mutex m_mutex;
+	ProfileSampleRing m_cpuRings[PFS_TOTALNUM];
+	ProfileSampleRing m_gpuRings[PFS_TOTALNUM];
+
+	// Timestamp queries per query set and stage, begin and end
+	GLuint m_queryIds[2][PFS_TOTALNUM][2];
+	bool m_queryIssued[2][PFS_TOTALNUM];
+	bool m_queriesCreated;
+	bool m_timerQuerySupported;
+	int m_querySet;
+	int m_droppedQueryNum;
+
+	double m_passStartTime[PFS_TOTALNUM];
+
+	bool m_showHUD;
+	bool m_titleChanged;
+	double m_lastTitleTime;
+
+	double m_startTime;
+	string m_csvPath;
+	double m_lastExportTime;
+};
+
+// Adds the CPU time of its scope to a stage
+class CProfileScope
+{
+public:
+	explicit CProfileScope(ProfileStage stage);
+	~CProfileScope();
+
+private:
+	ProfileStage m_stage;
+	double m_startTime;
+};
+
+}
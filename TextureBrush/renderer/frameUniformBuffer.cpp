@@ -0,0 +1,34 @@
+#include "frameUniformBuffer.h"
+
+using namespace TextureSynthesis;
+
+CFrameUniformBuffer::CFrameUniformBuffer() : m_bufferId(0)
+{
+	glGenBuffers(1, &m_bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_bufferId);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// The binding point is never used for anything else, so it's bound once
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_bufferId);
+}
+
+CFrameUniformBuffer::~CFrameUniformBuffer()
+{
+	if (m_bufferId != 0)
+	{
+		glDeleteBuffers(1, &m_bufferId);
+	}
+}
+
+void CFrameUniformBuffer::update(const mat4 &modelviewMat, const mat4 &projMat)
+{
+	m_data.modelviewMat = modelviewMat;
+	m_data.projMat = projMat;
+	m_data.mvpMat = projMat * modelviewMat;
+	m_data.normalMat = transpose(inverse(modelviewMat));
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_bufferId);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniformData), &m_data.modelviewMat[0][0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+#define FRAME_UNIFORM_BINDING 0
+
+// std140 layout of the FrameUniforms block, all members are mat4 so no padding is needed.
+// The normal matrix is the inverse transpose of the model view matrix.
+struct FrameUniformData
+{
+	mat4 modelviewMat;
+	mat4 projMat;
+	mat4 mvpMat;
+	mat4 normalMat;
+};
+
+// Uniform buffer with the view constants of a frame, bound to FRAME_UNIFORM_BINDING for every
+// program declaring the FrameUniforms block. Updated once per frame instead of once per program.
+class CFrameUniformBuffer
+{
+public:
+	CFrameUniformBuffer();
+	virtual ~CFrameUniformBuffer();
+
+	void update(const mat4 &modelviewMat, const mat4 &projMat);
+
+	const FrameUniformData& getData(){ return m_data; }
+
+	static const char* getBlockName(){ return "FrameUniforms"; }
+
+private:
+	GLuint m_bufferId;
+	FrameUniformData m_data;
+};
+
+}
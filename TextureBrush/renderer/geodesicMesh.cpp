@@ -1,6 +1,8 @@
 #include "geodesicMesh.h"
 
 #include "triangleMesh.h"
+#include "frameProfiler.h"
+#include "traceRecorder.h"
 #include "GW_GeodesicMesh.h"
 #include "GW_GeodesicPath.h"
 #include "GW_Vertex.h"
@@ -9,13 +11,16 @@
 using namespace TextureSynthesis;
 using namespace GW;
 
+// Distance stop criteria shared with the stop callback, which gets no user data from the library
+static float s_fastMarchingStopDistance = 10000.0f;
+
 // This callback is called every time a front vertex is visited to check
 // if we should terminate marching.
 static GW::GW_Bool FastMarchingStopCallback(
 	GW::GW_GeodesicVertex& v, void *callbackData)
 {
 	// Stop if the vertex is farther than the distance stop criteria
-	return (10000.0f <= v.GetDistance());
+	return (s_fastMarchingStopDistance <= v.GetDistance());
 }
 
 
@@ -119,6 +124,9 @@ void CGeodesicMesh::addSeed(int triIdx)
 
 void CGeodesicMesh::computeGeodesics(float *pDis)
 {
+	CProfileScope profileScope(PFS_GEODESIC_MARCH);
+	TRACE_SCOPE("geodesicMarch");
+
 	m_pGeoMesh->SetUpFastMarching();
 
 	while (!m_pGeoMesh->PerformFastMarchingOneStep())
@@ -151,8 +159,81 @@ void CGeodesicMesh::computeGeodesics(float *pDis)
 	}
 }
 
+void CGeodesicMesh::setStopDistance(float stopDistance)
+{
+	m_stopDistance = stopDistance;
+	s_fastMarchingStopDistance = stopDistance;
+}
+
+// Walk the reached region from the seeds through the vertex face adjacency,
+// so the cost follows the marched band instead of the whole mesh
+void CGeodesicMesh::collectReachedVertices(const vector<int>& seedVerIdxVec, vector<int>& verIdxVec, vector<float>& disVec)
+{
+	verIdxVec.clear();
+	disVec.clear();
+
+	const int *pVerFaceOffsets = m_pTriMesh->getVerFaceOffsets();
+	const int *pVerFaceIndices = m_pTriMesh->getVerFaceIndices();
+	const ivec3 *pTriIndices = m_pTriMesh->getTriIdx();
+
+	if (m_verVisited.size() != m_pTriMesh->getVerNum())
+	{
+		m_verVisited.assign(m_pTriMesh->getVerNum(), 0);
+	}
+
+	for (int seedIdx = 0; seedIdx < seedVerIdxVec.size(); ++seedIdx)
+	{
+		int verIdx = seedVerIdxVec[seedIdx];
+		if (!m_verVisited[verIdx])
+		{
+			m_verVisited[verIdx] = 1;
+			verIdxVec.push_back(verIdx);
+		}
+	}
+
+	// verIdxVec doubles as the traversal queue
+	for (int queueIdx = 0; queueIdx < verIdxVec.size(); ++queueIdx)
+	{
+		int verIdx = verIdxVec[queueIdx];
+
+		for (int adjIdx = pVerFaceOffsets[verIdx]; adjIdx < pVerFaceOffsets[verIdx + 1]; ++adjIdx)
+		{
+			const ivec3 &tri = pTriIndices[pVerFaceIndices[adjIdx]];
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				int adjVerIdx = tri[corner];
+				if (m_verVisited[adjVerIdx])
+				{
+					continue;
+				}
+
+				GW::GW_GeodesicVertex* vertex =
+					(GW::GW_GeodesicVertex*)(m_pGeoMesh->GetVertex((GW::GW_U32)adjVerIdx));
+
+				if (vertex->GetState() > 1 && vertex->GetDistance() <= m_stopDistance)
+				{
+					m_verVisited[adjVerIdx] = 1;
+					verIdxVec.push_back(adjVerIdx);
+				}
+			}
+		}
+	}
+
+	disVec.resize(verIdxVec.size());
+	for (int idx = 0; idx < verIdxVec.size(); ++idx)
+	{
+		GW::GW_GeodesicVertex* vertex =
+			(GW::GW_GeodesicVertex*)(m_pGeoMesh->GetVertex((GW::GW_U32)verIdxVec[idx]));
+		disVec[idx] = vertex->GetDistance();
+
+		m_verVisited[verIdxVec[idx]] = 0;
+	}
+}
+
 void CGeodesicMesh::computePath(int startIdx, int endIdx)
 {
+	TRACE_SCOPE("geodesicPath");
+
 	resetGeoMesh();
 	addSeed(endIdx);
 
@@ -22,11 +22,14 @@ public:
 	void addSeeds(const vector<int>& seedTriIdxVec);
 	
 	void computeGeodesics(float *pDis);
+	// Reached vertices and their distances after computeGeodesics, in traversal order
+	void collectReachedVertices(const vector<int>& seedVerIdxVec, vector<int>& verIdxVec, vector<float>& disVec);
 	void refinePath(int startIdx);
 	void computePath(int startIdx, int endIdx);
 	void getVertexPos(int idx, vec3* buff);
 
 	float getStopDistance(){ return m_stopDistance; }
+	void setStopDistance(float stopDistance);
 	const vector<int>& getZeroOrderPathIdxVec(){ return m_zeroOrderPathIdxVec; }
 	const vector<int>& getFirstOrderPathIdxVec(){ return m_firstOrderPathIdxVec; }
 
@@ -41,6 +44,8 @@ private:
 	vector<vec3> m_pathPointVec;
 
 	float m_pathLength;
+
+	vector<unsigned char> m_verVisited;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "glStateCache.h"
+
+using namespace TextureSynthesis;
+
+// Never a valid name or enum, so the first set after an invalidation is always issued
+static const GLuint s_unknownState = 0xFFFFFFFF;
+
+static int textureTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_1D:
+		return GSTT_1D;
+	case GL_TEXTURE_3D:
+		return GSTT_3D;
+	default:
+		return GSTT_2D;
+	}
+}
+
+CGLStateCache* CGLStateCache::Instance()
+{
+	static CGLStateCache *s_pStateCache = NULL;
+
+	if (s_pStateCache == NULL)
+	{
+		s_pStateCache = new CGLStateCache();
+	}
+
+	return s_pStateCache;
+}
+
+CGLStateCache::CGLStateCache() : m_issuedNum(0), m_skippedNum(0), m_lastIssuedNum(0), m_lastSkippedNum(0),
+	m_totalIssuedNum(0), m_totalSkippedNum(0), m_frameNum(0),
+	m_frameStarted(false)
+{
+	invalidate();
+}
+
+CGLStateCache::~CGLStateCache()
+{
+}
+
+void CGLStateCache::invalidate()
+{
+	m_program = m_vao = s_unknownState;
+	m_activeUnit = -1;
+	for (int unit = 0; unit < GL_STATE_TEXTURE_UNIT_NUM; ++unit)
+	{
+		for (int targetIdx = 0; targetIdx < GSTT_TOTALNUM; ++targetIdx)
+		{
+			m_textures[unit][targetIdx] = s_unknownState;
+		}
+	}
+	m_drawFrameBuffer = m_readFrameBuffer = s_unknownState;
+	m_polygonMode = m_depthFunc = s_unknownState;
+	m_depthTest = m_depthMask = -1;
+}
+
+bool CGLStateCache::useProgram(GLuint program)
+{
+	if (program == m_program)
+	{
+		return skip();
+	}
+
+	glUseProgram(program);
+	m_program = program;
+	return issue();
+}
+
+bool CGLStateCache::bindVertexArray(GLuint vao)
+{
+	if (vao == m_vao)
+	{
+		return skip();
+	}
+
+	glBindVertexArray(vao);
+	m_vao = vao;
+	return issue();
+}
+
+bool CGLStateCache::setActiveTexture(int unit)
+{
+	if (unit == m_activeUnit)
+	{
+		return skip();
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	m_activeUnit = unit;
+	return issue();
+}
+
+bool CGLStateCache::bindTexture(int unit, GLenum target, GLuint texture)
+{
+	if (unit < 0 || unit >= GL_STATE_TEXTURE_UNIT_NUM)
+	{
+		cout << "WARNING: Texture unit " << unit << " isn't shadowed by the state cache!" << endl;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		m_activeUnit = -1;
+		return issue();
+	}
+
+	GLuint &boundTexture = m_textures[unit][textureTargetIndex(target)];
+	if (texture == boundTexture)
+	{
+		return skip();
+	}
+
+	setActiveTexture(unit);
+	glBindTexture(target, texture);
+	boundTexture = texture;
+	return issue();
+}
+
+bool CGLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+	if (m_activeUnit < 0)
+	{
+		// Nothing is known about the active unit, make it the first one
+		setActiveTexture(0);
+	}
+
+	return bindTexture(m_activeUnit, target, texture);
+}
+
+bool CGLStateCache::bindFrameBuffer(GLenum target, GLuint frameBuffer)
+{
+	if (target == GL_READ_FRAMEBUFFER)
+	{
+		if (frameBuffer == m_readFrameBuffer)
+		{
+			return skip();
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
+		m_readFrameBuffer = frameBuffer;
+		return issue();
+	}
+
+	if (target == GL_DRAW_FRAMEBUFFER)
+	{
+		if (frameBuffer == m_drawFrameBuffer)
+		{
+			return skip();
+		}
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+		m_drawFrameBuffer = frameBuffer;
+		return issue();
+	}
+
+	if (frameBuffer == m_drawFrameBuffer && frameBuffer == m_readFrameBuffer)
+	{
+		return skip();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+	m_drawFrameBuffer = m_readFrameBuffer = frameBuffer;
+	return issue();
+}
+
+bool CGLStateCache::setPolygonMode(GLenum polygonMode)
+{
+	if (polygonMode == m_polygonMode)
+	{
+		return skip();
+	}
+
+	glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+	m_polygonMode = polygonMode;
+	return issue();
+}
+
+bool CGLStateCache::setDepthTest(bool enabled)
+{
+	if (int(enabled) == m_depthTest)
+	{
+		return skip();
+	}
+
+	if (enabled)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	else
+	{
+		glDisable(GL_DEPTH_TEST);
+	}
+	m_depthTest = int(enabled);
+	return issue();
+}
+
+bool CGLStateCache::setDepthFunc(GLenum depthFunc)
+{
+	if (depthFunc == m_depthFunc)
+	{
+		return skip();
+	}
+
+	glDepthFunc(depthFunc);
+	m_depthFunc = depthFunc;
+	return issue();
+}
+
+bool CGLStateCache::setDepthMask(bool enabled)
+{
+	if (int(enabled) == m_depthMask)
+	{
+		return skip();
+	}
+
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	m_depthMask = int(enabled);
+	return issue();
+}
+
+void CGLStateCache::forgetProgram(GLuint program)
+{
+	// A deleted program stays in use until another one is, only its name may come back
+	if (program == m_program)
+	{
+		m_program = s_unknownState;
+	}
+}
+
+void CGLStateCache::forgetVertexArray(GLuint vao)
+{
+	if (vao == m_vao)
+	{
+		m_vao = 0;
+	}
+}
+
+void CGLStateCache::forgetTexture(GLuint texture)
+{
+	for (int unit = 0; unit < GL_STATE_TEXTURE_UNIT_NUM; ++unit)
+	{
+		for (int targetIdx = 0; targetIdx < GSTT_TOTALNUM; ++targetIdx)
+		{
+			if (m_textures[unit][targetIdx] == texture)
+			{
+				m_textures[unit][targetIdx] = 0;
+			}
+		}
+	}
+}
+
+void CGLStateCache::forgetFrameBuffer(GLuint frameBuffer)
+{
+	if (frameBuffer == m_drawFrameBuffer)
+	{
+		m_drawFrameBuffer = 0;
+	}
+	if (frameBuffer == m_readFrameBuffer)
+	{
+		m_readFrameBuffer = 0;
+	}
+}
+
+void CGLStateCache::beginFrame()
+{
+	// Calls before the first frame are setup, not counted
+	if (m_frameStarted)
+	{
+		m_lastIssuedNum = m_issuedNum;
+		m_lastSkippedNum = m_skippedNum;
+		m_totalIssuedNum += m_issuedNum;
+		m_totalSkippedNum += m_skippedNum;
+		++m_frameNum;
+	}
+
+	m_issuedNum = m_skippedNum = 0;
+	m_frameStarted = true;
+}
+
+void CGLStateCache::printStats()
+{
+	if (m_frameNum == 0)
+	{
+		return;
+	}
+
+	cout << "Info: GL state cache issued " << double(m_totalIssuedNum) / m_frameNum << " and skipped "
+		<< double(m_totalSkippedNum) / m_frameNum << " redundant binds and state changes per frame" << endl;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+#define GL_STATE_TEXTURE_UNIT_NUM 16
+
+// Texture targets shadowed per unit
+enum GLStateTextureTarget
+{
+	GSTT_1D = 0,
+	GSTT_2D,
+	GSTT_3D,
+	GSTT_TOTALNUM
+};
+
+// Shadow of the bound program, vertex array, textures per unit, frame buffers, polygon mode and depth
+// state. Every bind of these goes through the cache on the render thread and is only issued when it
+// changes the state. The set functions return whether the GL call was issued.
+// Code changing the state behind the cache's back (DevIL, glPopAttrib of a pushed bit) must call
+// invalidate, deleting a bound object must call the matching forget function as GL falls back to 0.
+class CGLStateCache
+{
+public:
+	static CGLStateCache* Instance();
+	virtual ~CGLStateCache();
+
+	bool useProgram(GLuint program);
+	GLuint getProgram(){ return m_program; }
+	bool bindVertexArray(GLuint vao);
+
+	// Binds on the given unit, activating it if needed
+	bool bindTexture(int unit, GLenum target, GLuint texture);
+	// Binds on the active unit, for texture creation and uploads
+	bool bindTexture(GLenum target, GLuint texture);
+	bool setActiveTexture(int unit);
+
+	// GL_FRAMEBUFFER binds both the draw and the read frame buffer
+	bool bindFrameBuffer(GLenum target, GLuint frameBuffer);
+
+	bool setPolygonMode(GLenum polygonMode);
+	bool setDepthTest(bool enabled);
+	bool setDepthFunc(GLenum depthFunc);
+	bool setDepthMask(bool enabled);
+
+	void forgetProgram(GLuint program);
+	void forgetVertexArray(GLuint vao);
+	void forgetTexture(GLuint texture);
+	void forgetFrameBuffer(GLuint frameBuffer);
+
+	void invalidate();
+
+	// Rolls the per frame counters, called at the start of every frame
+	void beginFrame();
+
+	int getLastIssuedNum(){ return m_lastIssuedNum; }
+	int getLastSkippedNum(){ return m_lastSkippedNum; }
+	void printStats();
+
+protected:
+	CGLStateCache();
+
+	bool skip(){ ++m_skippedNum; return false; }
+	bool issue(){ ++m_issuedNum; return true; }
+
+private:
+	GLuint m_program;
+	GLuint m_vao;
+	int m_activeUnit;
+	GLuint m_textures[GL_STATE_TEXTURE_UNIT_NUM][GSTT_TOTALNUM];
+	GLuint m_drawFrameBuffer;
+	GLuint m_readFrameBuffer;
+	GLenum m_polygonMode;
+	int m_depthTest;
+	GLenum m_depthFunc;
+	int m_depthMask;
+
+	int m_issuedNum, m_skippedNum;
+	int m_lastIssuedNum, m_lastSkippedNum;
+	long long m_totalIssuedNum, m_totalSkippedNum;
+	int m_frameNum;
+	bool m_frameStarted;
+};
+
+}
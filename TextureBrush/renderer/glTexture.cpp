@@ -1,5 +1,6 @@
 #include "glTexture.h"
 #include "image2D.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
@@ -86,7 +87,7 @@ void CGLTexture::createGLTexture()
 	if (TEXTYPE_2D == m_textureType)
 	{
 		glGenTextures(1, &m_glTexHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glTexHandle);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, m_glTexHandle);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -102,12 +103,12 @@ void CGLTexture::createGLTexture()
 			glTexImage2D(GL_TEXTURE_2D, 0, m_texelFmt, m_texWidth, m_texHeight, 0, m_texelFmt, m_texelType, NULL);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, 0);
 	}
 	else if (TEXTYPE_3D == m_textureType)
 	{
 		glGenTextures(1, &m_glTexHandle);
-		glBindTexture(GL_TEXTURE_3D, m_glTexHandle);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_3D, m_glTexHandle);
 
 		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -124,7 +125,7 @@ void CGLTexture::createGLTexture()
 			glTexImage2D(GL_TEXTURE_3D, 0, m_texelFmt, m_texWidth, m_texHeight, m_texDepth, m_texelFmt, m_texelType, NULL);
 		}
 
-		glBindTexture(GL_TEXTURE_3D, 0);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_3D, 0);
 	}
 	else
 	{
@@ -144,6 +145,7 @@ void CGLTexture::releaseGLTexResource()
 
 	if (glIsTexture(m_glTexHandle))
 	{
+		CGLStateCache::Instance()->forgetTexture(m_glTexHandle);
 		glDeleteTextures(1, &m_glTexHandle);
 	}
 }
\ No newline at end of file
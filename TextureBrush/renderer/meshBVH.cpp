@@ -0,0 +1,779 @@
+#include "meshBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <emmintrin.h>
+
+#include "triangleMesh.h"
+#include "threadPool.h"
+#include "renderUtilities.h"
+
+using namespace TextureSynthesis;
+
+#define BVH_LEAF_SIZE 4
+#define BVH_BIN_NUM 16
+#define BVH_STACK_SIZE 128
+#define BVH_SAH_MAX_DEPTH 48
+#define BVH_PACKET_FLOATS 36
+#define BVH_RAY_BATCH_SIZE 64
+#define BVH_SERIAL_SPLIT_MIN_TRIS 4096
+#define BVH_JOBS_PER_THREAD 8
+
+static inline float boundArea(const vec3 &boundMin, const vec3 &boundMax)
+{
+	vec3 extent = boundMax - boundMin;
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static inline float boundDistanceSq(const BVHNode &node, const vec3 &pos)
+{
+	vec3 offset = glm::max(glm::max(node.boundMin - pos, pos - node.boundMax), vec3(0.0f));
+	return dot(offset, offset);
+}
+
+// Entry distance of the ray into the node bound, FLT_MAX if it misses within [0, maxT]. The fourth
+// lane holds the index fields of the node and is never looked at.
+static inline float intersectBound(const BVHNode &node, __m128 originV, __m128 invDirV, float maxT)
+{
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.boundMin.x), originV), invDirV);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.boundMax.x), originV), invDirV);
+	__m128 tNear = _mm_min_ps(t0, t1);
+	__m128 tFar = _mm_max_ps(t0, t1);
+
+	__m128 tEnter = _mm_max_ss(_mm_max_ss(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 1, 1, 1))),
+		_mm_max_ss(_mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 2, 2, 2)), _mm_setzero_ps()));
+	__m128 tExit = _mm_min_ss(_mm_min_ss(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 1, 1, 1))),
+		_mm_min_ss(_mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 2, 2, 2)), _mm_set_ss(maxT)));
+
+	float enter = _mm_cvtss_f32(tEnter);
+	return enter <= _mm_cvtss_f32(tExit) ? enter : FLT_MAX;
+}
+
+// Real-Time Collision Detection 5.1.5, closest point by the Voronoi region of the triangle it falls in
+static vec3 closestPointOnTriangle(const vec3 &p, const vec3 &a, const vec3 &b, const vec3 &c)
+{
+	vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = dot(ab, ap), d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+	vec3 bp = p - b;
+	float d3 = dot(ab, bp), d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+	vec3 cp = p - c;
+	float d5 = dot(ab, cp), d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+CMeshBVH::CMeshBVH(CThreadPool *pThreadPool) : m_pMesh(NULL), m_geometryVersion(0)
+{
+	m_pThreadPool = pThreadPool != NULL ? pThreadPool : CThreadPool::Instance();
+}
+
+CMeshBVH::~CMeshBVH()
+{
+
+}
+
+void CMeshBVH::build(CTriangleMesh *pMesh)
+{
+	double startTime = CRenderUtilities::getTime();
+
+	m_pMesh = pMesh;
+	m_geometryVersion = pMesh->getGeometryVersion();
+
+	m_nodeVec.clear();
+	m_leafTriIdxVec.clear();
+	m_leafPacketVec.clear();
+
+	const int triNum = pMesh->getTriNum();
+	if (triNum == 0)
+	{
+		return;
+	}
+
+	const ivec3 *pTriIndices = pMesh->getTriIdx();
+	const vec3 *pVertices = pMesh->getVertices();
+	const int threadNum = m_pThreadPool->getThreadNum();
+	const int chunkNum = threadNum * BVH_JOBS_PER_THREAD;
+
+	m_triOrderVec.resize(triNum);
+	m_triBoundMinVec.resize(triNum);
+	m_triBoundMaxVec.resize(triNum);
+	m_triCentroidVec.resize(triNum);
+
+	m_pThreadPool->parallelFor(chunkNum, [&](int chunkIdx)
+	{
+		const int endIdx = (long long)triNum * (chunkIdx + 1) / chunkNum;
+		for (int triIdx = (long long)triNum * chunkIdx / chunkNum; triIdx < endIdx; ++triIdx)
+		{
+			const vec3 &a = pVertices[pTriIndices[triIdx][0]];
+			const vec3 &b = pVertices[pTriIndices[triIdx][1]];
+			const vec3 &c = pVertices[pTriIndices[triIdx][2]];
+
+			m_triOrderVec[triIdx] = triIdx;
+			m_triBoundMinVec[triIdx] = glm::min(glm::min(a, b), c);
+			m_triBoundMaxVec[triIdx] = glm::max(glm::max(a, b), c);
+			m_triCentroidVec[triIdx] = (m_triBoundMinVec[triIdx] + m_triBoundMaxVec[triIdx]) * 0.5f;
+		}
+	});
+
+	// Split the top of the tree here until there are enough subtrees to keep every thread busy,
+	// each pending range is (node index, begin, end, depth)
+	m_nodeVec.push_back(BVHNode());
+	vector<ivec4> rangeVec(1, ivec4(0, 0, triNum, 0));
+	vector<ivec4> jobVec;
+	for (int rangeIdx = 0; rangeIdx < rangeVec.size(); ++rangeIdx)
+	{
+		ivec4 range = rangeVec[rangeIdx];
+		if (range[2] - range[1] < BVH_SERIAL_SPLIT_MIN_TRIS || jobVec.size() + rangeVec.size() - rangeIdx >= chunkNum)
+		{
+			jobVec.push_back(range);
+			continue;
+		}
+
+		computeNodeBound(m_nodeVec[range[0]], range[1], range[2]);
+		int mid = partitionTriangles(range[1], range[2]);
+
+		int leftIdx = m_nodeVec.size();
+		m_nodeVec[range[0]].firstIdx = leftIdx;
+		m_nodeVec[range[0]].triNum = 0;
+		m_nodeVec.resize(leftIdx + 2);
+
+		rangeVec.push_back(ivec4(leftIdx, range[1], mid, range[3] + 1));
+		rangeVec.push_back(ivec4(leftIdx + 1, mid, range[2], range[3] + 1));
+	}
+
+	vector<vector<BVHNode> > jobNodeVec(jobVec.size());
+	m_pThreadPool->parallelFor(jobVec.size(), [&](int jobIdx)
+	{
+		buildSubtree(jobVec[jobIdx][1], jobVec[jobIdx][2], jobVec[jobIdx][3], jobNodeVec[jobIdx]);
+	});
+
+	// Subtree roots take the place reserved for them, the rest is appended with child indices shifted
+	for (int jobIdx = 0; jobIdx < jobVec.size(); ++jobIdx)
+	{
+		const vector<BVHNode> &subtreeVec = jobNodeVec[jobIdx];
+		const int offset = m_nodeVec.size() - 1;
+
+		for (int localIdx = 0; localIdx < subtreeVec.size(); ++localIdx)
+		{
+			BVHNode node = subtreeVec[localIdx];
+			if (node.triNum == 0)
+			{
+				node.firstIdx += offset;
+			}
+
+			if (localIdx == 0)
+			{
+				m_nodeVec[jobVec[jobIdx][0]] = node;
+			}
+			else
+			{
+				m_nodeVec.push_back(node);
+			}
+		}
+	}
+
+	// Leaves point at their triangle range until the packets are laid out
+	vector<ivec2> leafRangeVec;
+	for (int nodeIdx = 0; nodeIdx < m_nodeVec.size(); ++nodeIdx)
+	{
+		if (m_nodeVec[nodeIdx].triNum > 0)
+		{
+			leafRangeVec.push_back(ivec2(m_nodeVec[nodeIdx].firstIdx, m_nodeVec[nodeIdx].triNum));
+			m_nodeVec[nodeIdx].firstIdx = leafRangeVec.size() - 1;
+		}
+	}
+
+	const int leafNum = leafRangeVec.size();
+	m_leafTriIdxVec.resize(leafNum * BVH_LEAF_SIZE);
+	m_leafPacketVec.resize(leafNum * BVH_PACKET_FLOATS);
+	m_pThreadPool->parallelFor(chunkNum, [&](int chunkIdx)
+	{
+		const int endIdx = (long long)leafNum * (chunkIdx + 1) / chunkNum;
+		for (int leafIdx = (long long)leafNum * chunkIdx / chunkNum; leafIdx < endIdx; ++leafIdx)
+		{
+			fillLeafPacket(leafIdx, leafRangeVec[leafIdx][0], leafRangeVec[leafIdx][1]);
+		}
+	});
+
+	vector<int>().swap(m_triOrderVec);
+	vector<vec3>().swap(m_triBoundMinVec);
+	vector<vec3>().swap(m_triBoundMaxVec);
+	vector<vec3>().swap(m_triCentroidVec);
+
+	cout << "Info: BVH of " << triNum << " triangles built with " << m_nodeVec.size() << " nodes and " << leafNum << " leaves in "
+		<< (CRenderUtilities::getTime() - startTime) * 1000.0 << " ms on " << threadNum << " threads" << endl;
+}
+
+bool CMeshBVH::isStale()
+{
+	return m_pMesh == NULL || m_pMesh->getGeometryVersion() != m_geometryVersion;
+}
+
+void CMeshBVH::computeNodeBound(BVHNode &node, int begin, int end)
+{
+	vec3 boundMin(FLT_MAX), boundMax(-FLT_MAX);
+	for (int idx = begin; idx < end; ++idx)
+	{
+		boundMin = glm::min(boundMin, m_triBoundMinVec[m_triOrderVec[idx]]);
+		boundMax = glm::max(boundMax, m_triBoundMaxVec[m_triOrderVec[idx]]);
+	}
+
+	node.boundMin = boundMin;
+	node.boundMax = boundMax;
+}
+
+int CMeshBVH::partitionTriangles(int begin, int end)
+{
+	vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (int idx = begin; idx < end; ++idx)
+	{
+		centroidMin = glm::min(centroidMin, m_triCentroidVec[m_triOrderVec[idx]]);
+		centroidMax = glm::max(centroidMax, m_triCentroidVec[m_triOrderVec[idx]]);
+	}
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1, bestSplit = 0;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		int binCount[BVH_BIN_NUM];
+		vec3 binMin[BVH_BIN_NUM], binMax[BVH_BIN_NUM];
+		for (int binIdx = 0; binIdx < BVH_BIN_NUM; ++binIdx)
+		{
+			binCount[binIdx] = 0;
+			binMin[binIdx] = vec3(FLT_MAX);
+			binMax[binIdx] = vec3(-FLT_MAX);
+		}
+
+		float scale = BVH_BIN_NUM / extent;
+		for (int idx = begin; idx < end; ++idx)
+		{
+			int triIdx = m_triOrderVec[idx];
+			int binIdx = std::min((int)((m_triCentroidVec[triIdx][axis] - centroidMin[axis]) * scale), BVH_BIN_NUM - 1);
+
+			++binCount[binIdx];
+			binMin[binIdx] = glm::min(binMin[binIdx], m_triBoundMinVec[triIdx]);
+			binMax[binIdx] = glm::max(binMax[binIdx], m_triBoundMaxVec[triIdx]);
+		}
+
+		// Right side costs swept from the last bin, then the left side joined from the first
+		float rightCost[BVH_BIN_NUM];
+		vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		int sweepCount = 0;
+		for (int binIdx = BVH_BIN_NUM - 1; binIdx > 0; --binIdx)
+		{
+			sweepCount += binCount[binIdx];
+			sweepMin = glm::min(sweepMin, binMin[binIdx]);
+			sweepMax = glm::max(sweepMax, binMax[binIdx]);
+			rightCost[binIdx] = sweepCount > 0 ? boundArea(sweepMin, sweepMax) * sweepCount : -1.0f;
+		}
+
+		sweepMin = vec3(FLT_MAX);
+		sweepMax = vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (int split = 1; split < BVH_BIN_NUM; ++split)
+		{
+			sweepCount += binCount[split - 1];
+			sweepMin = glm::min(sweepMin, binMin[split - 1]);
+			sweepMax = glm::max(sweepMax, binMax[split - 1]);
+
+			if (sweepCount == 0 || rightCost[split] < 0.0f)
+			{
+				continue;
+			}
+
+			float cost = boundArea(sweepMin, sweepMax) * sweepCount + rightCost[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// All centroids coincide, any split is as good as another
+	if (bestAxis < 0)
+	{
+		return (begin + end) / 2;
+	}
+
+	const float splitMin = centroidMin[bestAxis];
+	const float splitScale = BVH_BIN_NUM / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+	int *pMid = std::partition(&m_triOrderVec[0] + begin, &m_triOrderVec[0] + end, [&](int triIdx)
+	{
+		return std::min((int)((m_triCentroidVec[triIdx][bestAxis] - splitMin) * splitScale), BVH_BIN_NUM - 1) < bestSplit;
+	});
+
+	int mid = pMid - &m_triOrderVec[0];
+	return (mid == begin || mid == end) ? (begin + end) / 2 : mid;
+}
+
+// Local node 0 is the subtree root, children are allocated in pairs behind it. Past the SAH depth
+// limit ranges are halved, which bounds the depth of the traversal stacks.
+void CMeshBVH::buildSubtree(int begin, int end, int depth, vector<BVHNode> &nodeVec)
+{
+	nodeVec.clear();
+	nodeVec.push_back(BVHNode());
+	nodeVec[0].firstIdx = begin;
+	nodeVec[0].triNum = end - begin;
+
+	vector<ivec2> stack(1, ivec2(0, depth));
+	while (!stack.empty())
+	{
+		int nodeIdx = stack.back()[0];
+		int nodeDepth = stack.back()[1];
+		stack.pop_back();
+
+		int nodeBegin = nodeVec[nodeIdx].firstIdx;
+		int nodeEnd = nodeBegin + nodeVec[nodeIdx].triNum;
+		computeNodeBound(nodeVec[nodeIdx], nodeBegin, nodeEnd);
+
+		if (nodeEnd - nodeBegin <= BVH_LEAF_SIZE)
+		{
+			continue;
+		}
+
+		int mid = nodeDepth < BVH_SAH_MAX_DEPTH ? partitionTriangles(nodeBegin, nodeEnd) : (nodeBegin + nodeEnd) / 2;
+
+		int leftIdx = nodeVec.size();
+		nodeVec[nodeIdx].firstIdx = leftIdx;
+		nodeVec[nodeIdx].triNum = 0;
+
+		BVHNode child;
+		child.firstIdx = nodeBegin;
+		child.triNum = mid - nodeBegin;
+		nodeVec.push_back(child);
+		child.firstIdx = mid;
+		child.triNum = nodeEnd - mid;
+		nodeVec.push_back(child);
+
+		stack.push_back(ivec2(leftIdx, nodeDepth + 1));
+		stack.push_back(ivec2(leftIdx + 1, nodeDepth + 1));
+	}
+}
+
+// Empty lanes keep zero edges, their determinant is zero and they never report a hit
+void CMeshBVH::fillLeafPacket(int leafIdx, int begin, int triNum)
+{
+	const ivec3 *pTriIndices = m_pMesh->getTriIdx();
+	const vec3 *pVertices = m_pMesh->getVertices();
+
+	int *pTriIdx = &m_leafTriIdxVec[leafIdx * BVH_LEAF_SIZE];
+	float *pPacket = &m_leafPacketVec[leafIdx * BVH_PACKET_FLOATS];
+
+	for (int lane = 0; lane < BVH_LEAF_SIZE; ++lane)
+	{
+		vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+		pTriIdx[lane] = -1;
+
+		if (lane < triNum)
+		{
+			pTriIdx[lane] = m_triOrderVec[begin + lane];
+
+			const ivec3 &triangle = pTriIndices[pTriIdx[lane]];
+			v0 = pVertices[triangle[0]];
+			e1 = pVertices[triangle[1]] - v0;
+			e2 = pVertices[triangle[2]] - v0;
+		}
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			pPacket[axis * 4 + lane] = v0[axis];
+			pPacket[12 + axis * 4 + lane] = e1[axis];
+			pPacket[24 + axis * 4 + lane] = e2[axis];
+		}
+	}
+}
+
+// Moller-Trumbore on the four triangles of the leaf at once
+void CMeshBVH::intersectLeaf(const BVHNode &node, const vec3 &origin, const vec3 &dir, BVHRayHit &hit)
+{
+	const float *pPacket = &m_leafPacketVec[node.firstIdx * BVH_PACKET_FLOATS];
+
+	__m128 e1x = _mm_loadu_ps(pPacket + 12), e1y = _mm_loadu_ps(pPacket + 16), e1z = _mm_loadu_ps(pPacket + 20);
+	__m128 e2x = _mm_loadu_ps(pPacket + 24), e2y = _mm_loadu_ps(pPacket + 28), e2z = _mm_loadu_ps(pPacket + 32);
+	__m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 tx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(pPacket));
+	__m128 ty = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(pPacket + 4));
+	__m128 tz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(pPacket + 8));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 detAbs = _mm_max_ps(det, _mm_sub_ps(zero, det));
+	__m128 mask = _mm_and_ps(_mm_cmpgt_ps(detAbs, _mm_set1_ps(1e-20f)), _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+	int hitBits = _mm_movemask_ps(mask);
+	if (hitBits == 0)
+	{
+		return;
+	}
+
+	float tLanes[4], uLanes[4], vLanes[4];
+	_mm_storeu_ps(tLanes, t);
+	_mm_storeu_ps(uLanes, u);
+	_mm_storeu_ps(vLanes, v);
+
+	const int *pTriIdx = &m_leafTriIdxVec[node.firstIdx * BVH_LEAF_SIZE];
+	for (int lane = 0; lane < BVH_LEAF_SIZE; ++lane)
+	{
+		if ((hitBits & (1 << lane)) && tLanes[lane] < hit.t)
+		{
+			hit.triIdx = pTriIdx[lane];
+			hit.t = tLanes[lane];
+			hit.u = uLanes[lane];
+			hit.v = vLanes[lane];
+		}
+	}
+}
+
+bool CMeshBVH::intersectRay(const vec3 &origin, const vec3 &dir, float maxT, BVHRayHit &hit)
+{
+	hit.triIdx = -1;
+	hit.t = maxT;
+	hit.u = hit.v = 0.0f;
+
+	if (m_nodeVec.empty())
+	{
+		return false;
+	}
+
+	// Axis parallel rays get a huge but finite slope, so slabs never see 0 * inf
+	float invDir[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float d = dir[axis];
+		if (fabs(d) < 1e-20f)
+		{
+			d = d < 0.0f ? -1e-20f : 1e-20f;
+		}
+		invDir[axis] = 1.0f / d;
+	}
+
+	__m128 originV = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+	__m128 invDirV = _mm_set_ps(0.0f, invDir[2], invDir[1], invDir[0]);
+
+	if (intersectBound(m_nodeVec[0], originV, invDirV, hit.t) == FLT_MAX)
+	{
+		return false;
+	}
+
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode &node = m_nodeVec[stack[--stackSize]];
+
+		if (node.triNum > 0)
+		{
+			intersectLeaf(node, origin, dir, hit);
+			continue;
+		}
+
+		float tLeft = intersectBound(m_nodeVec[node.firstIdx], originV, invDirV, hit.t);
+		float tRight = intersectBound(m_nodeVec[node.firstIdx + 1], originV, invDirV, hit.t);
+
+		// Nearer child on top of the stack
+		if (tLeft <= tRight)
+		{
+			if (tRight != FLT_MAX) stack[stackSize++] = node.firstIdx + 1;
+			if (tLeft != FLT_MAX) stack[stackSize++] = node.firstIdx;
+		}
+		else
+		{
+			stack[stackSize++] = node.firstIdx + 1;
+			if (tLeft != FLT_MAX) stack[stackSize++] = node.firstIdx;
+		}
+	}
+
+	return hit.triIdx >= 0;
+}
+
+void CMeshBVH::intersectRays(const vector<vec3> &originVec, const vector<vec3> &dirVec, float maxT, vector<BVHRayHit> &hitVec)
+{
+	const int rayNum = originVec.size();
+	const int batchNum = (rayNum + BVH_RAY_BATCH_SIZE - 1) / BVH_RAY_BATCH_SIZE;
+
+	hitVec.resize(rayNum);
+
+	auto castBatch = [&](int batchIdx)
+	{
+		const int endIdx = std::min((batchIdx + 1) * BVH_RAY_BATCH_SIZE, rayNum);
+		for (int rayIdx = batchIdx * BVH_RAY_BATCH_SIZE; rayIdx < endIdx; ++rayIdx)
+		{
+			intersectRay(originVec[rayIdx], dirVec[rayIdx], maxT, hitVec[rayIdx]);
+		}
+	};
+
+	// A stroke chunk is usually a single batch, not worth waking the pool for
+	if (batchNum <= 1)
+	{
+		for (int batchIdx = 0; batchIdx < batchNum; ++batchIdx)
+		{
+			castBatch(batchIdx);
+		}
+	}
+	else
+	{
+		m_pThreadPool->parallelFor(batchNum, castBatch);
+	}
+}
+
+void CMeshBVH::pickScreenPoints(const vector<ivec2> &pointVec, int winHeight, const mat4 &modelviewMat, const mat4 &projMat,
+	const ivec4 &viewport, vector<BVHRayHit> &hitVec)
+{
+	mat4 invViewProjMat = inverse(projMat * modelviewMat);
+
+	vector<vec3> originVec(pointVec.size()), dirVec(pointVec.size());
+	for (int pointIdx = 0; pointIdx < pointVec.size(); ++pointIdx)
+	{
+		// Through the pixel center, as the pick pass samples it
+		float ndcX = ((pointVec[pointIdx][0] + 0.5f) - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+		float ndcY = ((winHeight - pointVec[pointIdx][1] - 0.5f) - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+
+		vec4 nearPos = invViewProjMat * vec4(ndcX, ndcY, -1.0f, 1.0f);
+		vec4 farPos = invViewProjMat * vec4(ndcX, ndcY, 1.0f, 1.0f);
+
+		originVec[pointIdx] = vec3(nearPos.x, nearPos.y, nearPos.z) / nearPos.w;
+		dirVec[pointIdx] = vec3(farPos.x, farPos.y, farPos.z) / farPos.w - originVec[pointIdx];
+	}
+
+	intersectRays(originVec, dirVec, 1.0f, hitVec);
+}
+
+bool CMeshBVH::nearestPoint(const vec3 &pos, float maxDis, BVHSurfacePoint &result)
+{
+	const ivec3 *pTriIndices = m_pMesh == NULL ? NULL : m_pMesh->getTriIdx();
+	const vec3 *pVertices = m_pMesh == NULL ? NULL : m_pMesh->getVertices();
+
+	result.triIdx = -1;
+	result.point = pos;
+	result.dis = maxDis;
+
+	float bestDisSq = maxDis * maxDis;
+	if (m_nodeVec.empty() || boundDistanceSq(m_nodeVec[0], pos) > bestDisSq)
+	{
+		return false;
+	}
+
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode &node = m_nodeVec[stack[--stackSize]];
+
+		// Bound may have been pushed before a closer point was found
+		if (boundDistanceSq(node, pos) > bestDisSq)
+		{
+			continue;
+		}
+
+		if (node.triNum > 0)
+		{
+			const int *pTriIdx = &m_leafTriIdxVec[node.firstIdx * BVH_LEAF_SIZE];
+			for (int lane = 0; lane < node.triNum; ++lane)
+			{
+				const ivec3 &triangle = pTriIndices[pTriIdx[lane]];
+				vec3 point = closestPointOnTriangle(pos, pVertices[triangle[0]], pVertices[triangle[1]], pVertices[triangle[2]]);
+				float disSq = dot(point - pos, point - pos);
+
+				if (disSq <= bestDisSq)
+				{
+					bestDisSq = disSq;
+					result.triIdx = pTriIdx[lane];
+					result.point = point;
+				}
+			}
+			continue;
+		}
+
+		float disLeft = boundDistanceSq(m_nodeVec[node.firstIdx], pos);
+		float disRight = boundDistanceSq(m_nodeVec[node.firstIdx + 1], pos);
+
+		if (disLeft <= disRight)
+		{
+			if (disRight <= bestDisSq) stack[stackSize++] = node.firstIdx + 1;
+			if (disLeft <= bestDisSq) stack[stackSize++] = node.firstIdx;
+		}
+		else
+		{
+			if (disLeft <= bestDisSq) stack[stackSize++] = node.firstIdx;
+			if (disRight <= bestDisSq) stack[stackSize++] = node.firstIdx + 1;
+		}
+	}
+
+	result.dis = sqrt(bestDisSq);
+
+	return result.triIdx >= 0;
+}
+
+void CMeshBVH::nearestPoints(const vector<vec3> &posVec, float maxDis, vector<BVHSurfacePoint> &resultVec)
+{
+	const int posNum = posVec.size();
+	const int batchNum = (posNum + BVH_RAY_BATCH_SIZE - 1) / BVH_RAY_BATCH_SIZE;
+
+	resultVec.resize(posNum);
+
+	m_pThreadPool->parallelFor(batchNum, [&](int batchIdx)
+	{
+		const int endIdx = std::min((batchIdx + 1) * BVH_RAY_BATCH_SIZE, posNum);
+		for (int posIdx = batchIdx * BVH_RAY_BATCH_SIZE; posIdx < endIdx; ++posIdx)
+		{
+			nearestPoint(posVec[posIdx], maxDis, resultVec[posIdx]);
+		}
+	});
+}
+
+// Every vertex is a corner of some triangle, so the corners of the leaves near enough cover all candidates
+int CMeshBVH::nearestVertex(const vec3 &pos, float maxDis)
+{
+	if (m_nodeVec.empty())
+	{
+		return -1;
+	}
+
+	const ivec3 *pTriIndices = m_pMesh->getTriIdx();
+	const vec3 *pVertices = m_pMesh->getVertices();
+
+	int bestVerIdx = -1;
+	float bestDisSq = maxDis * maxDis;
+
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode &node = m_nodeVec[stack[--stackSize]];
+
+		if (boundDistanceSq(node, pos) > bestDisSq)
+		{
+			continue;
+		}
+
+		if (node.triNum > 0)
+		{
+			const int *pTriIdx = &m_leafTriIdxVec[node.firstIdx * BVH_LEAF_SIZE];
+			for (int lane = 0; lane < node.triNum; ++lane)
+			{
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					int verIdx = pTriIndices[pTriIdx[lane]][corner];
+					float disSq = dot(pVertices[verIdx] - pos, pVertices[verIdx] - pos);
+
+					if (disSq <= bestDisSq)
+					{
+						bestDisSq = disSq;
+						bestVerIdx = verIdx;
+					}
+				}
+			}
+			continue;
+		}
+
+		float disLeft = boundDistanceSq(m_nodeVec[node.firstIdx], pos);
+		float disRight = boundDistanceSq(m_nodeVec[node.firstIdx + 1], pos);
+
+		if (disLeft <= disRight)
+		{
+			stack[stackSize++] = node.firstIdx + 1;
+			stack[stackSize++] = node.firstIdx;
+		}
+		else
+		{
+			stack[stackSize++] = node.firstIdx;
+			stack[stackSize++] = node.firstIdx + 1;
+		}
+	}
+
+	return bestVerIdx;
+}
+
+void CMeshBVH::queryRadius(const vec3 &center, float radius, vector<int> &triIdxVec)
+{
+	triIdxVec.clear();
+
+	if (m_nodeVec.empty())
+	{
+		return;
+	}
+
+	const ivec3 *pTriIndices = m_pMesh->getTriIdx();
+	const vec3 *pVertices = m_pMesh->getVertices();
+	const float radiusSq = radius * radius;
+
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode &node = m_nodeVec[stack[--stackSize]];
+
+		if (boundDistanceSq(node, center) > radiusSq)
+		{
+			continue;
+		}
+
+		if (node.triNum > 0)
+		{
+			const int *pTriIdx = &m_leafTriIdxVec[node.firstIdx * BVH_LEAF_SIZE];
+			for (int lane = 0; lane < node.triNum; ++lane)
+			{
+				const ivec3 &triangle = pTriIndices[pTriIdx[lane]];
+				vec3 point = closestPointOnTriangle(center, pVertices[triangle[0]], pVertices[triangle[1]], pVertices[triangle[2]]);
+
+				if (dot(point - center, point - center) <= radiusSq)
+				{
+					triIdxVec.push_back(pTriIdx[lane]);
+				}
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.firstIdx;
+		stack[stackSize++] = node.firstIdx + 1;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+class CTriangleMesh;
+class CThreadPool;
+
+// Interior nodes keep their two children next to each other at firstIdx, leaves hold up to
+// four triangles as one SoA packet at firstIdx, triNum is 0 for interior nodes
+struct BVHNode
+{
+	vec3 boundMin;
+	int firstIdx;
+	vec3 boundMax;
+	int triNum;
+};
+
+struct BVHRayHit
+{
+	int triIdx;		// -1 if nothing was hit
+	float t;		// Along the unnormalized ray direction
+	float u, v;		// Barycentric weights of the second and third corner
+};
+
+struct BVHSurfacePoint
+{
+	int triIdx;		// -1 if nothing is within the search distance
+	vec3 point;
+	float dis;
+};
+
+// Binned SAH bounding volume hierarchy over the triangles of a mesh. Triangle bounds are computed
+// and the subtrees below the first few splits are built in parallel. Rays are tested against both
+// children of a node and against the four triangles of a leaf at once with SSE.
+class CMeshBVH
+{
+public:
+	// Runs on the shared thread pool unless given one, which it doesn't own
+	explicit CMeshBVH(CThreadPool *pThreadPool = NULL);
+	virtual ~CMeshBVH();
+
+	void build(CTriangleMesh *pMesh);
+
+	// The mesh changed since the build and the hierarchy has to be rebuilt
+	bool isStale();
+
+	// Nearest hit within origin + [0, maxT] * dir
+	bool intersectRay(const vec3 &origin, const vec3 &dir, float maxT, BVHRayHit &hit);
+	void intersectRays(const vector<vec3> &originVec, const vector<vec3> &dirVec, float maxT, vector<BVHRayHit> &hitVec);
+
+	// Rays through window pixels from the near to the far plane, pixel rows counted from the top as in window events
+	void pickScreenPoints(const vector<ivec2> &pointVec, int winHeight, const mat4 &modelviewMat, const mat4 &projMat,
+		const ivec4 &viewport, vector<BVHRayHit> &hitVec);
+
+	// Closest point on the surface and closest mesh vertex within maxDis, vertex index -1 if none
+	bool nearestPoint(const vec3 &pos, float maxDis, BVHSurfacePoint &result);
+	void nearestPoints(const vector<vec3> &posVec, float maxDis, vector<BVHSurfacePoint> &resultVec);
+	int nearestVertex(const vec3 &pos, float maxDis);
+
+	// Triangles touching the sphere, as for the triangles under a brush
+	void queryRadius(const vec3 &center, float radius, vector<int> &triIdxVec);
+
+	int getNodeNum(){ return m_nodeVec.size(); }
+
+protected:
+	// Split [begin, end) of m_triOrderVec at the best binned SAH plane, returns the first index of the right half
+	int partitionTriangles(int begin, int end);
+	void computeNodeBound(BVHNode &node, int begin, int end);
+	void buildSubtree(int begin, int end, int depth, vector<BVHNode> &nodeVec);
+	void fillLeafPacket(int leafIdx, int begin, int triNum);
+
+	void intersectLeaf(const BVHNode &node, const vec3 &origin, const vec3 &dir, BVHRayHit &hit);
+
+private:
+	CThreadPool *m_pThreadPool;
+	CTriangleMesh *m_pMesh;
+	uint m_geometryVersion;
+
+	vector<BVHNode> m_nodeVec;
+
+	// Per leaf 4 triangle indices, -1 for empty lanes, and corner 0 plus two edges as 9 x 4 floats
+	vector<int> m_leafTriIdxVec;
+	vector<float> m_leafPacketVec;
+
+	// Build state, triangle order is partitioned in place so subtrees own disjoint ranges
+	vector<int> m_triOrderVec;
+	vector<vec3> m_triBoundMinVec;
+	vector<vec3> m_triBoundMaxVec;
+	vector<vec3> m_triCentroidVec;
+};
+
+}
@@ -0,0 +1,260 @@
+#include "paintHistory.h"
+
+#include <algorithm>
+
+#include "triangleMesh.h"
+#include "varintCoding.h"
+
+using namespace TextureSynthesis;
+
+static inline uint floatBits(float value)
+{
+	uint bits;
+	memcpy(&bits, &value, sizeof(uint));
+	return bits;
+}
+
+static inline float bitsFloat(uint bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+static bool compareFirst(const ivec2 &a, const ivec2 &b)
+{
+	return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+}
+
+CPaintHistory::CPaintHistory() : m_undoNum(0), m_byteNum(0), m_budgetByteNum(64 << 20)
+{
+
+}
+
+CPaintHistory::~CPaintHistory()
+{
+
+}
+
+void CPaintHistory::setMemoryBudget(size_t byteNum)
+{
+	m_budgetByteNum = byteNum;
+}
+
+void CPaintHistory::pushEntry(const vector<int> &verIdxVec, const vector<StrokeVertexState> &beforeVec, int layerNumBefore,
+	CStrokeLayers &strokeLayers, CTriangleMesh *pMesh)
+{
+	// Redo entries can't be reached any more, addLayer already dropped their layers
+	while (m_entryDeque.size() > m_undoNum)
+	{
+		m_byteNum -= m_entryDeque.back().data.size() + sizeof(PaintHistoryEntry);
+		m_entryDeque.pop_back();
+	}
+
+	// Sort by vertex, keeping the first recorded state of a vertex written more than once
+	vector<ivec2> order(verIdxVec.size());
+	for (int idx = 0; idx < verIdxVec.size(); ++idx)
+	{
+		order[idx] = ivec2(verIdxVec[idx], idx);
+	}
+	std::sort(order.begin(), order.end(), compareFirst);
+
+	vector<int> uniqueVerIdxVec;
+	vector<StrokeVertexState> uniqueBeforeVec, afterVec;
+	for (int idx = 0; idx < order.size(); ++idx)
+	{
+		if (!uniqueVerIdxVec.empty() && uniqueVerIdxVec.back() == order[idx][0])
+		{
+			continue;
+		}
+
+		StrokeVertexState afterState;
+		strokeLayers.getVertexState(order[idx][0], pMesh, afterState);
+
+		uniqueVerIdxVec.push_back(order[idx][0]);
+		uniqueBeforeVec.push_back(beforeVec[order[idx][1]]);
+		afterVec.push_back(afterState);
+	}
+
+	m_entryDeque.push_back(PaintHistoryEntry());
+	PaintHistoryEntry &entry = m_entryDeque.back();
+	entry.layerNumBefore = layerNumBefore;
+	entry.layerNumAfter = strokeLayers.getLayerNum();
+	entry.verNum = uniqueVerIdxVec.size();
+	encodeEntry(uniqueVerIdxVec, uniqueBeforeVec, afterVec, entry.data);
+
+	m_byteNum += entry.data.size() + sizeof(PaintHistoryEntry);
+	++m_undoNum;
+
+	cout << "Info: Undo entry of " << entry.verNum << " vertices encoded in " << entry.data.size() << " bytes, "
+		<< m_undoNum << " entries use " << m_byteNum << " bytes, stroke layers " << strokeLayers.getByteNum() << " bytes" << endl;
+
+	evictEntries(strokeLayers, pMesh);
+}
+
+bool CPaintHistory::undo(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh)
+{
+	if (m_undoNum == 0)
+	{
+		cout << "WARNING: Nothing to undo!" << endl;
+		return false;
+	}
+
+	--m_undoNum;
+	applyEntry(m_entryDeque[m_undoNum], false, strokeLayers, pMesh);
+
+	return true;
+}
+
+bool CPaintHistory::redo(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh)
+{
+	if (m_undoNum == m_entryDeque.size())
+	{
+		cout << "WARNING: Nothing to redo!" << endl;
+		return false;
+	}
+
+	applyEntry(m_entryDeque[m_undoNum], true, strokeLayers, pMesh);
+	++m_undoNum;
+
+	return true;
+}
+
+void CPaintHistory::clear()
+{
+	m_entryDeque.clear();
+	m_undoNum = 0;
+	m_byteNum = 0;
+}
+
+void CPaintHistory::applyEntry(const PaintHistoryEntry &entry, bool after, CStrokeLayers &strokeLayers, CTriangleMesh *pMesh)
+{
+	vector<int> verIdxVec;
+	vector<StrokeVertexState> beforeVec, afterVec;
+	decodeEntry(entry, verIdxVec, beforeVec, afterVec);
+
+	const vector<StrokeVertexState> &stateVec = after ? afterVec : beforeVec;
+	for (int idx = 0; idx < verIdxVec.size(); ++idx)
+	{
+		strokeLayers.setVertexState(verIdxVec[idx], stateVec[idx], pMesh);
+	}
+
+	strokeLayers.setActiveLayerNum(after ? entry.layerNumAfter : entry.layerNumBefore);
+}
+
+void CPaintHistory::evictEntries(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh)
+{
+	while (m_byteNum + strokeLayers.getByteNum() > m_budgetByteNum && m_undoNum > 0)
+	{
+		// Its stroke can't be undone any more, so the layer only has to live on in the base
+		strokeLayers.mergeLayers(m_entryDeque.front().layerNumAfter, pMesh);
+
+		m_byteNum -= m_entryDeque.front().data.size() + sizeof(PaintHistoryEntry);
+		m_entryDeque.pop_front();
+		--m_undoNum;
+
+		cout << "WARNING: Oldest undo entry evicted by the history memory budget!" << endl;
+	}
+}
+
+void CPaintHistory::encodeEntry(const vector<int> &verIdxVec, const vector<StrokeVertexState> &beforeVec,
+	const vector<StrokeVertexState> &afterVec, vector<unsigned char> &data)
+{
+	data.clear();
+
+	// Runs of consecutive vertex indices, each as gap from the previous run end and length
+	int runStart = 0, prevEnd = 0;
+	vector<ivec2> runVec;
+	for (int idx = 1; idx <= verIdxVec.size(); ++idx)
+	{
+		if (idx == verIdxVec.size() || verIdxVec[idx] != verIdxVec[idx - 1] + 1)
+		{
+			runVec.push_back(ivec2(verIdxVec[runStart], idx - runStart));
+			runStart = idx;
+		}
+	}
+
+	writeVarint(data, runVec.size());
+	for (int runIdx = 0; runIdx < runVec.size(); ++runIdx)
+	{
+		writeVarint(data, runVec[runIdx][0] - prevEnd);
+		writeVarint(data, runVec[runIdx][1]);
+		prevEnd = runVec[runIdx][0] + runVec[runIdx][1];
+	}
+
+	encodeStates(beforeVec, data);
+	encodeStates(afterVec, data);
+}
+
+void CPaintHistory::decodeEntry(const PaintHistoryEntry &entry, vector<int> &verIdxVec,
+	vector<StrokeVertexState> &beforeVec, vector<StrokeVertexState> &afterVec)
+{
+	const unsigned char *pData = entry.data.empty() ? NULL : &entry.data[0];
+
+	verIdxVec.clear();
+	verIdxVec.reserve(entry.verNum);
+
+	if (pData == NULL)
+	{
+		return;
+	}
+
+	int runNum = readVarint(pData);
+	int prevEnd = 0;
+	for (int runIdx = 0; runIdx < runNum; ++runIdx)
+	{
+		int runStart = prevEnd + readVarint(pData);
+		int runLength = readVarint(pData);
+
+		for (int verIdx = runStart; verIdx < runStart + runLength; ++verIdx)
+		{
+			verIdxVec.push_back(verIdx);
+		}
+		prevEnd = runStart + runLength;
+	}
+
+	pData = decodeStates(pData, entry.verNum, beforeVec);
+	decodeStates(pData, entry.verNum, afterVec);
+}
+
+// Neighbouring values are close, so the zigzag difference of their bit patterns is mostly small
+void CPaintHistory::encodeStates(const vector<StrokeVertexState> &stateVec, vector<unsigned char> &data)
+{
+	uint prevDisBits = floatBits(STROKE_DIS_NONE);
+	uint prevTexcoord = STROKE_TEXCOORD_INVALID;
+	int prevOwner = -1;
+
+	for (int idx = 0; idx < stateVec.size(); ++idx)
+	{
+		uint disBits = floatBits(stateVec[idx].dis);
+
+		writeVarint(data, zigzagEncode((int)(disBits - prevDisBits)));
+		writeVarint(data, zigzagEncode((int)(stateVec[idx].texcoord - prevTexcoord)));
+		writeVarint(data, zigzagEncode(stateVec[idx].owner - prevOwner));
+
+		prevDisBits = disBits;
+		prevTexcoord = stateVec[idx].texcoord;
+		prevOwner = stateVec[idx].owner;
+	}
+}
+
+const unsigned char* CPaintHistory::decodeStates(const unsigned char *pData, int verNum, vector<StrokeVertexState> &stateVec)
+{
+	uint prevDisBits = floatBits(STROKE_DIS_NONE);
+	uint prevTexcoord = STROKE_TEXCOORD_INVALID;
+	int prevOwner = -1;
+
+	stateVec.resize(verNum);
+	for (int idx = 0; idx < verNum; ++idx)
+	{
+		prevDisBits += (uint)zigzagDecode(readVarint(pData));
+		prevTexcoord += (uint)zigzagDecode(readVarint(pData));
+		prevOwner += zigzagDecode(readVarint(pData));
+
+		stateVec[idx].dis = bitsFloat(prevDisBits);
+		stateVec[idx].texcoord = prevTexcoord;
+		stateVec[idx].owner = prevOwner;
+	}
+
+	return pData;
+}
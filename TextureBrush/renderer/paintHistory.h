@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../preHeader.h"
+
+#include <deque>
+
+#include "strokeLayers.h"
+
+namespace TextureSynthesis
+{
+
+class CTriangleMesh;
+
+// One undoable painting step. Changed vertices are stored as index runs, followed by
+// their states before and after the step, all delta and varint encoded.
+struct PaintHistoryEntry
+{
+	int layerNumBefore;
+	int layerNumAfter;
+	int verNum;
+	vector<unsigned char> data;
+};
+
+// Undo and redo of stroke layers within a memory budget shared with the kept layers. The oldest undo
+// entries are evicted first and their layers merged into the base of the stroke layers.
+class CPaintHistory
+{
+public:
+	CPaintHistory();
+	virtual ~CPaintHistory();
+
+	// Applied when the next entry is pushed
+	void setMemoryBudget(size_t byteNum);
+
+	// Record a step from the states overwritten while recording, the after states are read back. Drops redo entries.
+	void pushEntry(const vector<int> &verIdxVec, const vector<StrokeVertexState> &beforeVec, int layerNumBefore,
+		CStrokeLayers &strokeLayers, CTriangleMesh *pMesh);
+
+	// Restore the attributes of one step, affected vertices are marked dirty on the mesh
+	bool undo(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh);
+	bool redo(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh);
+
+	void clear();
+
+	int getUndoNum(){ return m_undoNum; }
+	int getRedoNum(){ return m_entryDeque.size() - m_undoNum; }
+	size_t getByteNum(){ return m_byteNum; }
+
+protected:
+	void applyEntry(const PaintHistoryEntry &entry, bool after, CStrokeLayers &strokeLayers, CTriangleMesh *pMesh);
+	void evictEntries(CStrokeLayers &strokeLayers, CTriangleMesh *pMesh);
+
+	static void encodeEntry(const vector<int> &verIdxVec, const vector<StrokeVertexState> &beforeVec,
+		const vector<StrokeVertexState> &afterVec, vector<unsigned char> &data);
+	static void decodeEntry(const PaintHistoryEntry &entry, vector<int> &verIdxVec,
+		vector<StrokeVertexState> &beforeVec, vector<StrokeVertexState> &afterVec);
+
+	static void encodeStates(const vector<StrokeVertexState> &stateVec, vector<unsigned char> &data);
+	static const unsigned char* decodeStates(const unsigned char *pData, int verNum, vector<StrokeVertexState> &stateVec);
+
+private:
+	// Entries [0, m_undoNum) can be undone, the rest are redo entries
+	std::deque<PaintHistoryEntry> m_entryDeque;
+	int m_undoNum;
+
+	size_t m_byteNum;
+	size_t m_budgetByteNum;
+};
+
+}
@@ -2,11 +2,26 @@
 
 #include <set>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
 
 #include "pixelBufferObject.h"
+#include "frameBufferObject.h"
+#include "glStateCache.h"
+#include "softRasterizer.h"
+#include "meshBVH.h"
+#include "vertexKdTree.h"
 #include "renderSystemConfig.h"
+#include "renderSystem.h"
+#include "viewer.h"
+#include "camera.h"
 #include "brushGlobalRes.h"
+#include "renderUtilities.h"
+#include "frameProfiler.h"
+#include "traceRecorder.h"
+#include "Geo2D.h"
 #include "geodesicMesh.h"
+#include "strokeLayers.h"
 
 #include "triangleMesh.h"
 #include "vertexBufferObject.h"
@@ -14,6 +29,16 @@
 using std::set;
 using namespace TextureSynthesis;
 
+static bool compareVertexOrder(const ivec2 &a, const ivec2 &b)
+{
+	return a[0] < b[0];
+}
+
+// Raw points conditioned and processed together while the stroke is drawn
+#define STROKE_CHUNK_SIZE 16
+#define STROKE_QUEUE_SIZE 4096
+#define PICK_TILE_SIZE 32
+
 CPaintPathes* CPaintPathes::Instance()
 {
 	static CPaintPathes* s_pPaintPathes = NULL;
@@ -26,23 +51,73 @@ CPaintPathes* CPaintPathes::Instance()
 	return s_pPaintPathes;
 }
 
-CPaintPathes::CPaintPathes() : m_pPBO(NULL), m_pTriangleIdxData(NULL)
+CPaintPathes::CPaintPathes() : m_pPBO(NULL), m_pTriangleIdxData(NULL), m_pBaryPBO(NULL), m_pBaryData(NULL), m_pickTexId(0), m_pickPassKey(0), m_pickPassValid(false), m_pickSource(PST_GL), m_pSoftRasterizer(NULL),
+	m_tileColNum(0), m_tileRowNum(0), m_tileRequestNum(0), m_tileReadyNum(0), m_tileRequestQueue(STROKE_QUEUE_SIZE),
+	m_markEpoch(0), m_lastPickedTriIdx(-9), m_messageQueue(STROKE_QUEUE_SIZE), m_pendingMsgNum(0), m_pickReady(false), m_stopWorker(false),
+	m_streamAnchorSent(false), m_streamPathOpen(false), m_finalizeStartTime(0.0), m_writeIdx(0), m_publishedIdx(-1), m_readingIdx(-1), m_snapshotReady(false)
 {
 	int winWidth, winHeight;
 	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
 
-	m_pPBO = new CPixelBufferObject(TEXELFMT_RGBA, TEXELTYPE_FLOAT, winWidth, winHeight);
+	m_pPBO = new CPixelBufferObject(TEXELFMT_RED_INTEGER, TEXELTYPE_USIGNED_INT, winWidth, winHeight);
+	m_pBaryPBO = new CPixelBufferObject(TEXELFMT_RED_INTEGER, TEXELTYPE_USIGNED_INT, winWidth, winHeight, 1);
+
+	m_tileColNum = (winWidth + PICK_TILE_SIZE - 1) / PICK_TILE_SIZE;
+	m_tileRowNum = (winHeight + PICK_TILE_SIZE - 1) / PICK_TILE_SIZE;
+	m_triIdxCache.assign(winWidth * winHeight, 0);
+	m_baryCache.assign(winWidth * winHeight, 0);
+	m_tileRequested.assign(m_tileColNum * m_tileRowNum, 0);
+	m_pTriangleIdxData = &m_triIdxCache[0];
+	m_pBaryData = &m_baryCache[0];
+
+	int pickThreadNum;
+	CRenderSystemConfig::getSysCfgInstance()->getSoftwarePick(m_pickSource, pickThreadNum);
+	if (m_pickSource == PST_SOFTWARE || m_pickSource == PST_VALIDATE)
+	{
+		m_pSoftRasterizer = new CSoftRasterizer(winWidth, winHeight);
+	}
+
+	float undoBudgetMB;
+	CRenderSystemConfig::getSysCfgInstance()->getUndoBudget(undoBudgetMB);
+	m_paintHistory.setMemoryBudget((size_t)(undoBudgetMB * 1024.0f * 1024.0f));
+
+	m_workerThread = std::thread(&CPaintPathes::workerLoop, this);
 }
 
 CPaintPathes::~CPaintPathes()
 {
+	stopWorker();
+
 	SAFE_DELETE(m_pPBO);
+	SAFE_DELETE(m_pBaryPBO);
+	SAFE_DELETE(m_pSoftRasterizer);
+}
+
+void CPaintPathes::stopWorker()
+{
+	if (m_workerThread.joinable())
+	{
+		m_stopWorker = true;
+		pushMessage(SMT_QUIT);
+		m_workerThread.join();
+	}
+}
+
+// A new sketch reuses the pick buffers, so the previous sketch must be fully processed first
+void CPaintPathes::startSketch()
+{
+	waitForIdle();
+	m_pickReady = false;
+
+	m_pathVec.clear();
 }
 
 void CPaintPathes::startNewPath()
 {
 	cout << "Info: New painting path!" << endl;
 	m_pathPointVec.clear();
+
+	pushMessage(SMT_BEGIN_PATH);
 }
 
 void CPaintPathes::addPointToPath(const ivec2 &newPos)
@@ -51,6 +126,7 @@ void CPaintPathes::addPointToPath(const ivec2 &newPos)
 	{
 		cout << "[" << newPos[0] << "," << newPos[1] << "]" << endl;
 		m_pathPointVec.push_back(newPos);
+		pushMessage(SMT_POINT, newPos);
 		return;
 	}
 
@@ -60,138 +136,787 @@ void CPaintPathes::addPointToPath(const ivec2 &newPos)
 	{
 		cout << "[" << newPos[0] << "," << newPos[1] << "]" << endl;
 		m_pathPointVec.push_back(newPos);
+		pushMessage(SMT_POINT, newPos);
 	}
-	
-	
-	// Transform path vertices in pixel coordinates into world coordinates
-	GLdouble modelview[16];
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
-	GLdouble projection[16];
-	glGetDoublev(GL_PROJECTION_MATRIX, projection);
-	GLint viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	float depth;
-	glReadPixels(newPos[0], newPos[1], 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-	cout << "Depth is " << depth << endl;
-
-	double objPos[3];
-	gluUnProject(newPos[0], newPos[1], depth, modelview, projection, viewport, &objPos[0], &objPos[1], &objPos[2]);
-
-	cout << objPos[0] << " " << objPos[1] << " " << objPos[2] << endl;
 }
 
 void CPaintPathes::endPath()
 {
 	cout << "Info: End painting path!" << endl;
-	m_pathVec.clear(); // Only maintain one curve currently, remove this to maintain multiple curves
 	m_pathVec.push_back(m_pathPointVec);
+
+	pushMessage(SMT_END_PATH);
+}
+
+// Every path is finalized when the mouse is released, only a path still being drawn is left here
+void CPaintPathes::finishSketch()
+{
+	m_finalizeStartTime = CRenderUtilities::getTime();
+	pushMessage(SMT_FINALIZE);
+}
+
+void CPaintPathes::pushMessage(StrokeMessageType type, const ivec2 &pos)
+{
+	StrokeMessage message;
+	message.type = type;
+	message.pos = pos;
+
+	++m_pendingMsgNum;
+	while (!m_messageQueue.push(message))
+	{
+		std::this_thread::yield();
+	}
+
+	wakeWorker();
+}
+
+// Only called on the render thread, which keeps serving the pick tiles and snapshot slots the worker may be waiting on
+void CPaintPathes::waitForIdle()
+{
+	std::unique_lock<std::mutex> lock(m_idleMutex);
+	while (m_pendingMsgNum > 0)
+	{
+		if (m_snapshotReady || !m_tileBatchVec.empty() || !m_tileRequestQueue.empty())
+		{
+			lock.unlock();
+
+			// A finalizing worker can't write its snapshot before the previous one is taken
+			publishResults();
+			consumePickResults(true);
+
+			lock.lock();
+		}
+		else
+		{
+			m_idleCond.wait(lock);
+		}
+	}
+}
+
+void CPaintPathes::wakeRenderThread()
+{
+	std::lock_guard<std::mutex> lock(m_idleMutex);
+	m_idleCond.notify_all();
+}
+
+void CPaintPathes::wakeWorker()
+{
+	std::lock_guard<std::mutex> lock(m_workerMutex);
+	m_workerCond.notify_one();
+}
+
+// Blocks the stroke worker until ready holds, checked again every time it is woken
+void CPaintPathes::workerWait(const std::function<bool()> &ready)
+{
+	std::unique_lock<std::mutex> lock(m_workerMutex);
+	while (!ready())
+	{
+		m_workerCond.wait(lock);
+	}
+}
+
+void CPaintPathes::workerLoop()
+{
+	TRACE_THREAD_NAME("stroke worker");
+
+	StrokeMessage message;
+
+	while (true)
+	{
+		if (!m_messageQueue.pop(message))
+		{
+			workerWait([this](){ return !m_messageQueue.empty(); });
+			continue;
+		}
+
+		if (message.type == SMT_QUIT)
+		{
+			--m_pendingMsgNum;
+			wakeRenderThread();
+			break;
+		}
+
+		TRACE_SCOPE("strokeMessage");
+
+		switch (message.type)
+		{
+		case SMT_BEGIN_PATH:
+			beginStreamPath();
+			break;
+		case SMT_POINT:
+			// Points may arrive before the render thread has drawn the pick pass
+			workerWait([this](){ return m_pickReady || m_stopWorker; });
+
+			if (!m_pickReady) break;
+
+			m_streamRawVec.push_back(message.pos);
+			if (m_streamRawVec.size() > STROKE_CHUNK_SIZE)
+			{
+				streamPathPoints(false);
+			}
+			break;
+		case SMT_END_PATH:
+			finalizeStream();
+			break;
+		case SMT_FINALIZE:
+			if (m_streamPathOpen)
+			{
+				finalizeStream();
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (--m_pendingMsgNum == 0)
+		{
+			wakeRenderThread();
+		}
+	}
+}
+
+void CPaintPathes::beginStreamPath()
+{
+	resetSeedState();
+
+	m_streamRawVec.clear();
+	m_streamSeedVec.clear();
+	m_streamAnchorSent = false;
+	m_streamPathOpen = true;
+	m_lastPickedTriIdx = -9;
+	resetPathTiming();
+
+	m_zeroOrderPathIdxVec.clear();
+	m_firstOrderPathIdxVec.clear();
+}
+
+// Condition and process the raw points received so far, keeping the last one as anchor of the next chunk
+void CPaintPathes::streamPathPoints(bool flushTail)
+{
+	if (m_streamRawVec.empty() || (m_streamRawVec.size() < 2 && !flushTail))
+	{
+		return;
+	}
+
+	double startTime = CRenderUtilities::getTime();
+
+	vector<ivec2> pointVec;
+	TRACE_BEGIN("condition");
+	conditionPath(m_streamRawVec, pointVec);
+	TRACE_END("condition");
+
+	m_pathTiming.stageTime[SS_CONDITION] += CRenderUtilities::getTime() - startTime;
+
+	if (m_streamAnchorSent && !pointVec.empty())
+	{
+		pointVec.erase(pointVec.begin());
+	}
+	m_streamAnchorSent = true;
+
+	processPathPoints(pointVec, m_streamSeedVec);
+
+	ivec2 anchor = m_streamRawVec.back();
+	m_streamRawVec.assign(1, anchor);
+}
+
+void CPaintPathes::finalizeStream()
+{
+	TRACE_SCOPE("finalizeStream");
+
+	streamPathPoints(true);
+
+	// Every snapshot becomes a layer, so wait until the previous one is taken and never write the one being read
+	workerWait([this](){ return (!m_snapshotReady && m_readingIdx != m_writeIdx) || m_stopWorker; });
+
+	StrokeSnapshot &snapshot = m_snapshots[m_writeIdx];
+	snapshot.curveTriIdxVec = m_curveTriIdxVec;
+
+	computeStrokeLayer(m_streamSeedVec, snapshot.layer);
+	snapshot.timing = m_pathTiming;
+
+	m_publishedIdx = m_writeIdx;
+	m_snapshotReady = true;
+	m_writeIdx = 1 - m_writeIdx;
+
+	// Wake the render loop to publish it, or the render thread if it is waiting for the worker
+	CRenderSystem::Instance()->requestRedraw(RDF_STROKE);
+	wakeRenderThread();
+
+	cout << "Info: Stroke finalized with " << m_streamSeedVec.size() << " seeds and " << snapshot.layer.verIdxVec.size()
+		<< " band vertices " << (CRenderUtilities::getTime() - m_finalizeStartTime) * 1000.0 << " ms after release" << endl;
+
+	beginStreamPath();
+	m_streamPathOpen = false;
+}
+
+void CPaintPathes::publishResults()
+{
+	if (!m_snapshotReady.exchange(false))
+	{
+		return;
+	}
+
+	// Claim the published snapshot, retry if the worker published another one meanwhile
+	int readIdx;
+	do
+	{
+		readIdx = m_publishedIdx;
+		m_readingIdx = readIdx;
+	} while (readIdx != m_publishedIdx);
+
+	StrokeSnapshot &snapshot = m_snapshots[readIdx];
+	applyPathResult(snapshot.layer, snapshot.curveTriIdxVec, snapshot.timing);
+
+	m_readingIdx = -1;
+	wakeWorker();
+}
+
+void CPaintPathes::conditionPath(const vector<ivec2> &rawPointVec, vector<ivec2> &pointVec)
+{
+	float fitTolerance, sampleSpacing;
+	CRenderSystemConfig::getSysCfgInstance()->getStrokeFitting(fitTolerance, sampleSpacing);
+
+	if (sampleSpacing <= 0.0f || rawPointVec.size() < 3)
+	{
+		pointVec = rawPointVec;
+		return;
+	}
+
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+
+	vector<vec2> rawPoints(rawPointVec.size());
+	for (int pointIdx = 0; pointIdx < rawPointVec.size(); ++pointIdx)
+	{
+		rawPoints[pointIdx] = vec2(rawPointVec[pointIdx]);
+	}
+
+	vector<vector<vec2> > beziers;
+	Geo2D::FitCubicBeziers(beziers, rawPoints, fitTolerance);
+
+	vector<vec2> samplePoints;
+	Geo2D::ResampleCubicBeziers(samplePoints, beziers, sampleSpacing);
+
+	// Back to pixels inside the window, dropping repeated pixels
+	pointVec.clear();
+	for (int pointIdx = 0; pointIdx < samplePoints.size(); ++pointIdx)
+	{
+		ivec2 pixel(glm::clamp((int)floor(samplePoints[pointIdx][0] + 0.5f), 0, winWidth - 1),
+			glm::clamp((int)floor(samplePoints[pointIdx][1] + 0.5f), 0, winHeight - 1));
+
+		if (pointVec.empty() || pointVec.back() != pixel)
+		{
+			pointVec.push_back(pixel);
+		}
+	}
+
+	cout << "Info: Stroke conditioned from " << rawPointVec.size() << " to " << pointVec.size()
+		<< " points with " << beziers.size() << " bezier segments" << endl;
 }
 
-// Copy rendered triangle index texture from pixel buffer object
+bool CPaintPathes::reusePickPass()
+{
+	mat4 modelviewMat, projMat;
+	ivec4 viewport;
+	queryViewState(modelviewMat, projMat, viewport);
+
+	if (!m_pickPassValid || computePickPassKey(modelviewMat, projMat, viewport) != m_pickPassKey)
+	{
+		return false;
+	}
+
+	m_pickReady = true;
+	wakeWorker();
+
+	return true;
+}
+
+// Nothing is read back here, tiles under the stroke are fetched once stroke points reach them
 void CPaintPathes::extractTriangleIndexTexture(GLuint texId)
 {
 	//cout << "Info: Start a new sketch!" << endl;
-	m_pTriangleIdxData = m_pPBO->getDataPointer(texId);
+	m_pickTexId = texId;
+
+	mat4 modelviewMat, projMat;
+	ivec4 viewport;
+	queryViewState(modelviewMat, projMat, viewport);
+
+	if (m_pickSource == PST_VALIDATE)
+	{
+		validateSoftwarePick(texId, modelviewMat, projMat, viewport);
+	}
+
+	// The worker waits on m_pickReady, so no tile is in flight while the cache is dropped
+	resetPickTiles();
+	m_pickPassKey = computePickPassKey(modelviewMat, projMat, viewport);
+	m_pickPassValid = true;
+
+	m_pickReady = true;
+	wakeWorker();
 }
 
-void CPaintPathes::compute3dPath()
+void CPaintPathes::extractTriangleIndexSoftware(const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport)
+{
+	if (m_pickSource == PST_RAYCAST)
+	{
+		if (CBrushGlobalRes::s_pSmoothMeshBVH->isStale())
+		{
+			CBrushGlobalRes::s_pSmoothMeshBVH->build(CBrushGlobalRes::s_pSmoothMesh);
+		}
+
+		// The worker waits on m_pickReady, so the view can't change under a ray cast in flight
+		m_rayModelviewMat = modelviewMat;
+		m_rayProjMat = projMat;
+		m_rayViewport = viewport;
+		m_pickPassKey = computePickPassKey(modelviewMat, projMat, viewport);
+		m_pickPassValid = true;
+
+		m_pickReady = true;
+		wakeWorker();
+		return;
+	}
+
+	if (m_pSoftRasterizer == NULL)
+	{
+		int winWidth, winHeight;
+		CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+		m_pSoftRasterizer = new CSoftRasterizer(winWidth, winHeight);
+	}
+
+	double startTime = CRenderUtilities::getTime();
+
+	m_pSoftRasterizer->rasterize(CBrushGlobalRes::s_pFlatMesh, modelviewMat, projMat, viewport);
+
+	memcpy(&m_triIdxCache[0], m_pSoftRasterizer->getTriIdxData(), m_triIdxCache.size() * sizeof(uint));
+	memcpy(&m_baryCache[0], m_pSoftRasterizer->getBaryData(), m_baryCache.size() * sizeof(uint));
+
+	// Every tile is already in the cache, nothing is ever requested from the render thread
+	resetPickTiles();
+	m_tileRequested.assign(m_tileRequested.size(), 1);
+	m_pickPassKey = computePickPassKey(modelviewMat, projMat, viewport);
+	m_pickPassValid = true;
+
+	cout << "Info: Software pick pass drawn in " << (CRenderUtilities::getTime() - startTime) * 1000.0 << " ms" << endl;
+
+	m_pickReady = true;
+	wakeWorker();
+}
+
+// Full read back of the GL pick pass, compared pixel by pixel with the software one
+void CPaintPathes::validateSoftwarePick(GLuint texId, const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport)
+{
+	m_pSoftRasterizer->rasterize(CBrushGlobalRes::s_pFlatMesh, modelviewMat, projMat, viewport);
+
+	const uint *pGLTriIdxData = (const uint*)m_pPBO->getDataPointer(texId);
+	const uint *pGLBaryData = (const uint*)m_pBaryPBO->getDataPointer(texId);
+
+	if (pGLTriIdxData == NULL || pGLBaryData == NULL)
+	{
+		cout << "ERROR: GL pick pass read back failed, software pick not validated!" << endl;
+		m_pPBO->unmapData();
+		m_pBaryPBO->unmapData();
+		return;
+	}
+
+	const uint *pSoftTriIdxData = m_pSoftRasterizer->getTriIdxData();
+	const uint *pSoftBaryData = m_pSoftRasterizer->getBaryData();
+	const int pixelNum = m_pSoftRasterizer->getWidth() * m_pSoftRasterizer->getHeight();
+
+	int mismatchNum = 0, coveredNum = 0;
+	float baryErrorSum = 0.0f, maxBaryError = 0.0f;
+	for (int pixelIdx = 0; pixelIdx < pixelNum; ++pixelIdx)
+	{
+		if (pGLTriIdxData[pixelIdx] != pSoftTriIdxData[pixelIdx])
+		{
+			++mismatchNum;
+			continue;
+		}
+
+		if (pGLTriIdxData[pixelIdx] == 0)
+		{
+			continue;
+		}
+
+		++coveredNum;
+		for (int shift = 0; shift < 32; shift += 16)
+		{
+			float error = fabs((float)((pGLBaryData[pixelIdx] >> shift) & 0xFFFF) - (float)((pSoftBaryData[pixelIdx] >> shift) & 0xFFFF)) / 65535.0f;
+			baryErrorSum += error;
+			maxBaryError = std::max(maxBaryError, error);
+		}
+	}
+
+	m_pPBO->unmapData();
+	m_pBaryPBO->unmapData();
+
+	cout << "Info: Software pick differs from GL on " << mismatchNum << " of " << pixelNum << " pixels ("
+		<< 100.0f * mismatchNum / pixelNum << "%), barycentric error mean " << (coveredNum > 0 ? baryErrorSum / (2 * coveredNum) : 0.0f)
+		<< " max " << maxBaryError << endl;
+}
+
+void CPaintPathes::consumePickResults(bool wait)
+{
+	if (!m_tileBatchVec.empty())
+	{
+		if (!wait && !(m_pPBO->isReadReady() && m_pBaryPBO->isReadReady()))
+		{
+			return;
+		}
+
+		copyPickTiles(m_tileBatchVec);
+		m_tileReadyNum += m_tileBatchVec.size();
+		m_tileBatchVec.clear();
+		wakeWorker();
+	}
+
+	int tileIdx;
+	while (m_tileRequestQueue.pop(tileIdx))
+	{
+		m_tileBatchVec.push_back(tileIdx);
+	}
+
+	if (!m_tileBatchVec.empty())
+	{
+		readPickTiles(m_tileBatchVec);
+
+		// The read lands in a later frame
+		CRenderSystem::Instance()->requestRedraw(RDF_STROKE);
+	}
+}
+
+void CPaintPathes::resetPickTiles()
+{
+	m_tileRequested.assign(m_tileRequested.size(), 0);
+	m_tileRequestNum = 0;
+	m_tileReadyNum = 0;
+}
+
+void CPaintPathes::fetchPickTiles(const vector<ivec2> &pointVec)
 {
 	int winWidth, winHeight;
 	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
 
-	m_triIdxVec.clear();
-	m_pathVec3D.clear();
+	for (int pointIdx = 0; pointIdx < pointVec.size(); ++pointIdx)
+	{
+		int winX = pointVec[pointIdx][0];
+		int winY = winHeight - pointVec[pointIdx][1] - 1;
 
-	ivec3 *pTriIndices = CBrushGlobalRes::s_pSmoothMesh->getTriIdx();
-	float* pTriMarkData = CBrushGlobalRes::s_pFlatMesh->getPropFloatData();
-	// Reset all triangles as not marked
-	for (int idx = 0; idx < CBrushGlobalRes::s_pFlatMesh->getVerNum(); ++idx) {
-		pTriMarkData[idx] = 0.0f;
+		if (winX < 0 || winX >= winWidth || winY < 0 || winY >= winHeight)
+		{
+			continue;
+		}
+
+		int tileIdx = (winY / PICK_TILE_SIZE) * m_tileColNum + winX / PICK_TILE_SIZE;
+		if (!m_tileRequested[tileIdx])
+		{
+			m_tileRequested[tileIdx] = 1;
+			++m_tileRequestNum;
+
+			while (!m_tileRequestQueue.push(tileIdx))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Tile requests are read back by the render loop, or by the render thread waiting for the worker
+	if (m_tileReadyNum < m_tileRequestNum)
+	{
+		CRenderSystem::Instance()->requestRedraw(RDF_STROKE);
+		wakeRenderThread();
+	}
+
+	// The synchronous path runs on the render thread and has to service its own requests
+	const bool onRenderThread = std::this_thread::get_id() != m_workerThread.get_id();
+
+	if (onRenderThread)
+	{
+		while (m_tileReadyNum < m_tileRequestNum)
+		{
+			consumePickResults(true);
+		}
+	}
+	else
+	{
+		workerWait([this](){ return m_tileReadyNum >= m_tileRequestNum || m_stopWorker; });
+	}
+}
+
+ivec4 CPaintPathes::getTileRect(int tileIdx)
+{
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+
+	int x = (tileIdx % m_tileColNum) * PICK_TILE_SIZE;
+	int y = (tileIdx / m_tileColNum) * PICK_TILE_SIZE;
+
+	return ivec4(x, y, std::min(PICK_TILE_SIZE, winWidth - x), std::min(PICK_TILE_SIZE, winHeight - y));
+}
+
+void CPaintPathes::readPickTiles(const vector<int> &tileIdxVec)
+{
+	vector<ivec4> rectVec(tileIdxVec.size());
+	for (int idx = 0; idx < tileIdxVec.size(); ++idx)
+	{
+		rectVec[idx] = getTileRect(tileIdxVec[idx]);
+	}
+
+	CBrushGlobalRes::s_pFrameBuffer->bindForRead();
+	m_pPBO->startReadTiles(m_pickTexId, rectVec);
+	m_pBaryPBO->startReadTiles(m_pickTexId, rectVec);
+	CGLStateCache::Instance()->bindFrameBuffer(GL_READ_FRAMEBUFFER, CFrameBufferObject::getDefaultFrameBuffer());
+}
+
+// Tiles are packed one after another in the pixel buffers, rows are scattered into the window caches
+void CPaintPathes::copyPickTiles(const vector<int> &tileIdxVec)
+{
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+
+	const uint *pTriIdxData = (const uint*)m_pPBO->mapData();
+	const uint *pBaryData = (const uint*)m_pBaryPBO->mapData();
+
+	if (pTriIdxData == NULL || pBaryData == NULL)
+	{
+		cout << "ERROR: Pick tile read back failed!" << endl;
+		m_pPBO->unmapData();
+		m_pBaryPBO->unmapData();
+		return;
 	}
 
+	for (int idx = 0; idx < tileIdxVec.size(); ++idx)
+	{
+		ivec4 rect = getTileRect(tileIdxVec[idx]);
+
+		for (int row = 0; row < rect[3]; ++row)
+		{
+			int cacheOffset = (rect[1] + row) * winWidth + rect[0];
+			memcpy(&m_triIdxCache[cacheOffset], pTriIdxData + row * rect[2], rect[2] * sizeof(uint));
+			memcpy(&m_baryCache[cacheOffset], pBaryData + row * rect[2], rect[2] * sizeof(uint));
+		}
+
+		pTriIdxData += rect[2] * rect[3];
+		pBaryData += rect[2] * rect[3];
+	}
+
+	m_pPBO->unmapData();
+	m_pBaryPBO->unmapData();
+}
+
+// The camera's matrices of the current frame, nothing is read back from GL
+void CPaintPathes::queryViewState(mat4 &modelviewMat, mat4 &projMat, ivec4 &viewport)
+{
+	CCamera *pCamera = CViewer::getViewerInstance()->getCamera();
+
+	modelviewMat = pCamera->getModelviewMat();
+	projMat = pCamera->getProjMat();
+	viewport = pCamera->getViewport();
+}
+
+// FNV-1a over the matrices and viewport of the pick pass and the geometry version of the picked mesh
+unsigned long long CPaintPathes::computePickPassKey(const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport)
+{
+	float matrices[32];
+	for (int col = 0; col < 4; ++col)
+	{
+		for (int row = 0; row < 4; ++row)
+		{
+			matrices[col * 4 + row] = modelviewMat[col][row];
+			matrices[16 + col * 4 + row] = projMat[col][row];
+		}
+	}
+	int viewportData[4] = { viewport[0], viewport[1], viewport[2], viewport[3] };
+	uint geometryVersion = CBrushGlobalRes::s_pFlatMesh->getGeometryVersion();
+
+	unsigned long long key = 14695981039346656037ULL;
+	const unsigned char *pBytes[3] = { (const unsigned char*)matrices, (const unsigned char*)viewportData, (const unsigned char*)&geometryVersion };
+	const int byteNums[3] = { sizeof(matrices), sizeof(viewportData), sizeof(geometryVersion) };
+
+	for (int partIdx = 0; partIdx < 3; ++partIdx)
+	{
+		for (int byteIdx = 0; byteIdx < byteNums[partIdx]; ++byteIdx)
+		{
+			key = (key ^ pBytes[partIdx][byteIdx]) * 1099511628211ULL;
+		}
+	}
+
+	return key;
+}
+
+// Surface points are interpolated from the picked triangle's corners, no depth or matrices involved
+void CPaintPathes::reconstructPoints(const vector<int> &triIdxVec, const vector<vec2> &baryVec, vector<vec3> &worldPosVec)
+{
+	const ivec3 *pTriIndices = CBrushGlobalRes::s_pSmoothMesh->getTriIdx();
+	const vec3 *pVertices = CBrushGlobalRes::s_pSmoothMesh->getVertices();
+
+	worldPosVec.resize(triIdxVec.size());
+
+	for (int pointIdx = 0; pointIdx < triIdxVec.size(); ++pointIdx)
+	{
+		float b1 = baryVec[pointIdx][0];
+		float b2 = baryVec[pointIdx][1];
+		float b0 = std::max(1.0f - b1 - b2, 0.0f);
+
+		const ivec3 &triangle = pTriIndices[triIdxVec[pointIdx]];
+		worldPosVec[pointIdx] = pVertices[triangle[0]] * b0 + pVertices[triangle[1]] * b1 + pVertices[triangle[2]] * b2;
+	}
+}
+
+void CPaintPathes::compute3dPath()
+{
+	TRACE_SCOPE("compute3dPath");
+
+	// Seeding state is shared with the stroke worker
+	waitForIdle();
+
+	m_triIdxVec.clear();
+	m_pathVec3D.clear();
+
 	vector<int> newPathTriangleIdxVec;
-	set<int> newPathTriangleIdxSet;
-	vector<vec3> newPathPointVec3D;
-	set<int> curveTriangleIdxSet; // Set to maintain triangle index on curve to keep unique
-	
-	// Only one path currently
+	vector<ivec2> pointVec;
+	StrokeLayer layer;
+
+	// Every path becomes its own stroke layer
 	for (int pathIdx = 0; pathIdx < m_pathVec.size(); ++pathIdx)
 	{
 		newPathTriangleIdxVec.clear();
-		newPathTriangleIdxSet.clear();
-		newPathPointVec3D.clear();
-		curveTriangleIdxSet.clear();
+		resetSeedState();
+		m_lastPickedTriIdx = -9;
+		m_zeroOrderPathIdxVec.clear();
+		m_firstOrderPathIdxVec.clear();
+		resetPathTiming();
 
 		cout << "Info: New path in 3D" << endl;
 
-		int lastTriIdx = -9;
-		for (int pointIdx = 0; pointIdx < m_pathVec[pathIdx].size(); ++pointIdx)
-		{
-			ivec2 curPointScreenPos = m_pathVec[pathIdx][pointIdx];
-			int pixelIdx = (winHeight - curPointScreenPos[1] - 1) * winWidth + curPointScreenPos[0];
+		double startTime = CRenderUtilities::getTime();
+		TRACE_BEGIN("condition");
+		conditionPath(m_pathVec[pathIdx], pointVec);
+		TRACE_END("condition");
+		m_pathTiming.stageTime[SS_CONDITION] = CRenderUtilities::getTime() - startTime;
 
-			// Fetch vertex index from frame buffer texture
-			int curTriIdx = m_pTriangleIdxData[pixelIdx] - 1;
+		processPathPoints(pointVec, newPathTriangleIdxVec);
 
-			if (curTriIdx < 0 || curTriIdx >= CBrushGlobalRes::s_pSmoothMesh->getTriNum())
-			{
-				continue;
-			}
+		cout << "Info: Seeded " << pointVec.size() << " stroke points into " << newPathTriangleIdxVec.size()
+			<< " seeds in " << m_pathTiming.stageTime[SS_SEED] * 1000.0 << " ms" << endl;
 
-			if (curTriIdx == lastTriIdx) continue;
+		computeStrokeLayer(newPathTriangleIdxVec, layer);
+		applyPathResult(layer, m_curveTriIdxVec, m_pathTiming);
+	}
 
-			// Add triangle index to set
-			curveTriangleIdxSet.insert(curTriIdx);
-			pTriMarkData[curTriIdx * 3 + 0] = pTriMarkData[curTriIdx * 3 + 1] = pTriMarkData[curTriIdx * 3 + 2] = 1.0f;
-			lastTriIdx = curTriIdx;
-		}
+	resetSeedState();
+	m_pathVec.clear();
+}
+
+void CPaintPathes::resetPathTiming()
+{
+	for (int stageIdx = 0; stageIdx < SS_TOTALNUM; ++stageIdx)
+	{
+		m_pathTiming.stageTime[stageIdx] = 0.0;
+	}
+
+	m_pathTiming.pointNum = m_pathTiming.seedNum = m_pathTiming.bandVerNum = 0;
+}
+
+void CPaintPathes::processPathPoints(const vector<ivec2> &pointVec, vector<int> &seedVec)
+{
+	double startTime = CRenderUtilities::getTime();
+	TRACE_BEGIN("pick");
+
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+
+	// Ray cast picking needs no pick pass, otherwise the tiles under the points are read back
+	vector<BVHRayHit> hitVec;
+	if (m_pickSource == PST_RAYCAST)
+	{
+		CBrushGlobalRes::s_pSmoothMeshBVH->pickScreenPoints(pointVec, winHeight, m_rayModelviewMat, m_rayProjMat, m_rayViewport, hitVec);
+	}
+	else
+	{
+		fetchPickTiles(pointVec);
+	}
 
-		lastTriIdx = -9;
-		for (int pointIdx = 0; pointIdx < m_pathVec[pathIdx].size(); ++pointIdx)
+	// Collect picked points first so they can be reconstructed in one batch
+	vector<int> pickedTriIdxVec;
+	vector<vec2> pickedBaryVec;
+	vector<vec3> pickedWorldPosVec;
+
+	for (int pointIdx = 0; pointIdx < pointVec.size(); ++pointIdx)
+	{
+		ivec2 curPointScreenPos = pointVec[pointIdx];
+		if (curPointScreenPos[0] < 0 || curPointScreenPos[0] >= winWidth || curPointScreenPos[1] < 0 || curPointScreenPos[1] >= winHeight)
 		{
-			ivec2 curPointScreenPos = m_pathVec[pathIdx][pointIdx];
-			int pixelIdx = (winHeight - curPointScreenPos[1] - 1) * winWidth + curPointScreenPos[0];
+			continue;
+		}
 
-			// Fetch vertex index from frame buffer texture
-			int curTriIdx = m_pTriangleIdxData[pixelIdx] - 1;
+		int pixelIdx = (winHeight - curPointScreenPos[1] - 1) * winWidth + curPointScreenPos[0];
 
-			if (curTriIdx < 0 || curTriIdx >= CBrushGlobalRes::s_pSmoothMesh->getTriNum())
-			{
-				continue;
-			}
+		// Fetch vertex index from frame buffer texture
+		int curTriIdx = m_pickSource == PST_RAYCAST ? hitVec[pointIdx].triIdx : (int)m_pTriangleIdxData[pixelIdx] - 1;
 
-			if (curTriIdx == lastTriIdx) continue;
+		if (curTriIdx < 0 || curTriIdx >= CBrushGlobalRes::s_pSmoothMesh->getTriNum())
+		{
+			continue;
+		}
 
-			GLdouble modelview[16];
-			glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
-			GLdouble projection[16];
-			glGetDoublev(GL_PROJECTION_MATRIX, projection);
-			GLint viewport[4];
-			glGetIntegerv(GL_VIEWPORT, viewport);
+		if (curTriIdx == m_lastPickedTriIdx) continue;
 
-			float depth;
-			GLdouble objPos[3];
-			glReadPixels(curPointScreenPos[0], winHeight- curPointScreenPos[1], 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-			glReadPixels(curPointScreenPos[0], winHeight - curPointScreenPos[1], 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-			//cout << "Depth is " << depth << endl;
-			gluUnProject(curPointScreenPos[0], winHeight - curPointScreenPos[1], depth, modelview, projection, viewport, &objPos[0], &objPos[1], &objPos[2]);
-			
-			vec3* point = new vec3(objPos[0], objPos[1], objPos[2]);
-			AddVertex(curTriIdx, pTriIndices, point, newPathTriangleIdxVec, newPathTriangleIdxSet, curveTriangleIdxSet);
+		// Flag triangle as on curve
+		markCurveTriangle(curTriIdx);
+		m_lastPickedTriIdx = curTriIdx;
+
+		pickedTriIdxVec.push_back(curTriIdx);
+		if (m_pickSource == PST_RAYCAST)
+		{
+			pickedBaryVec.push_back(vec2(hitVec[pointIdx].u, hitVec[pointIdx].v));
+		}
+		else
+		{
+			uint packedBary = m_pBaryData[pixelIdx];
+			pickedBaryVec.push_back(vec2((packedBary & 0xFFFF) / 65535.0f, (packedBary >> 16) / 65535.0f));
 		}
 	}
 
-	float *pDisData = new float[CBrushGlobalRes::s_pSmoothMesh->getVerNum()];
+	double pickEndTime = CRenderUtilities::getTime();
+	TRACE_END("pick");
 
-	// Collect path segment between each two consecutive vertices
-	m_zeroOrderPathIdxVec.clear();
-	m_firstOrderPathIdxVec.clear();
+	TRACE_BEGIN("unproject");
+	reconstructPoints(pickedTriIdxVec, pickedBaryVec, pickedWorldPosVec);
+	TRACE_END("unproject");
+
+	double reconstructEndTime = CRenderUtilities::getTime();
+	TRACE_BEGIN("seed");
+
+	// Nearest mesh vertices of all points in one batch, a point near an edge may be nearest to none of its triangle's corners
+	vector<int> snapVerIdxVec(pickedWorldPosVec.size(), -1);
+	if (!CBrushGlobalRes::s_pSmoothMeshKdTree->isStale())
+	{
+		CBrushGlobalRes::s_pSmoothMeshKdTree->nearestVertices(pickedWorldPosVec, FLT_MAX, snapVerIdxVec);
+	}
+
+	int firstNewSeed = seedVec.size();
 
-	for (int verIdx = 1; verIdx < newPathTriangleIdxVec.size(); ++verIdx)
+	for (int pointIdx = 0; pointIdx < pickedTriIdxVec.size(); ++pointIdx)
+	{
+		AddVertex(pickedTriIdxVec[pointIdx], pickedWorldPosVec[pointIdx], seedVec, snapVerIdxVec[pointIdx]);
+	}
+
+	extendGeodesicPath(seedVec, firstNewSeed);
+	TRACE_END("seed");
+
+	m_pathTiming.stageTime[SS_PICK] += pickEndTime - startTime;
+	m_pathTiming.stageTime[SS_UNPROJECT] += reconstructEndTime - pickEndTime;
+	m_pathTiming.stageTime[SS_SEED] += CRenderUtilities::getTime() - reconstructEndTime;
+	m_pathTiming.pointNum += pointVec.size();
+	m_pathTiming.seedNum = seedVec.size();
+}
+
+// Collect path segment between each two consecutive vertices, starting from the first new one
+void CPaintPathes::extendGeodesicPath(const vector<int> &seedVec, int firstNewSeed)
+{
+	for (int verIdx = std::max(firstNewSeed, 1); verIdx < seedVec.size(); ++verIdx)
 	{
-		CBrushGlobalRes::s_pGeodesicMesh->computePath(
-			newPathTriangleIdxVec[verIdx - 1], newPathTriangleIdxVec[verIdx]);
+		CBrushGlobalRes::s_pGeodesicMesh->computePath(seedVec[verIdx - 1], seedVec[verIdx]);
 
 		for (int pointIdx = 0; pointIdx < CBrushGlobalRes::s_pGeodesicMesh->getZeroOrderPathIdxVec().size(); ++pointIdx)
 		{
@@ -202,59 +927,32 @@ void CPaintPathes::compute3dPath()
 			m_firstOrderPathIdxVec.push_back(CBrushGlobalRes::s_pGeodesicMesh->getFirstOrderPathIdxVec()[pointIdx]);
 		}
 	}
+}
 
-	//*********************************************************************************
-	// Todo-1:	Refine seed point set which satisfies that 
-	//			at most two vertices on a triangle can be added as seed points
-	// Input:	Triangle index set (variable curveTriangleIdxSet) on curve;
-	//			Triangle mesh data (triangle vertex corresponding data)
-	// Output:	Selected seed vertex index vector, 
-	//			addSeeds function will use this vector as parameter to set seed points
-	//			pls modify correspondingly.
-	//*********************************************************************************
-
-	/*
-	for (int pathIdx = 0; pathIdx < m_pathVec.size(); ++pathIdx) {
-		//int* hashArr;
-		//hashArr = (int*)malloc(sizeof(pTriIndices) / sizeof(ivec3) * sizeof(int) * 5);
-		ivec3 hashArr[10000];
-		for (int i = 0; i < 10000; i++)
-			hashArr[i][0] = hashArr[i][1] = hashArr[i][2] = 0;
-
-		set<int>::iterator it;
-		for (it = curveTriangleIdxSet.begin(); it != curveTriangleIdxSet.end(); it++) {
-			ivec3 triangle = pTriIndices[*it];
-			for (int i = 0; i < 3; i++) {
-				hashArr[*it][i]++;
-			}
-		}
+// Band limited fast marching from the seeds, the cost follows the size of the new stroke's band
+void CPaintPathes::computeStrokeLayer(const vector<int> &seedVec, StrokeLayer &layer)
+{
+	// Todo-1 (at most two seed vertices per triangle) is enforced while seeding in AddVertex
 
-		for (it = curveTriangleIdxSet.begin(); it != curveTriangleIdxSet.end(); it++) {
-			ivec3 triangle = pTriIndices[*it];
-			if (hashArr[*it][0] >= 2 && hashArr[*it][1] >= 2 && hashArr[*it][2] >= 2) {
-				int bypass = 0;
-				int min = hashArr[*it][0];
-				for (int i = 1; i < 3; i++) {
-					if (hashArr[*it][i] < min) {
-						bypass = i;
-						min = hashArr[*it][i];
-					}
-				}
-				vector<int>::iterator vit;
-				for (vit = newPathTriangleIdxVec.begin(); vit != newPathTriangleIdxVec.end(); vit++) {
-					if (*vit == bypass) {
-						int idx = pTriIndices[*it][bypass];
-						newPathTriangleIdxVec.erase(vit);
-						hashArr[*it][bypass]--;
-					}
-				}
-			}
-		}
-	}*/
+	float bandWidth;
+	CRenderSystemConfig::getSysCfgInstance()->getStrokeBand(bandWidth);
+
+	vector<int> verIdxVec;
+	vector<float> disVec;
 
+	double startTime = CRenderUtilities::getTime();
+	TRACE_BEGIN("march");
+
+	CBrushGlobalRes::s_pGeodesicMesh->setStopDistance(bandWidth);
 	CBrushGlobalRes::s_pGeodesicMesh->resetGeoMesh();
-	CBrushGlobalRes::s_pGeodesicMesh->addSeeds(newPathTriangleIdxVec);
-	CBrushGlobalRes::s_pGeodesicMesh->computeGeodesics(pDisData);
+	CBrushGlobalRes::s_pGeodesicMesh->addSeeds(seedVec);
+	CBrushGlobalRes::s_pGeodesicMesh->computeGeodesics(NULL);
+	CBrushGlobalRes::s_pGeodesicMesh->collectReachedVertices(seedVec, verIdxVec, disVec);
+
+	double marchEndTime = CRenderUtilities::getTime();
+	TRACE_END("march");
+
+	TRACE_SCOPE("parametrize");
 
 	collectVertexVectors();
 
@@ -262,17 +960,137 @@ void CPaintPathes::compute3dPath()
 
 	assignLocalTexcoords();
 
-	//*********************************************************************************
-	// Todo-5:	Update vertex buffer (s_pSmoothMesh) texcoord data
-	//*********************************************************************************
+	// Sort the band by vertex index for lookups and in-order attribute writes
+	vector<ivec2> order(verIdxVec.size());
+	for (int idx = 0; idx < verIdxVec.size(); ++idx)
+	{
+		order[idx] = ivec2(verIdxVec[idx], idx);
+	}
+	std::sort(order.begin(), order.end(), compareVertexOrder);
 
-	CBrushGlobalRes::s_pSmoothMesh->setPropFloat(pDisData, CBrushGlobalRes::s_pSmoothMesh->getVerNum());
-	CBrushGlobalRes::s_pSmoothMeshVBO->updateBuffer(VBOBM_FLOAT_PROP);
-	CBrushGlobalRes::s_pFlatMeshVBO->updateBuffer(VBOBM_FLOAT_PROP);
+	layer.priority = 0;
+	layer.verIdxVec.resize(order.size());
+	layer.disVec.resize(order.size());
+	for (int idx = 0; idx < order.size(); ++idx)
+	{
+		layer.verIdxVec[idx] = order[idx][0];
+		layer.disVec[idx] = disVec[order[idx][1]];
+	}
 
-	SAFE_DELETE_ARRAY(pDisData);
+	// Local texcoords are left invalid until Todo-4 assigns them
+	layer.texcoordVec.assign(order.size(), STROKE_TEXCOORD_INVALID);
 
-	m_pathVec.clear();
+	m_pathTiming.stageTime[SS_MARCH] = marchEndTime - startTime;
+	m_pathTiming.stageTime[SS_PARAMETRIZE] = CRenderUtilities::getTime() - marchEndTime;
+	m_pathTiming.bandVerNum = layer.verIdxVec.size();
+}
+
+// Mesh attributes are only touched here, on the thread owning the GL context
+void CPaintPathes::applyPathResult(StrokeLayer &layer, const vector<int> &curveTriIdxVec, StrokeTiming &timing)
+{
+	TRACE_SCOPE("applyPathResult");
+
+	double startTime = CRenderUtilities::getTime();
+
+	updateTriangleMarks(curveTriIdxVec);
+
+	// Todo-5: the new stroke's band is composited into the distance and texcoord attributes, later strokes on top
+	if (!layer.verIdxVec.empty())
+	{
+		vector<int> changedVerIdxVec;
+		vector<StrokeVertexState> beforeStateVec;
+		int layerNumBefore = m_strokeLayers.getLayerNum();
+
+		layer.priority = m_strokeLayers.getNextPriority();
+
+		m_strokeLayers.startRecording(&changedVerIdxVec, &beforeStateVec);
+		m_strokeLayers.addLayer(layer, CBrushGlobalRes::s_pSmoothMesh);
+		m_strokeLayers.stopRecording();
+
+		m_paintHistory.pushEntry(changedVerIdxVec, beforeStateVec, layerNumBefore, m_strokeLayers, CBrushGlobalRes::s_pSmoothMesh);
+	}
+
+	CBrushGlobalRes::s_pSmoothMeshVBO->updateDirtyBuffer(VBOBM_FLOAT_PROP | VBOBM_FLOAT2_PROP);
+	CBrushGlobalRes::s_pFlatMeshVBO->updateDirtyBuffer(VBOBM_FLOAT_PROP);
+
+	timing.stageTime[SS_UPLOAD] = CRenderUtilities::getTime() - startTime;
+	m_strokeTimingVec.push_back(timing);
+
+	for (int stageIdx = 0; stageIdx < SS_TOTALNUM; ++stageIdx)
+	{
+		CFrameProfiler::Instance()->addCpuSample(ProfileStage(PFS_STROKE_CONDITION + stageIdx), timing.stageTime[stageIdx]);
+	}
+}
+
+// Only faces marked by the previous stroke are cleared, and only faces whose mark changes are uploaded
+void CPaintPathes::updateTriangleMarks(const vector<int> &curveTriIdxVec)
+{
+	CTriangleMesh *pFlatMesh = CBrushGlobalRes::s_pFlatMesh;
+	float* pTriMarkData = pFlatMesh->getPropFloatData();
+
+	if (m_faceMarkEpoch.size() != pFlatMesh->getTriNum())
+	{
+		m_markedTriIdxVec.clear();
+		m_faceMarkEpoch.clear();
+	}
+
+	// Restamping from zero on wrap, prevEpoch == 0 then rewrites every new mark
+	if (m_faceMarkEpoch.empty() || m_markEpoch == 0xFFFFFFFF)
+	{
+		m_faceMarkEpoch.assign(pFlatMesh->getTriNum(), 0);
+		m_markEpoch = 0;
+	}
+
+	const uint prevEpoch = m_markEpoch++;
+
+	for (int idx = 0; idx < curveTriIdxVec.size(); ++idx)
+	{
+		int triIdx = curveTriIdxVec[idx];
+		if (m_faceMarkEpoch[triIdx] == m_markEpoch)
+		{
+			continue;
+		}
+
+		// Faces still marked from the previous stroke keep their value
+		if (prevEpoch == 0 || m_faceMarkEpoch[triIdx] != prevEpoch)
+		{
+			pTriMarkData[triIdx * 3 + 0] = pTriMarkData[triIdx * 3 + 1] = pTriMarkData[triIdx * 3 + 2] = 1.0f;
+			pFlatMesh->markPropDirty(TMPC_FLOAT, triIdx * 3, triIdx * 3 + 3);
+		}
+		m_faceMarkEpoch[triIdx] = m_markEpoch;
+	}
+
+	for (int idx = 0; idx < m_markedTriIdxVec.size(); ++idx)
+	{
+		int triIdx = m_markedTriIdxVec[idx];
+		if (m_faceMarkEpoch[triIdx] != m_markEpoch)
+		{
+			pTriMarkData[triIdx * 3 + 0] = pTriMarkData[triIdx * 3 + 1] = pTriMarkData[triIdx * 3 + 2] = 0.0f;
+			pFlatMesh->markPropDirty(TMPC_FLOAT, triIdx * 3, triIdx * 3 + 3);
+		}
+	}
+
+	m_markedTriIdxVec.assign(curveTriIdxVec.begin(), curveTriIdxVec.end());
+}
+
+void CPaintPathes::undoStroke()
+{
+	if (m_paintHistory.undo(m_strokeLayers, CBrushGlobalRes::s_pSmoothMesh))
+	{
+		CBrushGlobalRes::s_pSmoothMeshVBO->updateDirtyBuffer(VBOBM_FLOAT_PROP | VBOBM_FLOAT2_PROP);
+		CRenderSystem::Instance()->requestRedraw(RDF_UPLOAD);
+		cout << "Info: Stroke undone, " << m_paintHistory.getUndoNum() << " left to undo" << endl;
+	}
+}
+
+void CPaintPathes::redoStroke()
+{
+	if (m_paintHistory.redo(m_strokeLayers, CBrushGlobalRes::s_pSmoothMesh))
+	{
+		CBrushGlobalRes::s_pSmoothMeshVBO->updateDirtyBuffer(VBOBM_FLOAT_PROP | VBOBM_FLOAT2_PROP);
+		CRenderSystem::Instance()->requestRedraw(RDF_UPLOAD);
+		cout << "Info: Stroke redone, " << m_paintHistory.getRedoNum() << " left to redo" << endl;
+	}
 }
 
 //**************************************************************************
@@ -323,17 +1141,22 @@ void CPaintPathes::assignLocalTexcoords()
 }
 
 
-void CPaintPathes::AddVertex(int triIdx, ivec3* pTriIndices, vec3* point, vector<int> &newPathTriangleIdxVec, set<int> &newPathTriangleIdxSet, set<int> &curveTriangleIdxSet) {
+// Snap a picked point to the nearest corner of its triangle and add it as a seed vertex,
+// unless a curve triangle around that vertex already holds two other seeds.
+// Runs in O(valence) through the vertex face adjacency.
+void CPaintPathes::AddVertex(int triIdx, const vec3 &point, vector<int> &newPathTriangleIdxVec, int snapVerIdx) {
+	const ivec3 *pTriIndices = CBrushGlobalRes::s_pSmoothMesh->getTriIdx();
+	const vec3 *pVertices = CBrushGlobalRes::s_pSmoothMesh->getVertices();
+	const int *pVerFaceOffsets = CBrushGlobalRes::s_pSmoothMesh->getVerFaceOffsets();
+	const int *pVerFaceIndices = CBrushGlobalRes::s_pSmoothMesh->getVerFaceIndices();
+
 	float MinD = -1;
 	int MinVI = -1;
 	ivec3 triangle = pTriIndices[triIdx];
 
 	for (int i = 0; i < 3; i++) {
-		vec3* verPos = new vec3();
-		CBrushGlobalRes::s_pGeodesicMesh->getVertexPos(triangle[i], verPos);
-		float dist = sqrt(pow(verPos->x - point->x, 2) +
-			pow(verPos->y - point->y, 2) +
-			pow(verPos->z - point->z, 2));
+		vec3 diff = pVertices[triangle[i]] - point;
+		float dist = glm::dot(diff, diff);
 		if (dist < MinD || MinD < 0) {
 			MinD = dist;
 			MinVI = triangle[i];
@@ -345,34 +1168,90 @@ void CPaintPathes::AddVertex(int triIdx, ivec3* pTriIndices, vec3* point, vector
 		return;
 	}
 
-	int cnt = 0, flag = 1;
-	set<int>::iterator it;
-	for (it = curveTriangleIdxSet.begin(); it != curveTriangleIdxSet.end(); ++it) {
-		int ver[2];
-		ver[0] = ver[1] = -1;
-		cnt = 0;
-		triangle = pTriIndices[*it];
-		
-		for (int i = 0; i < 3; i++) {
-			if (newPathTriangleIdxSet.find(triangle[i]) != newPathTriangleIdxSet.end()) {
-				ver[cnt] = triangle[i];
-				cnt++;
+	// Only snap to vertices sharing a face with a corner, a nearer vertex further away lies on another part of the surface
+	if (snapVerIdx >= 0 && snapVerIdx != MinVI) {
+		vec3 diff = pVertices[snapVerIdx] - point;
+		if (glm::dot(diff, diff) < MinD) {
+			for (int adjIdx = pVerFaceOffsets[snapVerIdx]; adjIdx < pVerFaceOffsets[snapVerIdx + 1]; ++adjIdx) {
+				const ivec3 &face = pTriIndices[pVerFaceIndices[adjIdx]];
+				if (face[0] == triangle[0] || face[0] == triangle[1] || face[0] == triangle[2] ||
+					face[1] == triangle[0] || face[1] == triangle[1] || face[1] == triangle[2] ||
+					face[2] == triangle[0] || face[2] == triangle[1] || face[2] == triangle[2]) {
+					MinVI = snapVerIdx;
+					break;
+				}
 			}
 		}
-	
-		if (cnt > 1 && (ver[0] != MinVI && ver[1] != MinVI)) {
-			if (triangle[0] == MinVI || triangle[1] == MinVI || triangle[2] == MinVI) {
-				flag = 0;
-				break;
-			}
+	}
+
+	if (m_verIsSeed[MinVI]) {
+		// Already a seed, consecutive repeats add nothing
+		if (newPathTriangleIdxVec.empty() || newPathTriangleIdxVec.back() != MinVI) {
+			newPathTriangleIdxVec.push_back(MinVI);
+		}
+		return;
+	}
+
+	for (int adjIdx = pVerFaceOffsets[MinVI]; adjIdx < pVerFaceOffsets[MinVI + 1]; ++adjIdx) {
+		int faceIdx = pVerFaceIndices[adjIdx];
+		if (m_faceOnCurve[faceIdx] && m_faceSeedCount[faceIdx] >= 2) {
+			cout << "Ignore vertex " << MinVI << endl;
+			return;
+		}
+	}
+
+	for (int adjIdx = pVerFaceOffsets[MinVI]; adjIdx < pVerFaceOffsets[MinVI + 1]; ++adjIdx) {
+		m_faceSeedCount[pVerFaceIndices[adjIdx]]++;
+	}
+
+	m_verIsSeed[MinVI] = 1;
+	m_seedVerIdxVec.push_back(MinVI);
+	newPathTriangleIdxVec.push_back(MinVI);
+}
+
+// Clear seeding state left by the previous path, touching only the entries it set
+void CPaintPathes::resetSeedState()
+{
+	const int verNum = CBrushGlobalRes::s_pSmoothMesh->getVerNum();
+	const int triNum = CBrushGlobalRes::s_pSmoothMesh->getTriNum();
+
+	if (m_verIsSeed.size() != verNum || m_faceSeedCount.size() != triNum)
+	{
+		m_verIsSeed.assign(verNum, 0);
+		m_faceSeedCount.assign(triNum, 0);
+		m_faceOnCurve.assign(triNum, 0);
+		m_curveTriIdxVec.clear();
+		m_seedVerIdxVec.clear();
+		return;
+	}
+
+	const int *pVerFaceOffsets = CBrushGlobalRes::s_pSmoothMesh->getVerFaceOffsets();
+	const int *pVerFaceIndices = CBrushGlobalRes::s_pSmoothMesh->getVerFaceIndices();
+
+	for (int seedIdx = 0; seedIdx < m_seedVerIdxVec.size(); ++seedIdx)
+	{
+		int verIdx = m_seedVerIdxVec[seedIdx];
+		m_verIsSeed[verIdx] = 0;
+		for (int adjIdx = pVerFaceOffsets[verIdx]; adjIdx < pVerFaceOffsets[verIdx + 1]; ++adjIdx)
+		{
+			m_faceSeedCount[pVerFaceIndices[adjIdx]] = 0;
 		}
 	}
 
-	if (flag) {
-		newPathTriangleIdxVec.push_back(MinVI);
-		newPathTriangleIdxSet.insert(MinVI);
+	for (int idx = 0; idx < m_curveTriIdxVec.size(); ++idx)
+	{
+		m_faceOnCurve[m_curveTriIdxVec[idx]] = 0;
 	}
-	else {
-		cout << "Ignore vertex " << MinVI << endl;
+
+	m_seedVerIdxVec.clear();
+	m_curveTriIdxVec.clear();
+}
+
+void CPaintPathes::markCurveTriangle(int triIdx)
+{
+	if (!m_faceOnCurve[triIdx])
+	{
+		m_faceOnCurve[triIdx] = 1;
+		m_curveTriIdxVec.push_back(triIdx);
 	}
 }
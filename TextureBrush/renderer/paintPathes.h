@@ -2,24 +2,124 @@
 
 #include "../preHeader.h"
 
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "spscQueue.h"
+#include "strokeLayers.h"
+#include "paintHistory.h"
+
 namespace TextureSynthesis
 {
 
+enum StrokeMessageType
+{
+	SMT_BEGIN_PATH,
+	SMT_POINT,
+	SMT_END_PATH,
+	SMT_FINALIZE,
+	SMT_QUIT
+};
+
+struct StrokeMessage
+{
+	StrokeMessageType type;
+	ivec2 pos;
+};
+
+enum StrokeStage
+{
+	SS_CONDITION = 0,
+	SS_PICK,
+	SS_UNPROJECT,
+	SS_SEED,
+	SS_MARCH,
+	SS_PARAMETRIZE,
+	SS_UPLOAD,
+	SS_TOTALNUM
+};
+
+// Seconds spent per stage on one stroke, stages before upload run on the stroke worker
+struct StrokeTiming
+{
+	double stageTime[SS_TOTALNUM];
+	int pointNum;
+	int seedNum;
+	int bandVerNum;
+};
+
+// Where the pick buffers come from, set by SoftwarePick in system.cfg
+enum PickSourceType
+{
+	PST_GL = 0,
+	PST_SOFTWARE,
+	PST_VALIDATE,	// GL pass, compared against the software rasterizer every sketch
+	PST_RAYCAST		// No pick pass, stroke points are ray cast against the mesh BVH
+};
+
+// Stroke result handed from the stroke worker to the render thread
+struct StrokeSnapshot
+{
+	StrokeLayer layer;
+	vector<int> curveTriIdxVec;
+	StrokeTiming timing;
+};
+
 class CPixelBufferObject;
+class CSoftRasterizer;
 class CPaintPathes
 {
 public:
 	static CPaintPathes* Instance();
 	virtual ~CPaintPathes();
 
+	// Input thread side, stroke points are streamed to the worker as they arrive
+	void startSketch();
 	void startNewPath();
 	void addPointToPath(const ivec2 &newPos);
 	void endPath();
+	void finishSketch();
+
+	// Render thread side, uploads the latest finalized stroke if there is one
+	void publishResults();
+	void stopWorker();
 
+	// True if the last pick pass was drawn from the current view and mesh, its cached tiles are then reused
+	// and the pass doesn't need to be drawn again
+	bool reusePickPass();
+
+	// Capture the view of the pick pass, its tiles are read back on demand as stroke points need them
 	void extractTriangleIndexTexture(GLuint texId);
+
+	// Drop-in replacement of the GL pick pass, drawn on CPU from the given view straight into the pick caches.
+	// Ray cast picking only keeps the view.
+	void extractTriangleIndexSoftware(const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport);
+	bool isSoftwarePicking(){ return m_pickSource == PST_SOFTWARE || m_pickSource == PST_RAYCAST; }
+
+	// View of the viewer camera, its CPU built matrices and viewport, without reading anything back from GL
+	static void queryViewState(mat4 &modelviewMat, mat4 &projMat, ivec4 &viewport);
+
+	// Called once per frame, finishes the tile read back in flight and queues the tiles requested since
+	void consumePickResults(bool wait = false);
+
+	// Synchronous processing of m_pathVec on the calling thread
 	void compute3dPath();
 
-	void AddVertex(int triIdx, ivec3* pTriIndices, vec3* point, vector<int> &newPathTriangleIdxVec, set<int> &newPathTriangleIdxSet, set<int> &curveTriangleIdxSet);
+	CStrokeLayers& getStrokeLayers(){ return m_strokeLayers; }
+	const vector<StrokeTiming>& getStrokeTimingVec(){ return m_strokeTimingVec; }
+
+	// No queued input and no result waiting for upload
+	bool isIdle(){ return m_pendingMsgNum == 0 && !m_snapshotReady; }
+
+	// Render thread side, restores the attributes of the last stroke with partial uploads
+	void undoStroke();
+	void redoStroke();
+
+	// Seeds the corner of the picked triangle nearest to the point, or the given vertex if it is nearer and next to the triangle
+	void AddVertex(int triIdx, const vec3 &point, vector<int> &newPathTriangleIdxVec, int snapVerIdx = -1);
 
 	const vector<ivec2>& getPathPointVec(){ return m_pathPointVec; }
 	const vector<vector<ivec2> >& getPathVec(){ return m_pathVec; }
@@ -35,6 +135,42 @@ protected:
 	void calculateEquidisLineSegments();
 	void assignLocalTexcoords();
 
+	// Exact surface points of picked triangles from barycentric weights of their second and third corner
+	void reconstructPoints(const vector<int> &triIdxVec, const vector<vec2> &baryVec, vector<vec3> &worldPosVec);
+	unsigned long long computePickPassKey(const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport);
+	void validateSoftwarePick(GLuint texId, const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport);
+
+	// Make sure the pick tiles under the given points are in the CPU cache, requesting missing ones
+	void fetchPickTiles(const vector<ivec2> &pointVec);
+	void resetPickTiles();
+	void readPickTiles(const vector<int> &tileIdxVec);
+	void copyPickTiles(const vector<int> &tileIdxVec);
+	ivec4 getTileRect(int tileIdx);
+
+	// Fit raw mouse samples with cubic beziers and resample them at uniform arc length
+	void conditionPath(const vector<ivec2> &rawPointVec, vector<ivec2> &pointVec);
+
+	void resetSeedState();
+	void markCurveTriangle(int triIdx);
+	void updateTriangleMarks(const vector<int> &curveTriIdxVec);
+
+	// Pick, reconstruct and seed one run of stroke points, extending the geodesic path with new seeds
+	void processPathPoints(const vector<ivec2> &pointVec, vector<int> &seedVec);
+	void extendGeodesicPath(const vector<int> &seedVec, int firstNewSeed);
+	void computeStrokeLayer(const vector<int> &seedVec, StrokeLayer &layer);
+	void applyPathResult(StrokeLayer &layer, const vector<int> &curveTriIdxVec, StrokeTiming &timing);
+	void resetPathTiming();
+
+	void pushMessage(StrokeMessageType type, const ivec2 &pos = ivec2(0));
+	void waitForIdle();
+	void wakeRenderThread();
+	void wakeWorker();
+	void workerWait(const std::function<bool()> &ready);
+	void workerLoop();
+	void beginStreamPath();
+	void streamPathPoints(bool flushTail);
+	void finalizeStream();
+
 private:
 	vector<ivec2> m_pathPointVec;
 	vector<vector<ivec2> > m_pathVec;
@@ -46,7 +182,78 @@ private:
 	vector<int> m_firstOrderPathIdxVec;
 
 	CPixelBufferObject* m_pPBO;
-	uint* m_pTriangleIdxData;
+	const uint* m_pTriangleIdxData;
+
+	// Barycentric coordinates read back together with the triangle index buffer
+	CPixelBufferObject* m_pBaryPBO;
+	const uint* m_pBaryData;
+
+	// Window sized caches of the pick pass, filled tile by tile. Tiles are requested by the thread
+	// seeding stroke points and read back by the render thread, completions are counted in order.
+	GLuint m_pickTexId;
+	unsigned long long m_pickPassKey;
+	bool m_pickPassValid;
+	int m_pickSource;
+	CSoftRasterizer* m_pSoftRasterizer;
+	mat4 m_rayModelviewMat, m_rayProjMat;
+	ivec4 m_rayViewport;
+	vector<uint> m_triIdxCache;
+	vector<uint> m_baryCache;
+	vector<unsigned char> m_tileRequested;
+	int m_tileColNum, m_tileRowNum;
+	int m_tileRequestNum;
+	std::atomic<int> m_tileReadyNum;
+	CSpscQueue<int> m_tileRequestQueue;
+	vector<int> m_tileBatchVec;
+
+	// Flat per-face and per-vertex seeding state, only touched entries are reset
+	vector<unsigned char> m_faceSeedCount;
+	vector<unsigned char> m_faceOnCurve;
+	vector<unsigned char> m_verIsSeed;
+	vector<int> m_curveTriIdxVec;
+	vector<int> m_seedVerIdxVec;
+
+	// Faces marked on the flat mesh, stamped with the epoch of the stroke that marked them
+	vector<uint> m_faceMarkEpoch;
+	vector<int> m_markedTriIdxVec;
+	uint m_markEpoch;
+
+	int m_lastPickedTriIdx;
+	StrokeTiming m_pathTiming;
+
+	// Stroke worker, fed by the input thread through a single producer single consumer queue
+	CSpscQueue<StrokeMessage> m_messageQueue;
+	std::thread m_workerThread;
+	std::atomic<int> m_pendingMsgNum;
+
+	// Signalled when the queue is drained or pick tiles are requested, for the render thread in waitForIdle
+	std::mutex m_idleMutex;
+	std::condition_variable m_idleCond;
+
+	// Signalled when a message is queued, the pick pass is ready, tiles are read back or a snapshot is taken
+	std::mutex m_workerMutex;
+	std::condition_variable m_workerCond;
+	std::atomic<bool> m_pickReady;
+	std::atomic<bool> m_stopWorker;
+
+	// Worker owned state of the stroke being drawn, the first raw point is the last conditioned one
+	vector<ivec2> m_streamRawVec;
+	vector<int> m_streamSeedVec;
+	bool m_streamAnchorSent;
+	bool m_streamPathOpen;
+	double m_finalizeStartTime;
+
+	// Double buffered results, the worker never writes the snapshot being read
+	StrokeSnapshot m_snapshots[2];
+	int m_writeIdx;
+	std::atomic<int> m_publishedIdx;
+	std::atomic<int> m_readingIdx;
+	std::atomic<bool> m_snapshotReady;
+
+	// Retained strokes and their undo history, owned by the render thread
+	CStrokeLayers m_strokeLayers;
+	CPaintHistory m_paintHistory;
+	vector<StrokeTiming> m_strokeTimingVec;
 };
 
 }
\ No newline at end of file
@@ -1,62 +1,162 @@
 #include "pixelBufferObject.h"
 #include "glTexture.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
-CPixelBufferObject::CPixelBufferObject(TexelFormat vTexelFmt, TexelType vTexelType, int vWidth, int vHeight) : 
-m_texelFmt(vTexelFmt), m_texelType(vTexelType), m_width(vWidth), m_height(vHeight)
+CPixelBufferObject::CPixelBufferObject(TexelFormat vTexelFmt, TexelType vTexelType, int vWidth, int vHeight, int colorAttachIdx) : 
+m_texelFmt(vTexelFmt), m_texelType(vTexelType), m_width(vWidth), m_height(vHeight), m_colorAttachIdx(colorAttachIdx), m_readIdx(-1), m_mappedIdx(-1), m_pMappedData(NULL)
 {
-	glGenBuffers(1, &m_pboId);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboId);
-	glBufferData(GL_PIXEL_PACK_BUFFER, vWidth * vHeight * CTexturePropMap::s_fmt2ChannelNum[vTexelFmt]
-		* CTexturePropMap::s_type2ByteNum[vTexelType], NULL, GL_STREAM_READ);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_texelByteNum = CTexturePropMap::s_fmt2ChannelNum[vTexelFmt] * CTexturePropMap::s_type2ByteNum[vTexelType];
+	m_byteNum = vWidth * vHeight * m_texelByteNum;
 
-	m_pData = new uint[vWidth * vHeight];
+	glGenBuffers(PBO_RING_SIZE, m_pboIds);
+	for (int idx = 0; idx < PBO_RING_SIZE; ++idx)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboIds[idx]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, m_byteNum, NULL, GL_STREAM_READ);
+		m_fences[idx] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
 CPixelBufferObject::~CPixelBufferObject()
 {
-	glDeleteBuffers(1, &m_pboId);
+	unmapData();
+
+	for (int idx = 0; idx < PBO_RING_SIZE; ++idx)
+	{
+		if (m_fences[idx] != 0)
+		{
+			glDeleteSync(m_fences[idx]);
+		}
+	}
+	glDeleteBuffers(PBO_RING_SIZE, m_pboIds);
+}
+
+void CPixelBufferObject::startRead(GLuint texId)
+{
+	startReadTiles(texId, vector<ivec4>(1, ivec4(0, 0, m_width, m_height)));
 }
 
-uint* CPixelBufferObject::getDataPointer(GLuint texId)
+void CPixelBufferObject::startReadTiles(GLuint texId, const vector<ivec4> &rectVec)
 {
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	unmapData();
 
-	glBindTexture(GL_TEXTURE_2D, texId);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboId);
-	// FIX: Fixed texture format and texel type!
-	glReadPixels(0, 0, m_width, m_height, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+	m_readIdx = (m_readIdx + 1) % PBO_RING_SIZE;
 
-	void *retPointer = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (m_texelFmt != TEXELFMT_DEPTH_COMPONENT)
+	{
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + m_colorAttachIdx);
+		CGLStateCache::Instance()->bindTexture(GL_TEXTURE_2D, texId);
+	}
 
-	copyData(retPointer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboIds[m_readIdx]);
+
+	int offset = 0;
+	for (int rectIdx = 0; rectIdx < rectVec.size(); ++rectIdx)
+	{
+		const ivec4 &rect = rectVec[rectIdx];
+		int rectByteNum = rect[2] * rect[3] * m_texelByteNum;
+
+		if (offset + rectByteNum > m_byteNum)
+		{
+			cout << "ERROR: Pixel buffer too small for " << rectVec.size() << " rectangles!" << endl;
+			break;
+		}
+
+		glReadPixels(rect[0], rect[1], rect[2], rect[3], m_texelFmt, m_texelType, (GLvoid*)(size_t)offset);
+		offset += rectByteNum;
+	}
 
-	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
 	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	return m_pData;
+	if (m_fences[m_readIdx] != 0)
+	{
+		glDeleteSync(m_fences[m_readIdx]);
+	}
+	m_fences[m_readIdx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// Make sure the fence reaches the GPU even if nothing else flushes this frame
+	glFlush();
+}
+
+bool CPixelBufferObject::isReadReady()
+{
+	if (m_readIdx < 0)
+	{
+		return false;
+	}
+
+	if (m_fences[m_readIdx] == 0)
+	{
+		return true;
+	}
+
+	GLenum result = glClientWaitSync(m_fences[m_readIdx], 0, 0);
+	return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
 }
 
-void CPixelBufferObject::copyData(void* pPboData)
+const void* CPixelBufferObject::mapData()
 {
-	uint* pData = (uint*)(pPboData);
+	if (m_readIdx < 0)
+	{
+		cout << "ERROR: Pixel buffer mapped before any read!" << endl;
+		return NULL;
+	}
+
+	if (m_mappedIdx == m_readIdx)
+	{
+		return m_pMappedData;
+	}
 
-	//cout << endl;
-	for (int hIdx = 0; hIdx < m_height; ++hIdx)
+	unmapData();
+
+	if (m_fences[m_readIdx] != 0)
 	{
-		//cout << endl;
-		for (int vIdx = 0; vIdx < m_width; ++vIdx)
+		GLenum result = glClientWaitSync(m_fences[m_readIdx], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		if (result == GL_WAIT_FAILED)
 		{
-			m_pData[hIdx * m_width + vIdx] = pData[hIdx * m_width + vIdx];
-			/*if (m_pData[hIdx * m_width + vIdx] > 0)
-			{
-			cout << "0";
-			}
-			else
-			cout << "1";*/
+			cout << "WARNING: Waiting on the pixel buffer fence failed!" << endl;
 		}
+
+		glDeleteSync(m_fences[m_readIdx]);
+		m_fences[m_readIdx] = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboIds[m_readIdx]);
+	m_pMappedData = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_byteNum, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (m_pMappedData == NULL)
+	{
+		cout << "ERROR: Mapping the pixel buffer failed!" << endl;
+		return NULL;
 	}
-	//cout << endl;
-}
\ No newline at end of file
+
+	m_mappedIdx = m_readIdx;
+
+	return m_pMappedData;
+}
+
+void CPixelBufferObject::unmapData()
+{
+	if (m_mappedIdx < 0)
+	{
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pboIds[m_mappedIdx]);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	m_mappedIdx = -1;
+	m_pMappedData = NULL;
+}
+
+const void* CPixelBufferObject::getDataPointer(GLuint texId)
+{
+	startRead(texId);
+
+	return mapData();
+}
@@ -6,24 +6,52 @@
 namespace TextureSynthesis
 {
 
+#define PBO_RING_SIZE 2
+
 class CGLTexture;
+
+// Asynchronous read back of the bound read frame buffer. Each read goes to the next buffer of a ring
+// and is fenced, so the data can be mapped a frame later without stalling the pipeline.
 class CPixelBufferObject
 {
 public:
-	CPixelBufferObject(TexelFormat vTexelFmt, TexelType vTexelType, int vWidth, int vHeight);
+	// Color formats are read from the given color attachment of the bound read frame buffer
+	CPixelBufferObject(TexelFormat vTexelFmt, TexelType vTexelType, int vWidth, int vHeight, int colorAttachIdx = 0);
 	virtual ~CPixelBufferObject();
 
-	uint* getDataPointer(GLuint texId);
+	// Queue a read with the texel format and type of this buffer, the previously mapped buffer is released
+	void startRead(GLuint texId);
 
-private:
-	void copyData(void* pPboData);
+	// Queue a read of several window rectangles (x, y, width, height), packed one after another in the buffer
+	void startReadTiles(GLuint texId, const vector<ivec4> &rectVec);
+
+	// Whether the last queued read has finished on the GPU, never blocks
+	bool isReadReady();
+
+	// Map the last queued read, waiting on its fence if needed. The pointer stays valid until the next
+	// startRead or unmapData, and may be read from any thread meanwhile.
+	const void* mapData();
+	void unmapData();
+
+	// Synchronous read, kept for callers that need the data right away
+	const void* getDataPointer(GLuint texId);
+
+	int getByteNum(){ return m_byteNum; }
+	int getTexelByteNum(){ return m_texelByteNum; }
 
 private:
 	TexelFormat m_texelFmt;
 	TexelType m_texelType;
 	int m_width, m_height;
-	GLuint m_pboId;
-	uint* m_pData;
+	int m_colorAttachIdx;
+	int m_texelByteNum;
+	int m_byteNum;
+
+	GLuint m_pboIds[PBO_RING_SIZE];
+	GLsync m_fences[PBO_RING_SIZE];
+	int m_readIdx;		// Last buffer a read was queued to, -1 before the first read
+	int m_mappedIdx;	// Buffer currently mapped, -1 if none
+	const void* m_pMappedData;
 };
 
-}
\ No newline at end of file
+}
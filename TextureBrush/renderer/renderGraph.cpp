@@ -0,0 +1,262 @@
+#include "renderGraph.h"
+
+#include <algorithm>
+
+#include "renderPass.h"
+#include "shaderProgram.h"
+#include "frameBufferObject.h"
+#include "frameProfiler.h"
+#include "glStateCache.h"
+
+using namespace TextureSynthesis;
+
+CRenderGraph::CRenderGraph() : m_bindMode(RGBM_CACHED), m_callNum(0), m_lastCallNum(0)
+{
+	m_backBufferIdx = importResource("back_buffer", NULL);
+
+	for (int modeIdx = 0; modeIdx < RGBM_TOTALNUM; ++modeIdx)
+	{
+		m_totalCallNum[modeIdx] = 0;
+		m_frameNum[modeIdx] = 0;
+	}
+}
+
+CRenderGraph::~CRenderGraph()
+{
+	for (int passIdx = 0; passIdx < m_passVec.size(); ++passIdx)
+	{
+		SAFE_DELETE(m_passVec[passIdx]);
+	}
+}
+
+CRenderPass* CRenderGraph::addPass(CRenderPass *pPass)
+{
+	m_passVec.push_back(pPass);
+	return pPass;
+}
+
+int CRenderGraph::importResource(const string &name, CFrameBufferObject *pFrameBuffer)
+{
+	RenderGraphResource resource;
+	resource.name = name;
+	resource.pFrameBuffer = pFrameBuffer;
+
+	m_resourceVec.push_back(resource);
+	return m_resourceVec.size() - 1;
+}
+
+// Walk back from the back buffer and the requested resources, a wanted pass survives if it has side
+// effects or writes something a surviving later pass reads
+void CRenderGraph::cullPasses(const vector<bool> &wantedVec, vector<bool> &aliveVec)
+{
+	vector<bool> neededVec(m_resourceVec.size(), false);
+	neededVec[m_backBufferIdx] = true;
+	for (int reqIdx = 0; reqIdx < m_requestedResVec.size(); ++reqIdx)
+	{
+		neededVec[m_requestedResVec[reqIdx]] = true;
+	}
+
+	aliveVec.assign(m_passVec.size(), false);
+	for (int passIdx = m_passVec.size() - 1; passIdx >= 0; --passIdx)
+	{
+		CRenderPass *pPass = m_passVec[passIdx];
+		if (!wantedVec[passIdx])
+		{
+			continue;
+		}
+
+		bool alive = pPass->m_sideEffect;
+		for (int resIdx = 0; resIdx < pPass->m_writeResVec.size() && !alive; ++resIdx)
+		{
+			alive = neededVec[pPass->m_writeResVec[resIdx]];
+		}
+
+		if (alive)
+		{
+			aliveVec[passIdx] = true;
+			for (int resIdx = 0; resIdx < pPass->m_readResVec.size(); ++resIdx)
+			{
+				neededVec[pPass->m_readResVec[resIdx]] = true;
+			}
+		}
+	}
+}
+
+// State changes go through the state cache, which also covers what execute callbacks bind.
+// Binding everything forgets the cached state first, so every call is issued.
+void CRenderGraph::bindFrameBuffer(GLuint frameBuffer)
+{
+	if (m_bindMode == RGBM_BIND_ALL)
+	{
+		CGLStateCache::Instance()->invalidate();
+	}
+
+	countCall(CGLStateCache::Instance()->bindFrameBuffer(GL_FRAMEBUFFER, frameBuffer));
+}
+
+void CRenderGraph::useProgram(GLuint program)
+{
+	if (m_bindMode == RGBM_BIND_ALL)
+	{
+		CGLStateCache::Instance()->invalidate();
+	}
+
+	countCall(CGLStateCache::Instance()->useProgram(program));
+}
+
+void CRenderGraph::bindVertexArray(GLuint vao)
+{
+	if (m_bindMode == RGBM_BIND_ALL)
+	{
+		CGLStateCache::Instance()->invalidate();
+	}
+
+	countCall(CGLStateCache::Instance()->bindVertexArray(vao));
+}
+
+void CRenderGraph::setPolygonMode(GLenum polygonMode)
+{
+	if (m_bindMode == RGBM_BIND_ALL)
+	{
+		CGLStateCache::Instance()->invalidate();
+	}
+
+	countCall(CGLStateCache::Instance()->setPolygonMode(polygonMode));
+}
+
+void CRenderGraph::countCall(bool issued)
+{
+	if (issued)
+	{
+		++m_callNum;
+	}
+}
+
+static bool compareDrawState(const RenderDraw *pA, const RenderDraw *pB)
+{
+	GLuint programA = pA->pProgram->getProgramHandle(), programB = pB->pProgram->getProgramHandle();
+	if (programA != programB)
+	{
+		return programA < programB;
+	}
+
+	return pA->pScene->getVAO() < pB->pScene->getVAO();
+}
+
+void CRenderGraph::execute()
+{
+	const bool bindAll = m_bindMode == RGBM_BIND_ALL;
+	m_callNum = 0;
+
+	vector<bool> wantedVec(m_passVec.size());
+	for (int passIdx = 0; passIdx < m_passVec.size(); ++passIdx)
+	{
+		wantedVec[passIdx] = !m_passVec[passIdx]->m_condition || m_passVec[passIdx]->m_condition();
+	}
+
+	vector<bool> aliveVec;
+	cullPasses(wantedVec, aliveVec);
+
+	for (int passIdx = 0; passIdx < m_passVec.size(); ++passIdx)
+	{
+		if (!aliveVec[passIdx])
+		{
+			continue;
+		}
+
+		CRenderPass *pPass = m_passVec[passIdx];
+		if (pPass->m_profileStage != PFS_TOTALNUM)
+		{
+			CFrameProfiler::Instance()->beginPass(pPass->m_profileStage);
+		}
+
+		if (!pPass->m_writeResVec.empty())
+		{
+			CFrameBufferObject *pTarget = m_resourceVec[pPass->m_writeResVec[0]].pFrameBuffer;
+			GLuint frameBuffer = pTarget != NULL ? pTarget->getFrameBuffer() : CFrameBufferObject::getDefaultFrameBuffer();
+			bindFrameBuffer(frameBuffer);
+
+			if (pPass->m_clearTarget)
+			{
+				glClearColor(pPass->m_clearColor.x, pPass->m_clearColor.y, pPass->m_clearColor.z, pPass->m_clearColor.w);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				m_callNum += 2;
+			}
+		}
+
+		vector<const RenderDraw*> drawVec(pPass->m_drawVec.size());
+		for (int drawIdx = 0; drawIdx < drawVec.size(); ++drawIdx)
+		{
+			drawVec[drawIdx] = &pPass->m_drawVec[drawIdx];
+		}
+		if (!bindAll)
+		{
+			std::stable_sort(drawVec.begin(), drawVec.end(), compareDrawState);
+		}
+
+		for (int drawIdx = 0; drawIdx < drawVec.size(); ++drawIdx)
+		{
+			const RenderDraw &draw = *drawVec[drawIdx];
+
+			useProgram(draw.pProgram->getProgramHandle());
+			bindVertexArray(draw.pScene->getVAO());
+			setPolygonMode(draw.polygonMode);
+
+			if (draw.setUniforms)
+			{
+				draw.setUniforms(draw.pProgram);
+			}
+
+			draw.pScene->drawBound(draw.mode);
+			++m_callNum;
+
+			if (bindAll)
+			{
+				bindVertexArray(0);
+				useProgram(0);
+			}
+		}
+
+		if (pPass->m_execute)
+		{
+			pPass->m_execute();
+		}
+
+		if (bindAll && !pPass->m_writeResVec.empty() && m_resourceVec[pPass->m_writeResVec[0]].pFrameBuffer != NULL)
+		{
+			bindFrameBuffer(CFrameBufferObject::getDefaultFrameBuffer());
+		}
+
+		if (pPass->m_profileStage != PFS_TOTALNUM)
+		{
+			CFrameProfiler::Instance()->endPass(pPass->m_profileStage);
+		}
+	}
+
+	// Leave the defaults for code running after the graph
+	bindVertexArray(0);
+	useProgram(0);
+	setPolygonMode(GL_FILL);
+	bindFrameBuffer(CFrameBufferObject::getDefaultFrameBuffer());
+
+	m_requestedResVec.clear();
+
+	m_lastCallNum = m_callNum;
+	m_totalCallNum[m_bindMode] += m_callNum;
+	++m_frameNum[m_bindMode];
+}
+
+void CRenderGraph::printCallStats()
+{
+	if (m_frameNum[RGBM_CACHED] > 0)
+	{
+		cout << "Info: Render graph issued " << double(m_totalCallNum[RGBM_CACHED]) / m_frameNum[RGBM_CACHED]
+			<< " GL state and draw calls per frame over " << m_frameNum[RGBM_CACHED] << " frames" << endl;
+	}
+
+	if (m_frameNum[RGBM_BIND_ALL] > 0)
+	{
+		cout << "Info: Render graph issued " << double(m_totalCallNum[RGBM_BIND_ALL]) / m_frameNum[RGBM_BIND_ALL]
+			<< " GL state and draw calls per frame over " << m_frameNum[RGBM_BIND_ALL] << " frames binding everything" << endl;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+class CRenderPass;
+class CFrameBufferObject;
+
+// A frame buffer written or read by passes, owned elsewhere (the window, the pick target)
+struct RenderGraphResource
+{
+	string name;
+	CFrameBufferObject* pFrameBuffer;
+};
+
+// How the graph issues state. Binding everything runs the draws unsorted, binds all state per draw
+// and per pass and unbinds it afterwards like a pass by pass renderer, to measure what the cache saves.
+enum RenderGraphBindMode
+{
+	RGBM_CACHED = 0,
+	RGBM_BIND_ALL,
+	RGBM_TOTALNUM
+};
+
+// Passes run in the order they were added, which must respect their dependencies. Every frame the
+// passes not wanted or whose outputs nobody needs are culled, then the rest run with the program,
+// vertex array, frame buffer and polygon mode only changed when they differ from the previous draw.
+class CRenderGraph
+{
+public:
+	CRenderGraph();
+	virtual ~CRenderGraph();
+
+	// The passes are owned by the graph
+	CRenderPass* addPass(CRenderPass *pPass);
+
+	int importResource(const string &name, CFrameBufferObject *pFrameBuffer);
+
+	// The window or offscreen frame buffer, always needed
+	int getBackBuffer(){ return m_backBufferIdx; }
+
+	// Resources to keep this frame even if no surviving pass reads them, e.g. for a screenshot
+	void requestResource(int resIdx){ m_requestedResVec.push_back(resIdx); }
+
+	void execute();
+
+	CFrameBufferObject* getFrameBuffer(int resIdx){ return m_resourceVec[resIdx].pFrameBuffer; }
+
+	void setBindMode(RenderGraphBindMode bindMode){ m_bindMode = bindMode; }
+	RenderGraphBindMode getBindMode(){ return m_bindMode; }
+
+	// GL state and draw calls the graph issued in the last frame
+	int getLastCallNum(){ return m_lastCallNum; }
+	void printCallStats();
+
+protected:
+	void cullPasses(const vector<bool> &wantedVec, vector<bool> &aliveVec);
+
+	void bindFrameBuffer(GLuint frameBuffer);
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void setPolygonMode(GLenum polygonMode);
+	void countCall(bool issued);
+
+private:
+	vector<CRenderPass*> m_passVec;
+	vector<RenderGraphResource> m_resourceVec;
+	vector<int> m_requestedResVec;
+	int m_backBufferIdx;
+
+	RenderGraphBindMode m_bindMode;
+
+	int m_callNum, m_lastCallNum;
+	long long m_totalCallNum[RGBM_TOTALNUM];
+	int m_frameNum[RGBM_TOTALNUM];
+};
+
+}
@@ -0,0 +1,25 @@
+#include "renderPass.h"
+
+using namespace TextureSynthesis;
+
+CRenderPass::CRenderPass(const string &name, ProfileStage profileStage) : m_name(name), m_profileStage(profileStage),
+	m_sideEffect(false), m_clearTarget(false), m_clearColor(0.0f)
+{
+}
+
+CRenderPass::~CRenderPass()
+{
+}
+
+void CRenderPass::addDraw(CShaderProgram *pProgram, CVertexBufferObject *pScene, VBORenderMode mode, GLenum polygonMode,
+	const std::function<void(CShaderProgram*)> &setUniforms)
+{
+	RenderDraw draw;
+	draw.pProgram = pProgram;
+	draw.pScene = pScene;
+	draw.mode = mode;
+	draw.polygonMode = polygonMode;
+	draw.setUniforms = setUniforms;
+
+	m_drawVec.push_back(draw);
+}
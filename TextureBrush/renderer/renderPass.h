@@ -1,20 +1,71 @@
 #pragma once
 
+#include "../preHeader.h"
+#include "vertexBufferObject.h"
+#include "frameProfiler.h"
+
+#include <functional>
+
 namespace TextureSynthesis
 {
 
 class CVertexBufferObject;
 class CShaderProgram;
 
+// One draw of a pass, uniforms beyond the frame block are set by setUniforms with the program bound
+struct RenderDraw
+{
+	CShaderProgram* pProgram;
+	CVertexBufferObject* pScene;
+	VBORenderMode mode;
+	GLenum polygonMode;
+	std::function<void(CShaderProgram*)> setUniforms;
+};
+
+// A node of the render graph. Resources are ids handed out by CRenderGraph, a pass draws into the
+// frame buffer of its first written resource. Draws are sorted by program and vertex array before
+// they run, execute callbacks do the work that isn't a draw (software picking, read backs, overlays)
+// after them.
 class CRenderPass
 {
 public:
-	CRenderPass();
+	explicit CRenderPass(const string &name, ProfileStage profileStage = PFS_TOTALNUM);
 	virtual ~CRenderPass();
 
+	void readResource(int resIdx){ m_readResVec.push_back(resIdx); }
+	void writeResource(int resIdx){ m_writeResVec.push_back(resIdx); }
+
+	void addDraw(CShaderProgram *pProgram, CVertexBufferObject *pScene, VBORenderMode mode, GLenum polygonMode = GL_FILL,
+		const std::function<void(CShaderProgram*)> &setUniforms = std::function<void(CShaderProgram*)>());
+	void setExecute(const std::function<void()> &execute){ m_execute = execute; }
+
+	// Evaluated once per frame, a pass not wanted this frame is culled
+	void setCondition(const std::function<bool()> &condition){ m_condition = condition; }
+
+	// Passes with effects beyond their outputs, e.g. feeding the stroke worker, run whenever wanted
+	void setSideEffect(bool sideEffect){ m_sideEffect = sideEffect; }
+
+	// Clear the target to the color before drawing
+	void setClear(const vec4 &clearColor){ m_clearTarget = true; m_clearColor = clearColor; }
+
+	const string& getName(){ return m_name; }
+
 private:
-	CVertexBufferObject* m_pScene;
-	CShaderProgram* m_pShaderProgram;
+	friend class CRenderGraph;
+
+	string m_name;
+	ProfileStage m_profileStage;
+
+	vector<int> m_readResVec;
+	vector<int> m_writeResVec;
+	vector<RenderDraw> m_drawVec;
+
+	std::function<bool()> m_condition;
+	std::function<void()> m_execute;
+	bool m_sideEffect;
+
+	bool m_clearTarget;
+	vec4 m_clearColor;
 };
 
-}
\ No newline at end of file
+}
@@ -2,7 +2,13 @@
 
 #include "renderUtilities.h"
 #include "renderSystemConfig.h"
+#include "frameProfiler.h"
+#include "traceRecorder.h"
 #include "viewer.h"
+#include "camera.h"
+#include "renderPass.h"
+#include "renderGraph.h"
+#include "glStateCache.h"
 
 #include "../renderer/triangleMesh.h"
 #include "../renderer/sphereGeometry.h"
@@ -12,11 +18,16 @@
 #include "../renderer/screenPassVBO.h"
 #include "../renderer/shaderProgram.h"
 #include "../renderer/shaderManager.h"
+#include "../renderer/frameUniformBuffer.h"
 #include "../renderer/glTexture.h"
 
 #include "../renderer/paintPathes.h"
 #include "../renderer/geodesicMesh.h"
 #include "../renderer/brushGlobalRes.h"
+#include "../renderer/strokeLog.h"
+
+#include <thread>
+#include <chrono>
 
 using namespace TextureSynthesis;
 
@@ -32,18 +43,35 @@ CRenderSystem* CRenderSystem::Instance()
 	return s_pRenderSystem;
 }
 
-CRenderSystem::CRenderSystem() :m_pMainWindow(NULL)
+CRenderSystem::CRenderSystem() :m_pMainWindow(NULL), m_closeRequested(false), m_isHeadless(false), m_headlessFrameNum(0), m_pOffscreenBuffer(NULL),
+	m_pRenderGraph(NULL), m_pickPassMode(PPM_NONE), m_showMarks(false), m_showWireframe(true),
+	m_onDemand(false), m_maxFrameRate(0.0f), m_dirtyFlags(RDF_WINDOW), m_inputTime(-1.0), m_idleTime(0.0), m_idleCpuTime(0.0)
+#ifdef TEXTUREBRUSH_OSMESA
+	, m_osMesaContext(NULL)
+#endif
 {
 	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_UP, this);
 	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_DOWN, this);
 	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_LEFT, this);
 	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_RIGHT, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_H, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_T, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_M, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_W, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_B, this);
 }
 
 CRenderSystem::~CRenderSystem()
 {
 }
 
+void CRenderSystem::setHeadless(int frameNum, const string &frameDir)
+{
+	m_isHeadless = true;
+	m_headlessFrameNum = frameNum;
+	m_frameDir = frameDir;
+}
+
 void CRenderSystem::initRenderSystem()
 {
 	// Must be initialized by this order!!
@@ -56,6 +84,9 @@ void CRenderSystem::initRenderSystem()
 
 	setEventCallbackFuncs();
 
+	// Everything after this draws into the offscreen buffer when headless
+	createOffscreenBuffer();
+
 	CBrushGlobalRes::initGlobalResource();
 }
 
@@ -70,12 +101,29 @@ void CRenderSystem::initGlew()
 		exit(-1);
 	}
 
+	// The pick read back fences its PBO copies and maps the finished one
+	bool hasSync = glewIsSupported("GL_VERSION_3_2") || glewIsSupported("GL_ARB_sync");
+	bool hasMapRange = glewIsSupported("GL_VERSION_3_0") || glewIsSupported("GL_ARB_map_buffer_range");
+	if (!hasSync || !hasMapRange) {
+		cout << "ERROR: Support for " << (hasSync ? "" : "GL_ARB_sync ") << (hasMapRange ? "" : "GL_ARB_map_buffer_range ")
+			<< "missing, needed by the pick read back." << endl;
+
+		exit(-1);
+	}
+
 	char *GL_version = (char *)glGetString(GL_VERSION);
 	cout << "Info: supported OpenGL version:" << GL_version << std::endl;
 }
 
 void CRenderSystem::initGlfw()
 {
+#ifdef TEXTUREBRUSH_OSMESA
+	// No display to connect to
+	if (m_isHeadless) {
+		return;
+	}
+#endif
+
 	if (!glfwInit()) {
 		exit(EXIT_FAILURE);
 	}
@@ -102,10 +150,17 @@ void CRenderSystem::initDevIL()
 
 void CRenderSystem::setEventCallbackFuncs()
 {
+	if (m_pMainWindow == NULL)
+	{
+		return;
+	}
+
 	glfwSetKeyCallback(m_pMainWindow, CEventManager::keyCallback);
 	glfwSetMouseButtonCallback(m_pMainWindow, CEventManager::mouseButtonCallback);
 	glfwSetCursorPosCallback(m_pMainWindow, CEventManager::mousePosCallback);
 	glfwSetScrollCallback(m_pMainWindow, CEventManager::mouseWheelCallback);
+	glfwSetWindowRefreshCallback(m_pMainWindow, CEventManager::windowRefreshCallback);
+	glfwSetWindowSizeCallback(m_pMainWindow, CEventManager::windowSizeCallback);
 }
 
 void CRenderSystem::createRenderWindow()
@@ -115,6 +170,27 @@ void CRenderSystem::createRenderWindow()
 	CRenderSystemConfig::getSysCfgInstance()->getWindowName(m_winTitle);
 	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
 
+	if (m_isHeadless)
+	{
+#ifdef TEXTUREBRUSH_OSMESA
+		// Compatibility profile, the camera matrices are still written to the fixed function matrix stack for the fixed function helpers
+		m_osMesaContext = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+		m_osMesaBuffer.resize(winWidth * winHeight * 4);
+
+		if (m_osMesaContext == NULL || !OSMesaMakeCurrent(m_osMesaContext, &m_osMesaBuffer[0], GL_UNSIGNED_BYTE, winWidth, winHeight))
+		{
+			cout << "ERROR: Can't create OSMesa context!" << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		cout << "Info: Headless OSMesa context of " << winWidth << "x" << winHeight << endl;
+		return;
+#else
+		// Hidden window, only its context is used
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+#endif
+	}
+
 	m_pMainWindow = glfwCreateWindow(winWidth, winHeight, m_winTitle.c_str(), NULL, NULL);
 
 	if (!m_pMainWindow)
@@ -126,85 +202,370 @@ void CRenderSystem::createRenderWindow()
 	glfwMakeContextCurrent(m_pMainWindow);
 }
 
+// The default frame buffer of a hidden window has no pixel ownership, so headless frames go to an FBO
+void CRenderSystem::createOffscreenBuffer()
+{
+	if (!m_isHeadless)
+	{
+		return;
+	}
+
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+
+	m_pOffscreenBuffer = new CFrameBufferObject(winWidth, winHeight, 1);
+	CFrameBufferObject::setDefaultFrameBuffer(m_pOffscreenBuffer->getFrameBuffer());
+	m_pOffscreenBuffer->deactivate();
+
+	cout << "Info: Headless rendering at " << winWidth << "x" << winHeight;
+	if (m_headlessFrameNum > 0)
+	{
+		cout << " for " << m_headlessFrameNum << " frames";
+	}
+	if (!m_frameDir.empty())
+	{
+		cout << ", frames saved to " << m_frameDir;
+	}
+	cout << endl;
+}
+
+void CRenderSystem::getFrameSize(int &width, int &height)
+{
+	if (m_pMainWindow == NULL || m_isHeadless)
+	{
+		CRenderSystemConfig::getSysCfgInstance()->getWinSize(width, height);
+	}
+	else
+	{
+		glfwGetWindowSize(m_pMainWindow, &width, &height);
+	}
+}
+
+bool CRenderSystem::shouldClose(int frame)
+{
+	if (m_closeRequested)
+	{
+		return true;
+	}
+
+	if (m_isHeadless)
+	{
+		return m_headlessFrameNum > 0 && frame >= m_headlessFrameNum;
+	}
+
+	return glfwGetKey(m_pMainWindow, GLFW_KEY_ESCAPE) || glfwWindowShouldClose(m_pMainWindow);
+}
+
+void CRenderSystem::requestRedraw(int flags)
+{
+	// Input is only dispatched on the render thread, the first input not drawn yet is timed without a lock
+	if ((flags & RDF_INPUT) && m_inputTime < 0.0)
+	{
+		m_inputTime = CRenderUtilities::getTime();
+	}
+
+	// A loop waiting for events sleeps until one is posted
+	if (m_dirtyFlags.fetch_or(flags) == 0 && m_onDemand && !m_isHeadless && m_pMainWindow != NULL)
+	{
+		glfwPostEmptyEvent();
+	}
+}
+
+// Returns false if the window was closed while waiting
+bool CRenderSystem::waitForRedraw(int frame)
+{
+	// Replays feed their input frame by frame, headless runs have no events to wait for
+	if (!m_onDemand || m_isHeadless || CStrokeLog::Instance()->isReplaying())
+	{
+		return true;
+	}
+
+	if (m_dirtyFlags == 0)
+	{
+		TRACE_SCOPE("waitEvents");
+
+		double startTime = CRenderUtilities::getTime();
+		double startCpuTime = CRenderUtilities::getProcessCpuTime();
+		bool workerIdle = CPaintPathes::Instance()->isIdle();
+
+		while (m_dirtyFlags == 0 && !shouldClose(frame))
+		{
+			glfwWaitEvents();
+		}
+
+		// Only spans the stroke worker spent blocked too, its stroke work isn't idle overhead
+		if (workerIdle && CPaintPathes::Instance()->isIdle())
+		{
+			m_idleTime += CRenderUtilities::getTime() - startTime;
+			m_idleCpuTime += CRenderUtilities::getProcessCpuTime() - startCpuTime;
+		}
+	}
+
+	return !shouldClose(frame);
+}
+
+void CRenderSystem::reportRenderMode(int frame, double totalTime, double totalCpuTime)
+{
+	cout << "Info: " << (m_onDemand ? "On demand" : "Continuous") << " rendering drew " << frame << " frames in " << totalTime
+		<< " s, CPU usage " << 100.0 * totalCpuTime / std::max(totalTime, 1e-6) << "% of a core";
+	if (m_idleTime > 0.0)
+	{
+		cout << ", " << 100.0 * m_idleCpuTime / m_idleTime << "% over " << m_idleTime << " s idle";
+	}
+	cout << endl;
+
+	ProfileStats latencyStats;
+	CFrameProfiler::Instance()->getStats(PFS_INPUT_LATENCY, false, latencyStats);
+	if (latencyStats.sampleNum > 0)
+	{
+		cout << "Info: Input to photon latency mean " << latencyStats.mean << " ms, p50 " << latencyStats.p50 << " p95 "
+			<< latencyStats.p95 << " p99 " << latencyStats.p99 << " over the last " << latencyStats.sampleNum << " inputs" << endl;
+	}
+}
+
+void CRenderSystem::writeFrame(int frame)
+{
+	int winWidth, winHeight;
+	getFrameSize(winWidth, winHeight);
+
+	vector<unsigned char> pixels(winWidth * winHeight * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, winWidth, winHeight, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	char fileName[32];
+	sprintf(fileName, "/frame_%05d.png", frame);
+	string framePath = m_frameDir + fileName;
+
+	ILuint imgHandle;
+	ilGenImages(1, &imgHandle);
+	ilBindImage(imgHandle);
+	ilTexImage(winWidth, winHeight, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE, &pixels[0]);
+	ilEnable(IL_FILE_OVERWRITE);
+
+	if (!ilSaveImage(framePath.c_str()))
+	{
+		cout << "ERROR: Can't save frame " << framePath << "!" << endl;
+	}
+
+	ilDeleteImages(1, &imgHandle);
+}
+
 void CRenderSystem::cleanSystem()
 {
+	CStrokeLog::Instance()->stopRecording();
+	CPaintPathes::Instance()->stopWorker();
+
+	SAFE_DELETE(m_pRenderGraph);
+
+	SAFE_DELETE(m_pOffscreenBuffer);
+	CFrameBufferObject::setDefaultFrameBuffer(0);
+
 // 	CViewer *pViewer = CViewer::getViewerInstance();
 // 	SAFE_DELETE(pViewer);
 // 
 // 	CEventManager *pEventManager = CEventManager::getEventManagerInstance();
 // 	SAFE_DELETE(pEventManager);
+
+	// The graph and the offscreen buffer delete GL objects, the context goes last
+#ifdef TEXTUREBRUSH_OSMESA
+	if (m_osMesaContext != NULL)
+	{
+		OSMesaDestroyContext(m_osMesaContext);
+		m_osMesaContext = NULL;
+		return;
+	}
+#endif
+
+	glfwTerminate();
+}
+
+void CRenderSystem::buildRenderGraph()
+{
+	m_pRenderGraph = new CRenderGraph();
+
+	int backBuffer = m_pRenderGraph->getBackBuffer();
+	int pickTarget = m_pRenderGraph->importResource("pick_index", CBrushGlobalRes::s_pFrameBuffer);
+
+	CRenderPass *pPass = m_pRenderGraph->addPass(new CRenderPass("overlays"));
+	pPass->writeResource(backBuffer);
+	pPass->setExecute([](){
+		CRenderUtilities::drawAxis();
+		CRenderUtilities::drawWireCube(vec3(-1.0), vec3(1.0));
+	});
+
+	// The software pick only feeds the stroke worker
+	pPass = m_pRenderGraph->addPass(new CRenderPass("pick_software", PFS_PICK_PASS));
+	pPass->setSideEffect(true);
+	pPass->setCondition([this](){ return m_pickPassMode == PPM_SOFTWARE; });
+	pPass->setExecute([](){
+		mat4 modelviewMat, projMat;
+		ivec4 viewport;
+		CPaintPathes::queryViewState(modelviewMat, projMat, viewport);
+		CPaintPathes::Instance()->extractTriangleIndexSoftware(modelviewMat, projMat, viewport);
+	});
+
+	// Render triangle index into frame buffer and extract triangle index with screen space coordinate
+	pPass = m_pRenderGraph->addPass(new CRenderPass("pick", PFS_PICK_PASS));
+	pPass->writeResource(pickTarget);
+	pPass->setCondition([this](){ return m_pickPassMode == PPM_GL; });
+	pPass->setClear(vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	pPass->addDraw(CBrushGlobalRes::s_pTrackProgram, CBrushGlobalRes::s_pFlatMeshVBO, VBORM_TRIANGLES);
+	pPass->setExecute([](){
+		CPaintPathes::Instance()->extractTriangleIndexTexture(CBrushGlobalRes::s_pFrameBuffer->getColorBuffer(0));
+	});
+
+	// Read back the pick tiles requested by the stroke worker, they land a frame later
+	pPass = m_pRenderGraph->addPass(new CRenderPass("pick_readback", PFS_PICK_READBACK));
+	pPass->readResource(pickTarget);
+	pPass->setSideEffect(true);
+	pPass->setExecute([](){ CPaintPathes::Instance()->consumePickResults(); });
+
+	// Upload the stroke finalized by the stroke worker, if any
+	pPass = m_pRenderGraph->addPass(new CRenderPass("publish", PFS_PUBLISH));
+	pPass->setSideEffect(true);
+	pPass->setExecute([](){ CPaintPathes::Instance()->publishResults(); });
+
+	// Render marked triangles on the curve
+	pPass = m_pRenderGraph->addPass(new CRenderPass("mark_display"));
+	pPass->writeResource(backBuffer);
+	pPass->setCondition([this](){ return m_showMarks; });
+	pPass->addDraw(CBrushGlobalRes::s_pShowMarkProgram, CBrushGlobalRes::s_pFlatMeshVBO, VBORM_TRIANGLES);
+
+	// Render final result, the wireframe is overlaid in the same draw
+	pPass = m_pRenderGraph->addPass(new CRenderPass("fill", PFS_FILL_PASS));
+	pPass->writeResource(backBuffer);
+	pPass->addDraw(CBrushGlobalRes::s_pFinalRenderProgram, CBrushGlobalRes::s_pSmoothMeshVBO, VBORM_TRIANGLES, GL_FILL,
+		[this](CShaderProgram *pProgram){
+		int showWireframe = m_showWireframe ? 1 : 0;
+		pProgram->updateTexture2D("u_sourceTex", CBrushGlobalRes::s_pGLTexture->getGLTexHandle(), 0);
+		pProgram->updateUniformiv("u_showWireframe", &showWireframe, 1, 1);
+	});
+
+	pPass = m_pRenderGraph->addPass(new CRenderPass("hud"));
+	pPass->writeResource(backBuffer);
+	pPass->setExecute([this](){ CFrameProfiler::Instance()->drawHUD(m_isHeadless ? NULL : m_pMainWindow, m_winTitle); });
 }
 
 void CRenderSystem::render()
 {
 	int frame = 0;
+	double startTime = CRenderUtilities::getTime();
+	double startCpuTime = CRenderUtilities::getProcessCpuTime();
+
+	int onDemand;
+	CRenderSystemConfig::getSysCfgInstance()->getRenderMode(onDemand, m_maxFrameRate);
+	m_onDemand = onDemand != 0;
 
 	float totalTriangleNum = 1.0f * CBrushGlobalRes::s_totalTriangleNum;
 
-	while (!glfwGetKey(m_pMainWindow, GLFW_KEY_ESCAPE) && !glfwWindowShouldClose(m_pMainWindow))
-	{
-		CViewer::getViewerInstance()->aim();
+	CFrameProfiler *pProfiler = CFrameProfiler::Instance();
+	uint uploadedCameraVersion = 0;
 
-		CRenderUtilities::drawAxis();
-		CRenderUtilities::drawWireCube(vec3(-1.0), vec3(1.0));
+	TRACE_THREAD_NAME("render");
 
-		// Render triangle index
-		if (CBrushGlobalRes::s_newSketch)
-		{
-			CBrushGlobalRes::s_newSketch = false;
+	buildRenderGraph();
 
-			// Render triangle index into frame buffer and extract triangle index with screen space coordinate
-			CBrushGlobalRes::s_pFrameBuffer->activate();
+	while (!shouldClose(frame) && waitForRedraw(frame))
+	{
+		TRACE_SCOPE("frame");
 
-			CBrushGlobalRes::s_pTrackProgram->activate();
+		double frameStartTime = CRenderUtilities::getTime();
+		double frameStartCpuTime = CRenderUtilities::getProcessCpuTime();
 
-			CBrushGlobalRes::s_pTrackProgram->updateModelViewMat("u_modelviewMatrix");
-			CBrushGlobalRes::s_pTrackProgram->updateProjMat("u_projMatrix");
-			CBrushGlobalRes::s_pFlatMeshVBO->display(VBORM_TRIANGLES);
+		pProfiler->beginFrame();
+		CGLStateCache::Instance()->beginFrame();
 
-			CBrushGlobalRes::s_pTrackProgram->deactivate();
+		// Feed recorded input before the camera is aimed, as live input would be
+		CStrokeLog::Instance()->replayFrame();
 
-			CPaintPathes::Instance()->extractTriangleIndexTexture(CBrushGlobalRes::s_pFrameBuffer->getColorBuffer(0));
+		// Everything changed so far is drawn by this frame, later changes dirty the next one
+		int dirtyFlags = m_dirtyFlags.exchange(0);
+		double inputTime = m_inputTime;
+		m_inputTime = -1.0;
 
-			CBrushGlobalRes::s_pFrameBuffer->deactivate();
+		CViewer::getViewerInstance()->aim();
+
+		// View constants of all programs, uploaded only when the camera changed
+		CCamera *pCamera = CViewer::getViewerInstance()->getCamera();
+		if (pCamera->getVersion() != uploadedCameraVersion)
+		{
+			uploadedCameraVersion = pCamera->getVersion();
+			CBrushGlobalRes::s_pFrameUniformBuffer->update(pCamera->getModelviewMat(), pCamera->getProjMat());
 		}
 
-		// Render marked triangles on the curve
-		/*CBrushGlobalRes::s_pShowMarkProgram->activate();
+		// Render triangle index, unless the last pass was drawn from the same view
+		m_pickPassMode = PPM_NONE;
+		if (CBrushGlobalRes::s_newSketch)
+		{
+			CBrushGlobalRes::s_newSketch = false;
 
-		CBrushGlobalRes::s_pShowMarkProgram->updateModelViewMat("u_modelviewMatrix");
-		CBrushGlobalRes::s_pShowMarkProgram->updateProjMat("u_projMatrix");
+			if (!CPaintPathes::Instance()->reusePickPass())
+			{
+				m_pickPassMode = CPaintPathes::Instance()->isSoftwarePicking() ? PPM_SOFTWARE : PPM_GL;
+			}
+		}
 
-		CBrushGlobalRes::s_pFlatMeshVBO->display(VBORM_TRIANGLES);
+		m_pRenderGraph->execute();
 
-		CBrushGlobalRes::s_pShowMarkProgram->deactivate();*/
+		pProfiler->beginPass(PFS_PRESENT);
+		TRACE_BEGIN("present");
+		if (m_isHeadless)
+		{
+			if (!m_frameDir.empty())
+			{
+				writeFrame(frame);
+			}
+			glFinish();
+		}
+		else
+		{
+			glfwSwapBuffers(m_pMainWindow);
+			glfwPollEvents();
+		}
+		TRACE_END("present");
+		pProfiler->endPass(PFS_PRESENT);
 
-		// Render final result
-		CBrushGlobalRes::s_pFinalRenderProgram->activate();
+		if (inputTime >= 0.0)
+		{
+			pProfiler->addCpuSample(PFS_INPUT_LATENCY, CRenderUtilities::getTime() - inputTime);
+		}
 
-		CBrushGlobalRes::s_pFinalRenderProgram->updateModelViewMat("u_modelviewMatrix");
-		CBrushGlobalRes::s_pFinalRenderProgram->updateProjMat("u_projMatrix");
-		CBrushGlobalRes::s_pFinalRenderProgram->updateTexture2D("u_sourceTex", CBrushGlobalRes::s_pGLTexture->getGLTexHandle(), 0);
+		pProfiler->endFrame();
+		++frame;
 
-			//LIQILIQI
-		int tmp;
-		tmp = 1;
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		CBrushGlobalRes::s_pFinalRenderProgram->updateUniformiv("is_line", &tmp, 1, 1);
-		CBrushGlobalRes::s_pSmoothMeshVBO->display(VBORM_TRIANGLES);
-		tmp = 0;
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		CBrushGlobalRes::s_pFinalRenderProgram->updateUniformiv("is_line", &tmp, 1, 1);
-		CBrushGlobalRes::s_pSmoothMeshVBO->display(VBORM_TRIANGLES);
+		if (m_maxFrameRate > 0.0f)
+		{
+			double sleepTime = frameStartTime + 1.0 / m_maxFrameRate - CRenderUtilities::getTime();
+			if (sleepTime > 0.0)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds((long long)(sleepTime * 1e6)));
+			}
+		}
 
-		CBrushGlobalRes::s_pFinalRenderProgram->deactivate();
+		// A continuous frame with nothing changed is the one an on demand loop would have slept through
+		if (!m_onDemand && dirtyFlags == 0 && CPaintPathes::Instance()->isIdle())
+		{
+			m_idleTime += CRenderUtilities::getTime() - frameStartTime;
+			m_idleCpuTime += CRenderUtilities::getProcessCpuTime() - frameStartCpuTime;
+		}
+	}
 
-		glfwSwapBuffers(m_pMainWindow);
-		glfwPollEvents();
-		++frame;
+	pProfiler->writeStats();
+	m_pRenderGraph->printCallStats();
+	CGLStateCache::Instance()->printStats();
+	if (pProfiler->getDroppedQueryNum() > 0)
+	{
+		cout << "Info: " << pProfiler->getDroppedQueryNum() << " GPU timings weren't ready in time and were dropped" << endl;
 	}
 
-	glfwTerminate();
+	reportRenderMode(frame, CRenderUtilities::getTime() - startTime, CRenderUtilities::getProcessCpuTime() - startCpuTime);
+
+	if (m_isHeadless)
+	{
+		double totalTime = CRenderUtilities::getTime() - startTime;
+		cout << "Info: Rendered " << frame << " frames in " << totalTime * 1000.0 << " ms, "
+			<< totalTime * 1000.0 / std::max(frame, 1) << " ms per frame" << endl;
+	}
 }
 
 bool CRenderSystem::keyPressed(const KeyEvent &arg)
@@ -219,6 +580,22 @@ bool CRenderSystem::keyPressed(const KeyEvent &arg)
 		break;
 	case GLFW_KEY_RIGHT:
 		break;
+	case GLFW_KEY_H:
+		CFrameProfiler::Instance()->toggleHUD();
+		break;
+	case GLFW_KEY_T:
+		CTraceRecorder::Instance()->dump(CTraceRecorder::Instance()->getDumpPath());
+		break;
+	case GLFW_KEY_M:
+		m_showMarks = !m_showMarks;
+		break;
+	case GLFW_KEY_W:
+		m_showWireframe = !m_showWireframe;
+		break;
+	case GLFW_KEY_B:
+		// Bind everything per draw to measure the calls the graph saves
+		m_pRenderGraph->setBindMode(m_pRenderGraph->getBindMode() == RGBM_CACHED ? RGBM_BIND_ALL : RGBM_CACHED);
+		break;
 	default:
 		break;
 	}
@@ -3,9 +3,37 @@
 #include "../preHeader.h"
 #include "../eventHandler/eventManager.h"
 
+#include <atomic>
+
+// Headless contexts come from OSMesa instead of a hidden GLFW window, so no display is needed
+#ifdef TEXTUREBRUSH_OSMESA
+#include "GL/osmesa.h"
+#endif
+
 namespace TextureSynthesis
 {
 
+class CFrameBufferObject;
+class CRenderGraph;
+
+// How the triangle index is picked this frame
+enum PickPassMode
+{
+	PPM_NONE = 0,
+	PPM_SOFTWARE,
+	PPM_GL
+};
+
+// Why a frame has to be drawn in on demand mode
+enum RedrawFlag
+{
+	RDF_INPUT = 1,		// Key, button, wheel or painting input, timed for the input to photon latency
+	RDF_CAMERA = 2,
+	RDF_STROKE = 4,		// Pick tiles requested or a stroke finalized by the stroke worker
+	RDF_UPLOAD = 8,		// Vertex attributes changed outside a frame, e.g. undo
+	RDF_WINDOW = 16
+};
+
 class CRenderSystem : public KeyListener
 {
 public:
@@ -14,6 +42,21 @@ public:
 
 	GLFWwindow* getGLFWWindow(){ return m_pMainWindow; }
 
+	// Render into an offscreen frame buffer of the configured window size, without a visible window.
+	// 0 frames runs until closed by a replayed stroke log, frames are saved as PNG if a directory is given.
+	// Must be set before initRenderSystem.
+	void setHeadless(int frameNum, const string &frameDir);
+	bool isHeadless(){ return m_isHeadless; }
+
+	// Size of the frame being rendered, the window's or the offscreen buffer's
+	void getFrameSize(int &width, int &height);
+
+	// Leave the render loop after the current frame
+	void requestClose(){ m_closeRequested = true; }
+
+	// Mark the scene dirty, wakes the render loop waiting in on demand mode. May be called from any thread.
+	void requestRedraw(int flags);
+
 protected:
 	CRenderSystem();
 
@@ -27,10 +70,16 @@ public:
 	void setEventCallbackFuncs();
 
 	void createRenderWindow();
+	void createOffscreenBuffer();
 
 	void cleanSystem();
 
+	void buildRenderGraph();
 	void render();
+	bool shouldClose(int frame);
+	bool waitForRedraw(int frame);
+	void reportRenderMode(int frame, double totalTime, double totalCpuTime);
+	void writeFrame(int frame);
 
 	// Event handler
 	bool keyPressed(const KeyEvent &arg);
@@ -39,6 +88,27 @@ public:
 private:
 	string								m_winTitle;
 	GLFWwindow*							m_pMainWindow;
+	bool								m_closeRequested;
+
+	bool								m_isHeadless;
+	int									m_headlessFrameNum;
+	string								m_frameDir;
+	CFrameBufferObject*					m_pOffscreenBuffer;
+
+	CRenderGraph*						m_pRenderGraph;
+	PickPassMode						m_pickPassMode;
+	bool								m_showMarks;
+	bool								m_showWireframe;
+
+	bool								m_onDemand;
+	float								m_maxFrameRate;
+	std::atomic<int>					m_dirtyFlags;
+	double								m_inputTime;
+	double								m_idleTime, m_idleCpuTime;
+#ifdef TEXTUREBRUSH_OSMESA
+	OSMesaContext						m_osMesaContext;
+	vector<unsigned char>				m_osMesaBuffer;
+#endif
 };
 
 } // End of namespace
\ No newline at end of file
@@ -10,6 +10,11 @@ CRenderSystemConfig::CRenderSystemConfig()
 	m_parameterTypeMap["CameraProj"] = RSPT_CAMERA_PROJ;
 	m_parameterTypeMap["CameraAdjust"] = RSPT_CAMERA_ADJUST;
 	m_parameterTypeMap["ModelName"] = RSPT_MODEL_NAME;
+	m_parameterTypeMap["StrokeFitting"] = RSPT_STROKE_FITTING;
+	m_parameterTypeMap["StrokeBand"] = RSPT_STROKE_BAND;
+	m_parameterTypeMap["UndoBudget"] = RSPT_UNDO_BUDGET;
+	m_parameterTypeMap["SoftwarePick"] = RSPT_SOFTWARE_PICK;
+	m_parameterTypeMap["RenderMode"] = RSPT_RENDER_MODE;
 
 	initConfig();
 	loadConfig();
@@ -49,6 +54,11 @@ void CRenderSystemConfig::initConfig()
 	m_lookAtX = m_lookAtY = m_lookAtZ = 0.0f;
 	m_fov = 60.0f; m_nearPlane = 0.0001f; m_farPlane = 10000.0f;
 	m_tumblingSpeed = 0.5f; m_zoomSpeed = 0.2f;	m_moveSpeed = 0.05f;
+	m_fitTolerance = 2.0f; m_sampleSpacing = 8.0f;
+	m_strokeBandWidth = 0.25f;
+	m_undoBudgetMB = 64.0f;
+	m_pickSource = 0; m_pickThreadNum = 0;
+	m_onDemand = 0; m_maxFrameRate = 0.0f;
 }
 
 void CRenderSystemConfig::parseConfig(const std::string &cfgLine)
@@ -99,6 +109,31 @@ void CRenderSystemConfig::parseConfig(const std::string &cfgLine)
 				m_modelName = string(beginItr, endItr);
 			}
 			break;
+		case RSPT_STROKE_FITTING:
+			{
+				qi::parse(beginItr, endItr, qi::double_>>' '>>qi::double_, m_fitTolerance, m_sampleSpacing);
+			}
+			break;
+		case RSPT_STROKE_BAND:
+			{
+				qi::parse(beginItr, endItr, qi::double_, m_strokeBandWidth);
+			}
+			break;
+		case RSPT_UNDO_BUDGET:
+			{
+				qi::parse(beginItr, endItr, qi::double_, m_undoBudgetMB);
+			}
+			break;
+		case RSPT_SOFTWARE_PICK:
+			{
+				qi::parse(beginItr, endItr, qi::int_>>' '>>qi::int_, m_pickSource, m_pickThreadNum);
+			}
+			break;
+		case RSPT_RENDER_MODE:
+			{
+				qi::parse(beginItr, endItr, qi::int_>>' '>>qi::double_, m_onDemand, m_maxFrameRate);
+			}
+			break;
 		default:
 			std::cout<<"WARNING: Not existing parameter!"<<std::endl;
 			break;
@@ -124,6 +159,13 @@ void CRenderSystemConfig::getWinSize(int &width, int &height)
 	height = m_winHeight;
 }
 
+// Buffers sized from the window read it once, so overrides must come before the render system is set up
+void CRenderSystemConfig::setWinSize(int width, int height)
+{
+	m_winWidth = width;
+	m_winHeight = height;
+}
+
 void CRenderSystemConfig::getCameraMView(float &lookatX, float &lookatY, float &lookatZ, float &head, float &pitch, float &radius)
 {
 	lookatX = m_lookAtX;
@@ -151,4 +193,39 @@ void CRenderSystemConfig::getCameraAdjust(float &tumblingSpeed, float &zoomSpeed
 void CRenderSystemConfig::getModelName(string& modelName)
 {
 	modelName = m_modelName;
+}
+
+void CRenderSystemConfig::getStrokeFitting(float &fitTolerance, float &sampleSpacing)
+{
+	fitTolerance = m_fitTolerance;
+	sampleSpacing = m_sampleSpacing;
+}
+
+void CRenderSystemConfig::getStrokeBand(float &bandWidth)
+{
+	bandWidth = m_strokeBandWidth;
+}
+
+void CRenderSystemConfig::getUndoBudget(float &budgetMB)
+{
+	budgetMB = m_undoBudgetMB;
+}
+
+void CRenderSystemConfig::getSoftwarePick(int &pickSource, int &threadNum)
+{
+	pickSource = m_pickSource;
+	threadNum = m_pickThreadNum;
+}
+
+// 0 renders continuously, 1 only when something changed, a frame rate cap of 0 means uncapped
+void CRenderSystemConfig::getRenderMode(int &onDemand, float &maxFrameRate)
+{
+	onDemand = m_onDemand;
+	maxFrameRate = m_maxFrameRate;
+}
+
+void CRenderSystemConfig::setRenderMode(int onDemand, float maxFrameRate)
+{
+	m_onDemand = onDemand;
+	m_maxFrameRate = maxFrameRate;
 }
\ No newline at end of file
@@ -13,6 +13,11 @@ enum RenderSystemParameterType
 	RSPT_CAMERA_PROJ,
 	RSPT_CAMERA_ADJUST,
 	RSPT_MODEL_NAME,
+	RSPT_STROKE_FITTING,
+	RSPT_STROKE_BAND,
+	RSPT_UNDO_BUDGET,
+	RSPT_SOFTWARE_PICK,
+	RSPT_RENDER_MODE,
 	RSPT_TOTAL_NUMBER
 };
 
@@ -24,11 +29,18 @@ public:
 
 	void getWindowName(string& winName);
 	void getWinSize(int &width, int &height);
+	void setWinSize(int width, int height);
 	void getCameraMView(float &lookatX, float &lookatY, float &lookatZ, float &head, float &pitch, float &radius);
 	void getCameraProj(float &fov, float &nearPlane, float &farPlane);
 	void getCameraAdjust(float &tumblingSpeed, float &zoomSpeed, float &moveSpeed);
 
 	void getModelName(string& modelName);
+	void getStrokeFitting(float &fitTolerance, float &sampleSpacing);
+	void getStrokeBand(float &bandWidth);
+	void getUndoBudget(float &budgetMB);
+	void getSoftwarePick(int &pickSource, int &threadNum);
+	void getRenderMode(int &onDemand, float &maxFrameRate);
+	void setRenderMode(int onDemand, float maxFrameRate);
 
 protected:
 	CRenderSystemConfig();
@@ -47,6 +59,13 @@ protected:
 
 	string m_modelName;
 
+	float m_fitTolerance, m_sampleSpacing;
+	float m_strokeBandWidth;
+	float m_undoBudgetMB;
+	int m_pickSource, m_pickThreadNum;
+	int m_onDemand;
+	float m_maxFrameRate;
+
 	map<std::string, int> m_parameterTypeMap;
 };
 
@@ -2,24 +2,65 @@
 
 #include "renderSystemConfig.h"
 #include "renderSystem.h"
+#include "viewer.h"
+#include "camera.h"
 #include "image2D.h"
 
 #include "../renderer/Geo2D.h"
 
+#ifdef TEXTUREBRUSH_OSMESA
+#include <chrono>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
 using namespace TextureSynthesis;
 
 double CRenderUtilities::getTime()
 {
+#ifdef TEXTUREBRUSH_OSMESA
+	// GLFW isn't initialized without a display
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
 	return glfwGetTime();
+#endif
+}
+
+double CRenderUtilities::getProcessCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		return 0.0;
+	}
+
+	// 100 ns units
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	return (kernel.QuadPart + user.QuadPart) * 1e-7;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
 }
 
 void CRenderUtilities::drawAxis()
 {
 	//draw axis.
-	GLfloat modelview[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
-	GLint viewport[4];
-	glGetIntegerv(GL_VIEWPORT, &viewport[0]);
+	CCamera *pCamera = CViewer::getViewerInstance()->getCamera();
+	const float *modelview = &pCamera->getModelviewMat()[0][0];
+	ivec4 viewport = pCamera->getViewport();
 	GLint width = viewport[2] / 16;
 	GLint height = viewport[3] / 16;
 	glViewport(0, 0, width, height);
@@ -61,7 +102,7 @@ void CRenderUtilities::computePixelSize(CImage2D* pImg, float scale, vec2& pixel
 	pImg->getImgSize(imgHeight, imgWidth);
 
 	int winWidth, winHeight;
-	glfwGetWindowSize(CRenderSystem::Instance()->getGLFWWindow(), &winWidth, &winHeight);
+	CRenderSystem::Instance()->getFrameSize(winWidth, winHeight);
 
 	float imgWHRatio = (float)imgWidth / imgHeight;
 	float winWHRatio = (float)winWidth / winHeight;
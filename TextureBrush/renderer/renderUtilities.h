@@ -20,6 +20,8 @@ class CRenderUtilities
 {
 public:
 	static double getTime();
+	// User and kernel time used by all threads of the process, in seconds
+	static double getProcessCpuTime();
 	static void drawAxis();
 
 	static void computePixelSize(CImage2D* pImg, float scale, vec2& pixelSize, vec2& imgCenter);
@@ -1,5 +1,6 @@
 #include "screenPassVBO.h"
 #include "screenRectangle.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
@@ -14,9 +15,7 @@ CScreenPassVBO::~CScreenPassVBO()
 
 void CScreenPassVBO::display()
 {
-	glBindVertexArray(m_VAO);
+	CGLStateCache::Instance()->bindVertexArray(m_VAO);
 
 	glDrawElementsBaseVertex(GL_TRIANGLES, m_triNum * 3, GL_UNSIGNED_INT, (void*)0, 0);
-
-	glBindVertexArray(0);
 }
\ No newline at end of file
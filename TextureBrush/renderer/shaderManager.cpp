@@ -32,6 +32,23 @@ GLuint CShaderManager::getShaderByName(ShaderType vST, const char* shaderName)
 	return m_shaders[shaderName];
 }
 
+GLenum CShaderManager::getGLShaderType(ShaderType vST)
+{
+	switch (vST)
+	{
+	case ST_VERTEX:
+		return GL_VERTEX_SHADER;
+	case ST_FRAGMENT:
+		return GL_FRAGMENT_SHADER;
+	case ST_GEOMETRY:
+		return GL_GEOMETRY_SHADER;
+	case ST_COMPUTE:
+		return GL_COMPUTE_SHADER;
+	default:
+		return GL_VERTEX_SHADER;
+	}
+}
+
 void CShaderManager::loadShader(ShaderType vST, const char* shaderFile)
 {
 	GLuint shaderHandle;
@@ -39,7 +56,7 @@ void CShaderManager::loadShader(ShaderType vST, const char* shaderFile)
 	int len;
 	char* shaderBuf = CCommonUtility::loadFile(shaderFile, len);
 
-	shaderHandle = glCreateShader(vST);
+	shaderHandle = glCreateShader(getGLShaderType(vST));
 
 	const GLchar * glFilePtr = shaderBuf;
 	glShaderSource(shaderHandle, 1, &glFilePtr, &len);
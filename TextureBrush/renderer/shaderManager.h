@@ -8,10 +8,11 @@ namespace TextureSynthesis
 class CShaderManager
 {
 public:
+	// Indices of the stages a program attaches, see getGLShaderType for the GL enums
 	enum ShaderType
 	{
-		ST_VERTEX = GL_VERTEX_SHADER,
-		ST_FRAGMENT = GL_FRAGMENT_SHADER,
+		ST_VERTEX = 0,
+		ST_FRAGMENT,
 		ST_GEOMETRY,
 		ST_COMPUTE,
 		ST_TOTALTYPENUM
@@ -23,6 +24,8 @@ public:
 
 	GLuint getShaderByName(ShaderType vST, const char* shaderName);
 
+	static GLenum getGLShaderType(ShaderType vST);
+
 private:
 	CShaderManager();
 
@@ -1,4 +1,8 @@
 #include "shaderProgram.h"
+#include "frameUniformBuffer.h"
+#include "viewer.h"
+#include "camera.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
@@ -7,6 +11,11 @@ using namespace TextureSynthesis;
 //////////////////////////////////////////////////////////////////////////
 CShaderProgram::CShaderProgram() : m_linked(false)
 {
+	for (int idx = 0; idx < CShaderManager::ST_TOTALTYPENUM; ++idx)
+	{
+		m_shaders[idx] = 0;
+	}
+
 	m_programHandle = glCreateProgram();
 	if(glIsProgram(m_programHandle) == GL_TRUE)
 	{
@@ -18,7 +27,10 @@ CShaderProgram::~CShaderProgram()
 {
 	detachShaders();
 	if(glIsProgram(m_programHandle) == GL_TRUE)
+	{
+		CGLStateCache::Instance()->forgetProgram(m_programHandle);
 		glDeleteProgram(m_programHandle);
+	}
 }
 
 void CShaderProgram::attachShader(CShaderManager::ShaderType vST, const char* shaderFile)
@@ -58,9 +70,64 @@ void CShaderProgram::linkProgram()
 	else
 	{
 		m_linked = true;
+		cacheUniformLocations();
+
+		// View constants come from the shared per frame uniform buffer
+		GLuint blockIdx = glGetUniformBlockIndex(m_programHandle, CFrameUniformBuffer::getBlockName());
+		if (blockIdx != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(m_programHandle, blockIdx, FRAME_UNIFORM_BINDING);
+		}
+	}
+}
+
+void CShaderProgram::cacheUniformLocations()
+{
+	m_uniformLocationMap.clear();
+
+	GLint uniformNum = 0, maxNameLen = 0;
+	glGetProgramiv(m_programHandle, GL_ACTIVE_UNIFORMS, &uniformNum);
+	glGetProgramiv(m_programHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLen);
+
+	std::vector<GLchar> nameBuf(std::max(maxNameLen, 1));
+	for (int uniformIdx = 0; uniformIdx < uniformNum; ++uniformIdx)
+	{
+		GLsizei nameLen = 0;
+		GLint size = 0;
+		GLenum type;
+		glGetActiveUniform(m_programHandle, uniformIdx, nameBuf.size(), &nameLen, &size, &type, &nameBuf[0]);
+
+		// Members of uniform blocks have no location
+		std::string varName(&nameBuf[0], nameLen);
+		GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+		if (varLoc < 0)
+		{
+			continue;
+		}
+
+		// Arrays are reported as name[0], they are looked up by the plain name
+		if (varName.size() > 3 && varName.compare(varName.size() - 3, 3, "[0]") == 0)
+		{
+			varName.erase(varName.size() - 3);
+		}
+		m_uniformLocationMap[varName] = varLoc;
 	}
 }
 
+GLint CShaderProgram::getUniformLocation(const std::string& varName)
+{
+	std::map<std::string, GLint>::iterator it = m_uniformLocationMap.find(varName);
+	if (it != m_uniformLocationMap.end())
+	{
+		return it->second;
+	}
+
+	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	m_uniformLocationMap[varName] = varLoc;
+
+	return varLoc;
+}
+
 void CShaderProgram::printLinkInfoLog(const GLuint& program)
 {
 	int infoLogLen(0);
@@ -80,20 +147,15 @@ void CShaderProgram::printLinkInfoLog(const GLuint& program)
 
 void CShaderProgram::activate()
 {
-	GLint currentProg;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProg);
-	if(currentProg != (GLint)m_programHandle)
-		glUseProgram(m_programHandle);
+	CGLStateCache::Instance()->useProgram(m_programHandle);
 
 	//updateUniformVariables();
 }
 
 void CShaderProgram::deactivate()
 {
-	GLint currentProg;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProg);
-	if(currentProg == (GLint)m_programHandle)
-		glUseProgram(0);
+	if (CGLStateCache::Instance()->getProgram() == m_programHandle)
+		CGLStateCache::Instance()->useProgram(0);
 }
 
 void CShaderProgram::updateUniformVariables()
@@ -138,7 +200,7 @@ void CShaderProgram::registerUniformiv(const std::string& varName, int* pValues,
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -164,7 +226,7 @@ void CShaderProgram::registerUniformuiv(const std::string& varName, unsigned int
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -190,7 +252,7 @@ void CShaderProgram::registerUniformfv(const std::string& varName, float* pValue
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -216,7 +278,7 @@ void CShaderProgram::registerUniformMatrix(const std::string& varName, float* pV
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -244,7 +306,7 @@ void CShaderProgram::registerUniformSampler(const std::string& varName, GLuint*
 {
 	assert(pTexHandle != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -266,7 +328,7 @@ void CShaderProgram::registerUniformSampler(const std::string& varName, GLuint*
 
 void CShaderProgram::registerUniformModelVivwMat(const std::string& varName)
 {
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -283,7 +345,7 @@ void CShaderProgram::registerUniformModelVivwMat(const std::string& varName)
 
 void CShaderProgram::registerUniformProjMat(const std::string& varName)
 {
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -421,7 +483,7 @@ void CShaderProgram::updateUniformiv(const std::string& varName, int* pValues, i
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -449,7 +511,7 @@ void CShaderProgram::updateUniformuiv(const std::string& varName, unsigned int*
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -477,7 +539,7 @@ void CShaderProgram::updateUniformfv(const std::string& varName, float* pValues,
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -505,7 +567,7 @@ void CShaderProgram::updateUniformMatrix(const std::string& varName, float* pVal
 {
 	assert(pValues != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -554,7 +616,7 @@ void CShaderProgram::updateUniformSampler(const std::string& varName, GLuint* pT
 {
 	assert(pTexHandle != NULL);
 
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
@@ -564,76 +626,71 @@ void CShaderProgram::updateUniformSampler(const std::string& varName, GLuint* pT
 
 void CShaderProgram::updateMatrix3x3(const std::string& varName, float *pMat)
 {
-	GLint mvLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint mvLoc = getUniformLocation(varName);
 	
 	glUniformMatrix3fv(mvLoc, 1, GL_FALSE, pMat);
 }
 
 void CShaderProgram::updateMatrix4x4(const std::string& varName, float *pMat)
 {
-	GLint mvLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint mvLoc = getUniformLocation(varName);
 
 	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, pMat);
 }
 
 void CShaderProgram::updateModelViewMat()
 {
-	GLfloat mv[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+	const mat4 &mv = CViewer::getViewerInstance()->getCamera()->getModelviewMat();
 
-	glUniformMatrix4fv(m_modelViewMatUniform.location, 1, GL_FALSE, mv);
+	glUniformMatrix4fv(m_modelViewMatUniform.location, 1, GL_FALSE, &mv[0][0]);
 }
 
 void CShaderProgram::updateProjMat()
 {
-	GLfloat proj[16];
-	glGetFloatv(GL_PROJECTION_MATRIX, proj);
+	const mat4 &proj = CViewer::getViewerInstance()->getCamera()->getProjMat();
 
-	glUniformMatrix4fv(m_projMatUniform.location, 1, GL_FALSE, proj);
+	glUniformMatrix4fv(m_projMatUniform.location, 1, GL_FALSE, &proj[0][0]);
 }
 
 void CShaderProgram::updateModelViewMat(const std::string& varName)
 {
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
 		std::cout << "WARNING: Model view Uniform variable " << varName << " not found!" << std::endl;
 	}
 
-	GLfloat mv[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, mv);
-	glUniformMatrix4fv(varLoc, 1, GL_FALSE, mv);
+	const mat4 &mv = CViewer::getViewerInstance()->getCamera()->getModelviewMat();
+	glUniformMatrix4fv(varLoc, 1, GL_FALSE, &mv[0][0]);
 }
 
 void CShaderProgram::updateProjMat(const std::string& varName)
 {
-	GLint varLoc = glGetUniformLocation(m_programHandle, varName.c_str());
+	GLint varLoc = getUniformLocation(varName);
 
 	if (varLoc < 0)
 	{
 		std::cout << "WARNING: Projective Uniform variable " << varName << " not found!" << std::endl;
 	}
 
-	GLfloat proj[16];
-	glGetFloatv(GL_PROJECTION_MATRIX, proj);
+	const mat4 &proj = CViewer::getViewerInstance()->getCamera()->getProjMat();
 
-	glUniformMatrix4fv(varLoc, 1, GL_FALSE, proj);
+	glUniformMatrix4fv(varLoc, 1, GL_FALSE, &proj[0][0]);
 }
 
 void CShaderProgram::updateTexture2D(const std::string& uniformName, GLuint glTexHandle, int bundlePoint)
 {
-	GLint mvLoc = glGetUniformLocation(m_programHandle, uniformName.c_str());
+	GLint mvLoc = getUniformLocation(uniformName);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, glTexHandle);
+	CGLStateCache::Instance()->bindTexture(0, GL_TEXTURE_2D, glTexHandle);
 
 	glUniform1i(mvLoc, 0);
 }
 
 void CShaderProgram::updateTexture3D(const std::string& uniformName, GLuint glTexHandle)
 {
-	GLint mvLoc = glGetUniformLocation(m_programHandle, uniformName.c_str());
+	GLint mvLoc = getUniformLocation(uniformName);
 
 	//glActiveTexture(GL_TEXTURE0 + 0);
 	//glBindTexture(GL_TEXTURE_3D, glTexHandle);
@@ -94,9 +94,14 @@ public:
 	void attachShader(CShaderManager::ShaderType vST, const char* shaderFile);
 	void linkProgram();
 
+	// Locations are resolved once at link time, unknown names are queried once and cached as -1
+	GLint getUniformLocation(const std::string& varName);
+
 	void activate();
 	void deactivate();
 
+	GLuint getProgramHandle(){ return m_programHandle; }
+
 	void updateUniformVariables();
 
 // General uniform variable register function
@@ -140,6 +145,7 @@ public:
 private:
 	void detachShaders();
 	void printLinkInfoLog(const GLuint& program);
+	void cacheUniformLocations();
 
 private:
 	bool m_linked;
@@ -154,6 +160,8 @@ private:
 	std::vector<UniformVariablef> m_fUniformVec;
 	std::vector<UniformVariableMat> m_matUniformVec;
 	std::vector<UniformVariableSampler> m_texUniformVec;
+
+	std::map<std::string, GLint> m_uniformLocationMap;
 };
 
 }  // end namespace
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "softRasterizer.h"
+
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "triangleMesh.h"
+#include "threadPool.h"
+
+using namespace TextureSynthesis;
+
+#define SOFT_TILE_SIZE 32
+#define SOFT_CHUNKS_PER_THREAD 4
+
+CSoftRasterizer::CSoftRasterizer(int width, int height) : m_width(width), m_height(height), m_chunkNum(0), m_pMesh(NULL)
+{
+	m_tileColNum = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	m_tileRowNum = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+
+	m_pThreadPool = CThreadPool::Instance();
+
+	m_triIdxBuffer.resize(width * height);
+	m_baryBuffer.resize(width * height);
+	m_depthBuffer.resize(width * height);
+
+	cout << "Info: Software rasterizer of " << width << "x" << height << " with " << m_pThreadPool->getThreadNum() << " threads" << endl;
+}
+
+CSoftRasterizer::~CSoftRasterizer()
+{
+
+}
+
+void CSoftRasterizer::rasterize(CTriangleMesh *pMesh, const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport)
+{
+	m_pMesh = pMesh;
+	m_viewProjMat = projMat * modelviewMat;
+	m_viewport = viewport;
+
+	std::fill(m_triIdxBuffer.begin(), m_triIdxBuffer.end(), 0);
+	std::fill(m_baryBuffer.begin(), m_baryBuffer.end(), 0);
+	std::fill(m_depthBuffer.begin(), m_depthBuffer.end(), 1.0f);
+
+	m_screenVerVec.resize(pMesh->getVerNum());
+
+	m_chunkNum = m_pThreadPool->getThreadNum() * SOFT_CHUNKS_PER_THREAD;
+	m_tileBinVec.resize(m_chunkNum);
+	for (int chunkIdx = 0; chunkIdx < m_chunkNum; ++chunkIdx)
+	{
+		m_tileBinVec[chunkIdx].resize(m_tileColNum * m_tileRowNum);
+		for (int tileIdx = 0; tileIdx < m_tileBinVec[chunkIdx].size(); ++tileIdx)
+		{
+			m_tileBinVec[chunkIdx][tileIdx].clear();
+		}
+	}
+
+	m_pThreadPool->parallelFor(m_chunkNum, [this](int chunkIdx){ transformVertices(chunkIdx); });
+	m_pThreadPool->parallelFor(m_chunkNum, [this](int chunkIdx){ binTriangles(chunkIdx); });
+	m_pThreadPool->parallelFor(m_tileColNum * m_tileRowNum, [this](int tileIdx){ rasterizeTile(tileIdx); });
+}
+
+void CSoftRasterizer::transformVertices(int chunkIdx)
+{
+	const vec3 *pVertices = m_pMesh->getVertices();
+	const int verNum = m_pMesh->getVerNum();
+	const int startIdx = (long long)verNum * chunkIdx / m_chunkNum;
+	const int endIdx = (long long)verNum * (chunkIdx + 1) / m_chunkNum;
+
+	for (int verIdx = startIdx; verIdx < endIdx; ++verIdx)
+	{
+		vec4 clipPos = m_viewProjMat * vec4(pVertices[verIdx], 1.0f);
+
+		if (clipPos.w <= EPSILON)
+		{
+			m_screenVerVec[verIdx] = vec4(0.0f, 0.0f, 0.0f, -1.0f);
+			continue;
+		}
+
+		float invW = 1.0f / clipPos.w;
+		m_screenVerVec[verIdx] = vec4(
+			m_viewport[0] + (clipPos.x * invW * 0.5f + 0.5f) * m_viewport[2],
+			m_viewport[1] + (clipPos.y * invW * 0.5f + 0.5f) * m_viewport[3],
+			clipPos.z * invW * 0.5f + 0.5f,
+			invW);
+	}
+}
+
+void CSoftRasterizer::binTriangles(int chunkIdx)
+{
+	const ivec3 *pTriIndices = m_pMesh->getTriIdx();
+	const int triNum = m_pMesh->getTriNum();
+	const int startIdx = (long long)triNum * chunkIdx / m_chunkNum;
+	const int endIdx = (long long)triNum * (chunkIdx + 1) / m_chunkNum;
+
+	vector<vector<int> > &tileBins = m_tileBinVec[chunkIdx];
+
+	for (int triIdx = startIdx; triIdx < endIdx; ++triIdx)
+	{
+		const vec4 &v0 = m_screenVerVec[pTriIndices[triIdx][0]];
+		const vec4 &v1 = m_screenVerVec[pTriIndices[triIdx][1]];
+		const vec4 &v2 = m_screenVerVec[pTriIndices[triIdx][2]];
+
+		if (v0.w <= 0.0f || v1.w <= 0.0f || v2.w <= 0.0f)
+		{
+			continue;
+		}
+
+		if ((v0.z < 0.0f && v1.z < 0.0f && v2.z < 0.0f) || (v0.z > 1.0f && v1.z > 1.0f && v2.z > 1.0f))
+		{
+			continue;
+		}
+
+		// Pixels whose centers fall inside the bounding box
+		int minX = std::max((int)ceil(std::min(std::min(v0.x, v1.x), v2.x) - 0.5f), std::max(m_viewport[0], 0));
+		int minY = std::max((int)ceil(std::min(std::min(v0.y, v1.y), v2.y) - 0.5f), std::max(m_viewport[1], 0));
+		int maxX = std::min((int)floor(std::max(std::max(v0.x, v1.x), v2.x) - 0.5f), std::min(m_viewport[0] + m_viewport[2], m_width) - 1);
+		int maxY = std::min((int)floor(std::max(std::max(v0.y, v1.y), v2.y) - 0.5f), std::min(m_viewport[1] + m_viewport[3], m_height) - 1);
+
+		if (minX > maxX || minY > maxY)
+		{
+			continue;
+		}
+
+		for (int tileY = minY / SOFT_TILE_SIZE; tileY <= maxY / SOFT_TILE_SIZE; ++tileY)
+		{
+			for (int tileX = minX / SOFT_TILE_SIZE; tileX <= maxX / SOFT_TILE_SIZE; ++tileX)
+			{
+				tileBins[tileY * m_tileColNum + tileX].push_back(triIdx);
+			}
+		}
+	}
+}
+
+void CSoftRasterizer::rasterizeTile(int tileIdx)
+{
+	int minX = (tileIdx % m_tileColNum) * SOFT_TILE_SIZE;
+	int minY = (tileIdx / m_tileColNum) * SOFT_TILE_SIZE;
+	int maxX = std::min(minX + SOFT_TILE_SIZE, m_width) - 1;
+	int maxY = std::min(minY + SOFT_TILE_SIZE, m_height) - 1;
+
+	// Chunks in order, so later triangles win depth ties as with GL_LEQUAL
+	for (int chunkIdx = 0; chunkIdx < m_chunkNum; ++chunkIdx)
+	{
+		const vector<int> &tileBin = m_tileBinVec[chunkIdx][tileIdx];
+		for (int binIdx = 0; binIdx < tileBin.size(); ++binIdx)
+		{
+			rasterizeTriangle(tileBin[binIdx], minX, minY, maxX, maxY);
+		}
+	}
+}
+
+void CSoftRasterizer::rasterizeTriangle(int triIdx, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY)
+{
+	const ivec3 &triangle = m_pMesh->getTriIdx()[triIdx];
+	const vec4 v[3] = { m_screenVerVec[triangle[0]], m_screenVerVec[triangle[1]], m_screenVerVec[triangle[2]] };
+
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+	if (area == 0.0f)
+	{
+		return;
+	}
+
+	// Edge k is opposite corner k, so its edge function is the unnormalized weight of corner k.
+	// Both windings are drawn by flipping the edges of clockwise triangles.
+	const float orient = area > 0.0f ? 1.0f : -1.0f;
+	const float invArea = 1.0f / (area * orient);
+
+	float edgeA[3], edgeB[3], edgeC[3];
+	__m128 inclusive[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		const vec4 &a = v[(k + 1) % 3];
+		const vec4 &b = v[(k + 2) % 3];
+
+		edgeA[k] = (a.y - b.y) * orient;
+		edgeB[k] = (b.x - a.x) * orient;
+		edgeC[k] = -(edgeA[k] * a.x + edgeB[k] * a.y);
+
+		// Pixels exactly on a shared edge belong to one side only
+		bool isInclusive = edgeA[k] > 0.0f || (edgeA[k] == 0.0f && edgeB[k] < 0.0f);
+		inclusive[k] = _mm_castsi128_ps(_mm_set1_epi32(isInclusive ? -1 : 0));
+	}
+
+	int minX = std::max((int)ceil(std::min(std::min(v[0].x, v[1].x), v[2].x) - 0.5f), tileMinX);
+	int minY = std::max((int)ceil(std::min(std::min(v[0].y, v[1].y), v[2].y) - 0.5f), tileMinY);
+	int maxX = std::min((int)floor(std::max(std::max(v[0].x, v[1].x), v[2].x) - 0.5f), tileMaxX);
+	int maxY = std::min((int)floor(std::max(std::max(v[0].y, v[1].y), v[2].y) - 0.5f), tileMaxY);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 lastX = _mm_set1_ps(maxX + 0.5f);
+	const __m128 scaledZ[3] = { _mm_set1_ps(v[0].z * invArea), _mm_set1_ps(v[1].z * invArea), _mm_set1_ps(v[2].z * invArea) };
+
+	float weights[3][4];
+	float depths[4];
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		const float py = y + 0.5f;
+		__m128 rowEdge[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			rowEdge[k] = _mm_set1_ps(edgeB[k] * py + edgeC[k]);
+		}
+
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 mask = _mm_cmple_ps(px, lastX);
+
+			__m128 edge[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				edge[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[k]), px), rowEdge[k]);
+				__m128 inside = _mm_or_ps(_mm_cmpgt_ps(edge[k], zero), _mm_and_ps(_mm_cmpeq_ps(edge[k], zero), inclusive[k]));
+				mask = _mm_and_ps(mask, inside);
+			}
+
+			if (_mm_movemask_ps(mask) == 0)
+			{
+				continue;
+			}
+
+			// Window depth is linear in screen space
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge[0], scaledZ[0]), _mm_mul_ps(edge[1], scaledZ[1])), _mm_mul_ps(edge[2], scaledZ[2]));
+
+			const int pixelIdx = y * m_width + x;
+			// Lanes past the triangle may lie in a tile another thread is drawing, they are not read
+			__m128 storedZ;
+			if (x + 3 <= maxX)
+			{
+				storedZ = _mm_loadu_ps(&m_depthBuffer[pixelIdx]);
+			}
+			else
+			{
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					depths[lane] = x + lane <= maxX ? m_depthBuffer[pixelIdx + lane] : 0.0f;
+				}
+				storedZ = _mm_loadu_ps(depths);
+			}
+			mask = _mm_and_ps(mask, _mm_cmple_ps(z, storedZ));
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one)));
+
+			int laneBits = _mm_movemask_ps(mask);
+			if (laneBits == 0)
+			{
+				continue;
+			}
+
+			_mm_storeu_ps(depths, z);
+			for (int k = 0; k < 3; ++k)
+			{
+				_mm_storeu_ps(weights[k], edge[k]);
+			}
+
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				if (!(laneBits & (1 << lane)))
+				{
+					continue;
+				}
+
+				// Perspective correct barycentrics, as interpolated for f_barycentric
+				float w0 = weights[0][lane] * v[0].w;
+				float w1 = weights[1][lane] * v[1].w;
+				float w2 = weights[2][lane] * v[2].w;
+				float invSum = 1.0f / (w0 + w1 + w2);
+
+				uint b1 = (uint)(glm::clamp(w1 * invSum, 0.0f, 1.0f) * 65535.0f + 0.5f);
+				uint b2 = (uint)(glm::clamp(w2 * invSum, 0.0f, 1.0f) * 65535.0f + 0.5f);
+
+				m_depthBuffer[pixelIdx + lane] = depths[lane];
+				m_triIdxBuffer[pixelIdx + lane] = triIdx + 1;
+				m_baryBuffer[pixelIdx + lane] = b1 | (b2 << 16);
+			}
+		}
+	}
+}
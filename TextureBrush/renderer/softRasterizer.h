@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+class CTriangleMesh;
+class CThreadPool;
+
+// CPU version of the triangle track pass for picking without a GL context. Produces the same
+// buffers as the pick FBO: triangle index + 1 (0 for background), barycentric weights of the
+// second and third corner as unorm16x2, and window depth, with rows bottom to top as in GL.
+// Triangles are binned into screen tiles, then tiles are rasterized in parallel with SSE edge
+// functions, four pixels at a time. Triangles crossing the eye plane are dropped instead of clipped.
+class CSoftRasterizer
+{
+public:
+	// Runs on the shared thread pool
+	CSoftRasterizer(int width, int height);
+	virtual ~CSoftRasterizer();
+
+	// Every triangle of the mesh is drawn with a less or equal depth test and no culling, like the GL pass
+	void rasterize(CTriangleMesh *pMesh, const mat4 &modelviewMat, const mat4 &projMat, const ivec4 &viewport);
+
+	const uint* getTriIdxData(){ return &m_triIdxBuffer[0]; }
+	const uint* getBaryData(){ return &m_baryBuffer[0]; }
+	const float* getDepthData(){ return &m_depthBuffer[0]; }
+
+	int getWidth(){ return m_width; }
+	int getHeight(){ return m_height; }
+
+private:
+	void transformVertices(int chunkIdx);
+	void binTriangles(int chunkIdx);
+	void rasterizeTile(int tileIdx);
+	void rasterizeTriangle(int triIdx, int minX, int minY, int maxX, int maxY);
+
+private:
+	int m_width, m_height;
+	int m_tileColNum, m_tileRowNum;
+	int m_chunkNum;
+
+	CThreadPool *m_pThreadPool;
+
+	// Inputs of the current rasterize call
+	CTriangleMesh *m_pMesh;
+	mat4 m_viewProjMat;
+	ivec4 m_viewport;
+
+	// Per vertex window x, y, depth and 1 / w, w <= 0 marks a vertex behind the eye
+	vector<vec4> m_screenVerVec;
+
+	// Triangles of each chunk per tile, chunks cover ascending triangle ranges to keep draw order
+	vector<vector<vector<int> > > m_tileBinVec;
+
+	vector<uint> m_triIdxBuffer;
+	vector<uint> m_baryBuffer;
+	vector<float> m_depthBuffer;
+};
+
+}
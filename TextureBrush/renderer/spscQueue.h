@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+namespace TextureSynthesis
+{
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two, one slot is kept empty.
+template <typename T>
+class CSpscQueue
+{
+public:
+	explicit CSpscQueue(int capacity) : m_head(0), m_tail(0)
+	{
+		int size = 2;
+		while (size < capacity + 1) size <<= 1;
+
+		m_slots.resize(size);
+		m_mask = size - 1;
+	}
+
+	// Producer side, returns false when the queue is full
+	bool push(const T &item)
+	{
+		const unsigned int tail = m_tail.load(std::memory_order_relaxed);
+		const unsigned int nextTail = (tail + 1) & m_mask;
+
+		if (nextTail == m_head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		m_slots[tail] = item;
+		m_tail.store(nextTail, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, returns false when the queue is empty
+	bool pop(T &item)
+	{
+		const unsigned int head = m_head.load(std::memory_order_relaxed);
+
+		if (head == m_tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		item = m_slots[head];
+		m_head.store((head + 1) & m_mask, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+	}
+
+private:
+	CSpscQueue(const CSpscQueue&);
+	CSpscQueue& operator=(const CSpscQueue&);
+
+	std::vector<T> m_slots;
+	unsigned int m_mask;
+
+	// Head and tail are written by different threads, keep them on separate cache lines
+	char m_headPad[64];
+	std::atomic<unsigned int> m_head;
+	char m_tailPad[64];
+	std::atomic<unsigned int> m_tail;
+};
+
+}
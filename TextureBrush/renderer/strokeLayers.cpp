@@ -0,0 +1,335 @@
+#include "strokeLayers.h"
+
+#include <algorithm>
+
+#include "triangleMesh.h"
+
+using namespace TextureSynthesis;
+
+CStrokeLayers::CStrokeLayers() : m_activeLayerNum(0), m_layerByteNum(0), m_baseLayerNum(0), m_lastBasePriority(-1),
+	m_pRecordVerIdxVec(NULL), m_pRecordStateVec(NULL)
+{
+
+}
+
+CStrokeLayers::~CStrokeLayers()
+{
+
+}
+
+int CStrokeLayers::addLayer(StrokeLayer &layer, CTriangleMesh *pMesh)
+{
+	if (m_verOwnerVec.size() != pMesh->getVerNum())
+	{
+		m_verOwnerVec.assign(pMesh->getVerNum(), -1);
+	}
+
+	// A new stroke ends the redo chain
+	while (m_baseLayerNum + (int)m_layerVec.size() > m_activeLayerNum)
+	{
+		m_layerByteNum -= getLayerByteNum(m_layerVec.back());
+		m_layerVec.pop_back();
+	}
+
+	const int layerIdx = m_activeLayerNum;
+	m_layerVec.push_back(StrokeLayer());
+	++m_activeLayerNum;
+	m_layerVec.back().priority = layer.priority;
+	m_layerVec.back().verIdxVec.swap(layer.verIdxVec);
+	m_layerVec.back().disVec.swap(layer.disVec);
+	m_layerVec.back().texcoordVec.swap(layer.texcoordVec);
+
+	const StrokeLayer &newLayer = m_layerVec.back();
+	m_layerByteNum += getLayerByteNum(newLayer);
+
+	for (int bandIdx = 0; bandIdx < newLayer.verIdxVec.size(); ++bandIdx)
+	{
+		int verIdx = newLayer.verIdxVec[bandIdx];
+		int ownerIdx = m_verOwnerVec[verIdx];
+
+		if (ownerIdx < 0 || newLayer.priority >= getOwnerPriority(verIdx, ownerIdx))
+		{
+			writeVertex(verIdx, layerIdx, bandIdx, pMesh);
+		}
+	}
+
+	return layerIdx;
+}
+
+void CStrokeLayers::setLayerPriority(int layerIdx, int priority, CTriangleMesh *pMesh)
+{
+	if (layerIdx < 0 || layerIdx >= m_activeLayerNum)
+	{
+		cout << "ERROR: Stroke layer " << layerIdx << " doesn't exist!" << endl;
+		return;
+	}
+
+	if (layerIdx < m_baseLayerNum)
+	{
+		cout << "ERROR: Stroke layer " << layerIdx << " is merged into the base!" << endl;
+		return;
+	}
+
+	StrokeLayer &layer = m_layerVec[layerIdx - m_baseLayerNum];
+	layer.priority = priority;
+	recompositeVertices(layer.verIdxVec, pMesh);
+}
+
+void CStrokeLayers::clear(CTriangleMesh *pMesh)
+{
+	vector<int> touchedVerIdxVec;
+	for (int layerIdx = m_baseLayerNum; layerIdx < m_activeLayerNum; ++layerIdx)
+	{
+		const StrokeLayer &layer = m_layerVec[layerIdx - m_baseLayerNum];
+		touchedVerIdxVec.insert(touchedVerIdxVec.end(), layer.verIdxVec.begin(), layer.verIdxVec.end());
+	}
+	for (int verIdx = 0; verIdx < m_baseStateVec.size(); ++verIdx)
+	{
+		if (m_baseStateVec[verIdx].owner >= 0)
+		{
+			touchedVerIdxVec.push_back(verIdx);
+		}
+	}
+
+	m_layerVec.clear();
+	m_activeLayerNum = 0;
+	m_layerByteNum = 0;
+
+	vector<StrokeVertexState>().swap(m_baseStateVec);
+	vector<int>().swap(m_basePriorityVec);
+	m_baseLayerNum = 0;
+	m_lastBasePriority = -1;
+
+	recompositeVertices(touchedVerIdxVec, pMesh);
+}
+
+void CStrokeLayers::mergeLayers(int layerNum, CTriangleMesh *pMesh)
+{
+	layerNum = std::min(layerNum, m_activeLayerNum);
+	if (layerNum <= m_baseLayerNum)
+	{
+		return;
+	}
+
+	if (m_baseStateVec.size() != pMesh->getVerNum())
+	{
+		StrokeVertexState noneState;
+		noneState.dis = STROKE_DIS_NONE;
+		noneState.texcoord = STROKE_TEXCOORD_INVALID;
+		noneState.owner = -1;
+
+		m_baseStateVec.assign(pMesh->getVerNum(), noneState);
+		m_basePriorityVec.assign(pMesh->getVerNum(), 0);
+	}
+
+	// Composited the same way as addLayer, the mesh attributes already show the result
+	const int mergeNum = layerNum - m_baseLayerNum;
+	for (int mergeIdx = 0; mergeIdx < mergeNum; ++mergeIdx)
+	{
+		const StrokeLayer &layer = m_layerVec[mergeIdx];
+
+		for (int bandIdx = 0; bandIdx < layer.verIdxVec.size(); ++bandIdx)
+		{
+			int verIdx = layer.verIdxVec[bandIdx];
+			StrokeVertexState &baseState = m_baseStateVec[verIdx];
+
+			if (baseState.owner < 0 || layer.priority >= m_basePriorityVec[verIdx])
+			{
+				baseState.dis = layer.disVec[bandIdx];
+				baseState.texcoord = layer.texcoordVec[bandIdx];
+				baseState.owner = m_baseLayerNum + mergeIdx;
+				m_basePriorityVec[verIdx] = layer.priority;
+			}
+		}
+
+		m_layerByteNum -= getLayerByteNum(layer);
+		m_lastBasePriority = layer.priority;
+	}
+
+	m_layerVec.erase(m_layerVec.begin(), m_layerVec.begin() + mergeNum);
+	m_baseLayerNum = layerNum;
+}
+
+int CStrokeLayers::getNextPriority()
+{
+	if (m_activeLayerNum == 0)
+	{
+		return 0;
+	}
+
+	if (m_activeLayerNum == m_baseLayerNum)
+	{
+		return m_lastBasePriority + 1;
+	}
+
+	return m_layerVec[m_activeLayerNum - 1 - m_baseLayerNum].priority + 1;
+}
+
+size_t CStrokeLayers::getByteNum()
+{
+	return m_layerByteNum + m_baseStateVec.size() * sizeof(StrokeVertexState) + m_basePriorityVec.size() * sizeof(int);
+}
+
+size_t CStrokeLayers::getLayerByteNum(const StrokeLayer &layer)
+{
+	return sizeof(StrokeLayer) + layer.verIdxVec.size() * sizeof(int) + layer.disVec.size() * sizeof(float)
+		+ layer.texcoordVec.size() * sizeof(uint);
+}
+
+int CStrokeLayers::getOwnerPriority(int verIdx, int ownerIdx)
+{
+	// Any merged owner stands for the base of the vertex
+	if (ownerIdx < m_baseLayerNum)
+	{
+		return m_basePriorityVec[verIdx];
+	}
+
+	return m_layerVec[ownerIdx - m_baseLayerNum].priority;
+}
+
+void CStrokeLayers::recompositeVertices(const vector<int> &verIdxVec, CTriangleMesh *pMesh)
+{
+	for (int idx = 0; idx < verIdxVec.size(); ++idx)
+	{
+		int verIdx = verIdxVec[idx];
+		int bestLayerIdx = -1, bestBandIdx = -1;
+		bool hasBase = !m_baseStateVec.empty() && m_baseStateVec[verIdx].owner >= 0;
+		int bestPriority = hasBase ? m_basePriorityVec[verIdx] : 0;
+
+		for (int layerIdx = m_baseLayerNum; layerIdx < m_activeLayerNum; ++layerIdx)
+		{
+			const StrokeLayer &layer = m_layerVec[layerIdx - m_baseLayerNum];
+			if ((hasBase || bestLayerIdx >= 0) && layer.priority < bestPriority)
+			{
+				continue;
+			}
+
+			int bandIdx = findInLayer(layerIdx, verIdx);
+			if (bandIdx >= 0)
+			{
+				bestLayerIdx = layerIdx;
+				bestBandIdx = bandIdx;
+				bestPriority = layer.priority;
+			}
+		}
+
+		if (bestLayerIdx < 0 && hasBase)
+		{
+			writeVertexState(verIdx, m_baseStateVec[verIdx], pMesh);
+		}
+		else
+		{
+			writeVertex(verIdx, bestLayerIdx, bestBandIdx, pMesh);
+		}
+	}
+}
+
+void CStrokeLayers::writeVertex(int verIdx, int layerIdx, int bandIdx, CTriangleMesh *pMesh)
+{
+	const StrokeLayer *pLayer = layerIdx >= 0 ? &m_layerVec[layerIdx - m_baseLayerNum] : NULL;
+
+	StrokeVertexState newState;
+	newState.owner = layerIdx;
+	newState.dis = pLayer != NULL ? pLayer->disVec[bandIdx] : STROKE_DIS_NONE;
+	newState.texcoord = pLayer != NULL ? pLayer->texcoordVec[bandIdx] : STROKE_TEXCOORD_INVALID;
+
+	writeVertexState(verIdx, newState, pMesh);
+}
+
+void CStrokeLayers::writeVertexState(int verIdx, const StrokeVertexState &state, CTriangleMesh *pMesh)
+{
+	if (m_pRecordVerIdxVec != NULL)
+	{
+		StrokeVertexState oldState;
+		getVertexState(verIdx, pMesh, oldState);
+
+		m_pRecordVerIdxVec->push_back(verIdx);
+		m_pRecordStateVec->push_back(oldState);
+	}
+
+	setVertexState(verIdx, state, pMesh);
+}
+
+void CStrokeLayers::startRecording(vector<int> *pVerIdxVec, vector<StrokeVertexState> *pStateVec)
+{
+	m_pRecordVerIdxVec = pVerIdxVec;
+	m_pRecordStateVec = pStateVec;
+}
+
+void CStrokeLayers::stopRecording()
+{
+	m_pRecordVerIdxVec = NULL;
+	m_pRecordStateVec = NULL;
+}
+
+void CStrokeLayers::getVertexState(int verIdx, CTriangleMesh *pMesh, StrokeVertexState &state)
+{
+	float *pDisData = pMesh->getPropFloatData();
+	vec2 *pTexcoordData = pMesh->getPropFloat2Data();
+
+	state.owner = m_verOwnerVec.empty() ? -1 : m_verOwnerVec[verIdx];
+	state.dis = pDisData != NULL ? pDisData[verIdx] : STROKE_DIS_NONE;
+	state.texcoord = pTexcoordData != NULL ? packTexcoord(pTexcoordData[verIdx]) : STROKE_TEXCOORD_INVALID;
+}
+
+void CStrokeLayers::setVertexState(int verIdx, const StrokeVertexState &state, CTriangleMesh *pMesh)
+{
+	if (m_verOwnerVec.size() != pMesh->getVerNum())
+	{
+		m_verOwnerVec.assign(pMesh->getVerNum(), -1);
+	}
+
+	m_verOwnerVec[verIdx] = state.owner;
+
+	float *pDisData = pMesh->getPropFloatData();
+	vec2 *pTexcoordData = pMesh->getPropFloat2Data();
+
+	if (pDisData != NULL)
+	{
+		pDisData[verIdx] = state.dis;
+		pMesh->markPropDirty(TMPC_FLOAT, verIdx, verIdx + 1);
+	}
+
+	if (pTexcoordData != NULL)
+	{
+		pTexcoordData[verIdx] = unpackTexcoord(state.texcoord);
+		pMesh->markPropDirty(TMPC_FLOAT2, verIdx, verIdx + 1);
+	}
+}
+
+int CStrokeLayers::findInLayer(int layerIdx, int verIdx)
+{
+	const vector<int> &bandVerIdxVec = m_layerVec[layerIdx - m_baseLayerNum].verIdxVec;
+	vector<int>::const_iterator itr = std::lower_bound(bandVerIdxVec.begin(), bandVerIdxVec.end(), verIdx);
+
+	if (itr == bandVerIdxVec.end() || *itr != verIdx)
+	{
+		return -1;
+	}
+
+	return itr - bandVerIdxVec.begin();
+}
+
+uint CStrokeLayers::packTexcoord(const vec2 &texcoord)
+{
+	if (texcoord[0] < 0.0f || texcoord[1] < 0.0f)
+	{
+		return STROKE_TEXCOORD_INVALID;
+	}
+
+	// 0xFFFF is left out so a valid texcoord never packs to the invalid marker
+	uint u = (uint)(glm::clamp(texcoord[0], 0.0f, 1.0f) * 65534.0f + 0.5f);
+	uint v = (uint)(glm::clamp(texcoord[1], 0.0f, 1.0f) * 65534.0f + 0.5f);
+
+	return u | (v << 16);
+}
+
+vec2 CStrokeLayers::unpackTexcoord(uint packedTexcoord)
+{
+	if (packedTexcoord == STROKE_TEXCOORD_INVALID)
+	{
+		return vec2(-1.0f);
+	}
+
+	return vec2((packedTexcoord & 0xFFFF) / 65534.0f, (packedTexcoord >> 16) / 65534.0f);
+}
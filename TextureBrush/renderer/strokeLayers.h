@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+// Packed texcoord of a vertex without a valid local texcoord
+const uint STROKE_TEXCOORD_INVALID = 0xFFFFFFFF;
+
+// Distance written for vertices outside every stroke band
+const float STROKE_DIS_NONE = -1.0f;
+
+class CTriangleMesh;
+
+// Band of one stroke, only the vertices it reached are stored, sorted by vertex index
+struct StrokeLayer
+{
+	int priority;
+	vector<int> verIdxVec;
+	vector<float> disVec;
+	vector<uint> texcoordVec;	// Two unorm16 values, u in the low half
+};
+
+// Composited per vertex state, what undo history records
+struct StrokeVertexState
+{
+	float dis;
+	uint texcoord;
+	int owner;
+};
+
+// Retained strokes composited into the per-vertex distance and texcoord attributes of a mesh.
+// For every vertex the covering layer with the highest priority wins, later layers win ties.
+// Layers beyond the active number are undone strokes kept for redo. The oldest layers can be
+// merged into a per vertex base once they can't be undone, layer indices stay the same.
+class CStrokeLayers
+{
+public:
+	CStrokeLayers();
+	virtual ~CStrokeLayers();
+
+	// Takes over the layer data, only its band is composited. Undone layers are dropped.
+	int addLayer(StrokeLayer &layer, CTriangleMesh *pMesh);
+	void setLayerPriority(int layerIdx, int priority, CTriangleMesh *pMesh);
+	void clear(CTriangleMesh *pMesh);
+
+	// Flatten the layers before the given index into the base, they are no longer kept
+	void mergeLayers(int layerNum, CTriangleMesh *pMesh);
+
+	int getLayerNum(){ return m_activeLayerNum; }
+	int getBaseLayerNum(){ return m_baseLayerNum; }
+	const StrokeLayer& getLayer(int layerIdx){ return m_layerVec[layerIdx - m_baseLayerNum]; }
+	int getNextPriority();
+	void setActiveLayerNum(int layerNum){ m_activeLayerNum = layerNum; }
+
+	// Memory held by the kept layers and the base
+	size_t getByteNum();
+
+	// States of the vertices about to be overwritten, in write order, a vertex may repeat
+	void startRecording(vector<int> *pVerIdxVec, vector<StrokeVertexState> *pStateVec);
+	void stopRecording();
+
+	void getVertexState(int verIdx, CTriangleMesh *pMesh, StrokeVertexState &state);
+	void setVertexState(int verIdx, const StrokeVertexState &state, CTriangleMesh *pMesh);
+
+	static uint packTexcoord(const vec2 &texcoord);
+	static vec2 unpackTexcoord(uint packedTexcoord);
+
+protected:
+	// Find the winning layer again for each given vertex and write its values
+	void recompositeVertices(const vector<int> &verIdxVec, CTriangleMesh *pMesh);
+	void writeVertex(int verIdx, int layerIdx, int bandIdx, CTriangleMesh *pMesh);
+	void writeVertexState(int verIdx, const StrokeVertexState &state, CTriangleMesh *pMesh);
+	int findInLayer(int layerIdx, int verIdx);
+	int getOwnerPriority(int verIdx, int ownerIdx);
+
+	static size_t getLayerByteNum(const StrokeLayer &layer);
+
+private:
+	// Layers [m_baseLayerNum, m_baseLayerNum + m_layerVec.size())
+	vector<StrokeLayer> m_layerVec;
+	int m_activeLayerNum;
+	size_t m_layerByteNum;
+
+	// Composite of the merged layers per vertex, owner is the merged layer that won or -1
+	vector<StrokeVertexState> m_baseStateVec;
+	vector<int> m_basePriorityVec;
+	int m_baseLayerNum;
+	int m_lastBasePriority;
+
+	vector<int> *m_pRecordVerIdxVec;
+	vector<StrokeVertexState> *m_pRecordStateVec;
+
+	// Winning layer per vertex, -1 for none
+	vector<int> m_verOwnerVec;
+};
+
+}
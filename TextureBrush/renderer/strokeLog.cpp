@@ -0,0 +1,458 @@
+#include "strokeLog.h"
+
+#include "varintCoding.h"
+#include "renderUtilities.h"
+#include "renderSystemConfig.h"
+#include "renderSystem.h"
+#include "viewer.h"
+#include "camera.h"
+#include "paintPathes.h"
+#include "../eventHandler/eventManager.h"
+
+using namespace TextureSynthesis;
+
+static const char s_strokeLogMagic[4] = { 'T', 'B', 'S', 'L' };
+static const uint s_strokeLogVersion = 1;
+
+CStrokeLog* CStrokeLog::Instance()
+{
+	static CStrokeLog* s_pStrokeLog = NULL;
+
+	if (s_pStrokeLog == NULL)
+	{
+		s_pStrokeLog = new CStrokeLog();
+	}
+
+	return s_pStrokeLog;
+}
+
+CStrokeLog::CStrokeLog() : m_isRecording(false), m_isReplaying(false), m_startTime(0.0),
+	m_winWidth(0), m_winHeight(0), m_replayEventIdx(0), m_replayFirstStroke(0), m_replayStartTime(0.0)
+{
+	for (int idx = 0; idx < 9; ++idx)
+	{
+		m_camera[idx] = 0.0f;
+	}
+}
+
+CStrokeLog::~CStrokeLog()
+{
+	stopRecording();
+}
+
+void CStrokeLog::startRecording(const string &logPath)
+{
+	if (m_isReplaying)
+	{
+		cout << "WARNING: Can't record while replaying a stroke log!" << endl;
+		return;
+	}
+
+	captureStartState();
+
+	m_logPath = logPath;
+	m_eventVec.clear();
+	m_startTime = CRenderUtilities::getTime();
+	m_isRecording = true;
+
+	cout << "Info: Recording strokes to " << logPath << endl;
+}
+
+void CStrokeLog::stopRecording()
+{
+	if (!m_isRecording)
+	{
+		return;
+	}
+
+	m_isRecording = false;
+
+	if (save(m_logPath))
+	{
+		cout << "Info: " << m_eventVec.size() << " input events saved to " << m_logPath << endl;
+	}
+}
+
+bool CStrokeLog::writeSpiralStroke(const string &logPath, int pointNum)
+{
+	captureStartState();
+	m_eventVec.clear();
+
+	StrokeLogEvent event;
+	event.time = 0.0;
+	event.code = event.action = 0;
+	event.x = m_winWidth / 2;
+	event.y = m_winHeight / 2;
+
+	// Shift down, the cursor on the first point, then the button held over the whole path
+	event.type = SLET_KEY;
+	event.code = GLFW_KEY_LEFT_SHIFT;
+	event.action = GLFW_PRESS;
+	m_eventVec.push_back(event);
+
+	event.type = SLET_MOVE;
+	m_eventVec.push_back(event);
+
+	event.type = SLET_BUTTON;
+	event.code = GLFW_MOUSE_BUTTON_LEFT;
+	m_eventVec.push_back(event);
+
+	// Archimedean spiral whose pitch spreads the path over the inner part of the window, at least
+	// two pixels apart so the turns never share pixels
+	const float maxRadius = 0.4f * std::min(m_winWidth, m_winHeight);
+	const float minRadius = 0.05f * maxRadius;
+	const float pitch = std::max(MY_PI * (maxRadius * maxRadius - minRadius * minRadius) / std::max(pointNum, 1), 2.0f);
+
+	float angle = 0.0f;
+	event.type = SLET_MOVE;
+	for (int pointIdx = 0; pointIdx < pointNum; ++pointIdx)
+	{
+		float radius = minRadius + pitch * angle / (2.0f * MY_PI);
+		event.time += 0.001;
+		event.x = m_winWidth / 2 + (int)floor(radius * cos(angle) + 0.5f);
+		event.y = m_winHeight / 2 + (int)floor(radius * sin(angle) + 0.5f);
+		m_eventVec.push_back(event);
+
+		angle += 1.0f / radius;
+	}
+
+	event.type = SLET_BUTTON;
+	event.code = GLFW_MOUSE_BUTTON_LEFT;
+	event.action = GLFW_RELEASE;
+	m_eventVec.push_back(event);
+
+	event.type = SLET_KEY;
+	event.code = GLFW_KEY_LEFT_SHIFT;
+	m_eventVec.push_back(event);
+
+	if (!save(logPath))
+	{
+		return false;
+	}
+
+	cout << "Info: Spiral stroke of " << pointNum << " points written to " << logPath << endl;
+	return true;
+}
+
+void CStrokeLog::captureStartState()
+{
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(m_winWidth, m_winHeight);
+
+	CCamera *pCamera = CViewer::getViewerInstance()->getCamera();
+	m_camera[0] = pCamera->m_fov;
+	m_camera[1] = pCamera->m_nearPlane;
+	m_camera[2] = pCamera->m_farPlane;
+	m_camera[3] = pCamera->m_head;
+	m_camera[4] = pCamera->m_pitch;
+	m_camera[5] = pCamera->m_radius;
+	m_camera[6] = pCamera->m_lookX;
+	m_camera[7] = pCamera->m_lookY;
+	m_camera[8] = pCamera->m_lookZ;
+}
+
+void CStrokeLog::recordKey(int key, int action)
+{
+	pushEvent(SLET_KEY, key, action, 0, 0);
+}
+
+void CStrokeLog::recordButton(int button, int action)
+{
+	pushEvent(SLET_BUTTON, button, action, 0, 0);
+}
+
+void CStrokeLog::recordMove(double x, double y)
+{
+	// Listeners only see integer cursor positions
+	pushEvent(SLET_MOVE, 0, 0, (int)x, (int)y);
+}
+
+void CStrokeLog::recordWheel(double offset)
+{
+	pushEvent(SLET_WHEEL, 0, 0, (int)offset, 0);
+}
+
+void CStrokeLog::pushEvent(StrokeLogEventType type, int code, int action, int x, int y)
+{
+	if (!m_isRecording || (action != GLFW_PRESS && action != GLFW_RELEASE && (type == SLET_KEY || type == SLET_BUTTON)))
+	{
+		return;
+	}
+
+	StrokeLogEvent event;
+	event.type = type;
+	event.time = CRenderUtilities::getTime() - m_startTime;
+	event.code = code;
+	event.action = action;
+	event.x = x;
+	event.y = y;
+
+	m_eventVec.push_back(event);
+}
+
+bool CStrokeLog::save(const string &logPath)
+{
+	vector<unsigned char> data;
+	writeVarint(data, m_eventVec.size());
+
+	double prevTime = 0.0;
+	int prevX = 0, prevY = 0;
+	for (int eventIdx = 0; eventIdx < m_eventVec.size(); ++eventIdx)
+	{
+		const StrokeLogEvent &event = m_eventVec[eventIdx];
+
+		data.push_back((unsigned char)event.type);
+		writeVarint(data, (uint)((event.time - prevTime) * 1000000.0 + 0.5));
+		prevTime += (uint)((event.time - prevTime) * 1000000.0 + 0.5) / 1000000.0;
+
+		switch (event.type)
+		{
+		case SLET_KEY:
+		case SLET_BUTTON:
+			writeVarint(data, event.code);
+			data.push_back((unsigned char)event.action);
+			break;
+		case SLET_MOVE:
+			writeVarint(data, zigzagEncode(event.x - prevX));
+			writeVarint(data, zigzagEncode(event.y - prevY));
+			prevX = event.x;
+			prevY = event.y;
+			break;
+		case SLET_WHEEL:
+			writeVarint(data, zigzagEncode(event.x));
+			break;
+		}
+	}
+
+	std::ofstream logFile(logPath.c_str(), std::ios::binary);
+	if (!logFile)
+	{
+		cout << "ERROR: Can't write stroke log " << logPath << "!" << endl;
+		return false;
+	}
+
+	logFile.write(s_strokeLogMagic, 4);
+	logFile.write((const char*)&s_strokeLogVersion, sizeof(uint));
+	logFile.write((const char*)&m_winWidth, sizeof(int));
+	logFile.write((const char*)&m_winHeight, sizeof(int));
+	logFile.write((const char*)m_camera, sizeof(m_camera));
+	logFile.write((const char*)&data[0], data.size());
+
+	return true;
+}
+
+bool CStrokeLog::load(const string &logPath)
+{
+	std::ifstream logFile(logPath.c_str(), std::ios::binary);
+	if (!logFile)
+	{
+		cout << "ERROR: Can't open stroke log " << logPath << "!" << endl;
+		return false;
+	}
+
+	char magic[4];
+	uint version;
+	logFile.read(magic, 4);
+	logFile.read((char*)&version, sizeof(uint));
+
+	if (!logFile || memcmp(magic, s_strokeLogMagic, 4) != 0 || version != s_strokeLogVersion)
+	{
+		cout << "ERROR: " << logPath << " is not a stroke log of version " << s_strokeLogVersion << "!" << endl;
+		return false;
+	}
+
+	logFile.read((char*)&m_winWidth, sizeof(int));
+	logFile.read((char*)&m_winHeight, sizeof(int));
+	logFile.read((char*)m_camera, sizeof(m_camera));
+
+	vector<unsigned char> data((std::istreambuf_iterator<char>(logFile)), std::istreambuf_iterator<char>());
+	if (data.empty())
+	{
+		cout << "ERROR: Stroke log " << logPath << " is truncated!" << endl;
+		return false;
+	}
+
+	// Varints never read past a terminating byte, pad so the last event of a truncated file can't overrun
+	const int paddingNum = 2;
+	data.insert(data.end(), paddingNum, 0);
+
+	const unsigned char *pData = &data[0];
+	const unsigned char *pDataEnd = &data[0] + data.size() - paddingNum;
+
+	// An event takes at least its type byte and a one byte time delta
+	uint eventNum = readVarint(pData);
+	if (pData > pDataEnd || eventNum > uint(pDataEnd - pData) / 2)
+	{
+		cout << "ERROR: Stroke log " << logPath << " declares " << eventNum << " events, more than it can hold!" << endl;
+		return false;
+	}
+	m_eventVec.resize(eventNum);
+
+	double time = 0.0;
+	int prevX = 0, prevY = 0;
+	uint eventIdx = 0;
+	for (; eventIdx < eventNum && pData < pDataEnd; ++eventIdx)
+	{
+		StrokeLogEvent &event = m_eventVec[eventIdx];
+
+		event.type = (StrokeLogEventType)*pData++;
+		time += readVarint(pData) / 1000000.0;
+		event.time = time;
+		event.code = event.action = event.x = event.y = 0;
+
+		bool valid = true;
+		switch (event.type)
+		{
+		case SLET_KEY:
+			event.code = readVarint(pData);
+			event.action = *pData++;
+			valid = event.code >= 1 && event.code <= GLFW_KEY_LAST;
+			break;
+		case SLET_BUTTON:
+			event.code = readVarint(pData);
+			event.action = *pData++;
+			valid = event.code >= 0 && event.code <= GLFW_MOUSE_BUTTON_LAST;
+			break;
+		case SLET_MOVE:
+			event.x = prevX += zigzagDecode(readVarint(pData));
+			event.y = prevY += zigzagDecode(readVarint(pData));
+			break;
+		case SLET_WHEEL:
+			event.x = zigzagDecode(readVarint(pData));
+			break;
+		default:
+			valid = false;
+			break;
+		}
+
+		if (!valid)
+		{
+			cout << "ERROR: Stroke log " << logPath << " is corrupt at event " << eventIdx << "!" << endl;
+			m_eventVec.clear();
+			return false;
+		}
+	}
+
+	// Reading into the padding means the last event was cut off
+	if (eventIdx != eventNum || pData > pDataEnd)
+	{
+		cout << "ERROR: Stroke log " << logPath << " is truncated!" << endl;
+		m_eventVec.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool CStrokeLog::startReplay(const string &logPath, const string &timingPath)
+{
+	if (m_isRecording || !load(logPath))
+	{
+		return false;
+	}
+
+	// Pick buffers are sized from the config, so the window has to match the recording
+	int winWidth, winHeight;
+	CRenderSystemConfig::getSysCfgInstance()->getWinSize(winWidth, winHeight);
+	if (winWidth != m_winWidth || winHeight != m_winHeight)
+	{
+		cout << "ERROR: Stroke log was recorded at " << m_winWidth << "x" << m_winHeight
+			<< ", set WindowSize to match before replaying!" << endl;
+		return false;
+	}
+
+	CCamera *pCamera = CViewer::getViewerInstance()->getCamera();
+	pCamera->m_fov = m_camera[0];
+	pCamera->m_nearPlane = m_camera[1];
+	pCamera->m_farPlane = m_camera[2];
+	pCamera->m_head = m_camera[3];
+	pCamera->m_pitch = m_camera[4];
+	pCamera->m_radius = m_camera[5];
+	pCamera->m_lookX = m_camera[6];
+	pCamera->m_lookY = m_camera[7];
+	pCamera->m_lookZ = m_camera[8];
+
+	m_logPath = logPath;
+	m_timingPath = timingPath;
+	m_replayEventIdx = 0;
+	m_replayFirstStroke = CPaintPathes::Instance()->getStrokeTimingVec().size();
+	m_replayStartTime = CRenderUtilities::getTime();
+	m_isReplaying = true;
+
+	cout << "Info: Replaying " << m_eventVec.size() << " input events from " << logPath << endl;
+
+	return true;
+}
+
+// Events are dispatched by order, not by their timestamps, so the results don't depend on frame rate
+void CStrokeLog::replayFrame()
+{
+	if (!m_isReplaying)
+	{
+		return;
+	}
+
+	while (m_replayEventIdx < m_eventVec.size())
+	{
+		const StrokeLogEvent &event = m_eventVec[m_replayEventIdx++];
+
+		switch (event.type)
+		{
+		case SLET_KEY:
+			CEventManager::keyCallback(NULL, event.code, 0, event.action, 0);
+			return;
+		case SLET_BUTTON:
+			CEventManager::mouseButtonCallback(NULL, event.code, event.action, 0);
+			break;
+		case SLET_MOVE:
+			CEventManager::mousePosCallback(NULL, event.x, event.y);
+			break;
+		case SLET_WHEEL:
+			CEventManager::mouseWheelCallback(NULL, 0.0, event.x);
+			break;
+		}
+	}
+
+	if (CPaintPathes::Instance()->isIdle())
+	{
+		finishReplay();
+	}
+}
+
+void CStrokeLog::finishReplay()
+{
+	m_isReplaying = false;
+
+	const vector<StrokeTiming> &timingVec = CPaintPathes::Instance()->getStrokeTimingVec();
+
+	cout << "Info: Replayed " << timingVec.size() - m_replayFirstStroke << " strokes from " << m_logPath << " in "
+		<< (CRenderUtilities::getTime() - m_replayStartTime) * 1000.0 << " ms" << endl;
+
+	if (!m_timingPath.empty())
+	{
+		std::ofstream timingFile(m_timingPath.c_str());
+		if (!timingFile)
+		{
+			cout << "ERROR: Can't write stroke timing " << m_timingPath << "!" << endl;
+		}
+		else
+		{
+			timingFile << "stroke,points,seeds,band_vertices,condition_ms,pick_ms,unproject_ms,seed_ms,march_ms,parametrize_ms,upload_ms" << endl;
+
+			for (int strokeIdx = m_replayFirstStroke; strokeIdx < timingVec.size(); ++strokeIdx)
+			{
+				const StrokeTiming &timing = timingVec[strokeIdx];
+
+				timingFile << strokeIdx - m_replayFirstStroke << "," << timing.pointNum << "," << timing.seedNum << "," << timing.bandVerNum;
+				for (int stageIdx = 0; stageIdx < SS_TOTALNUM; ++stageIdx)
+				{
+					timingFile << "," << timing.stageTime[stageIdx] * 1000.0;
+				}
+				timingFile << endl;
+			}
+
+			cout << "Info: Stroke timing written to " << m_timingPath << endl;
+		}
+	}
+
+	CRenderSystem::Instance()->requestClose();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+enum StrokeLogEventType
+{
+	SLET_KEY = 0,
+	SLET_BUTTON,
+	SLET_MOVE,
+	SLET_WHEEL
+};
+
+struct StrokeLogEvent
+{
+	StrokeLogEventType type;
+	double time;		// Seconds since recording started
+	int code;			// Key or mouse button
+	int action;			// GLFW_PRESS or GLFW_RELEASE
+	int x, y;			// Cursor position, or wheel offset in x
+};
+
+// Input recorded at the event manager, with the camera and window size it started from.
+// File layout: "TBSL", version, window size, camera, event number, then per event a type byte,
+// the time delta in microseconds and its payload, with cursor positions as deltas. All
+// integers after the header are varints, signed ones zigzag encoded.
+class CStrokeLog
+{
+public:
+	static CStrokeLog* Instance();
+	virtual ~CStrokeLog();
+
+	void startRecording(const string &logPath);
+	void stopRecording();
+	bool isRecording(){ return m_isRecording; }
+
+	void recordKey(int key, int action);
+	void recordButton(int button, int action);
+	void recordMove(double x, double y);
+	void recordWheel(double offset);
+
+	// Replay feeds the events back through the event manager, the timing CSV gets one row per stroke
+	bool startReplay(const string &logPath, const string &timingPath);
+	bool isReplaying(){ return m_isReplaying; }
+
+	// Dispatch the events of one frame, a key event ends the frame so the pick pass can see it
+	void replayFrame();
+
+	// Log of a single sketch with one path of the given number of points, spiralling out from the window
+	// center at one pixel per point. Replayed with a timing CSV it benchmarks long strokes reproducibly.
+	bool writeSpiralStroke(const string &logPath, int pointNum);
+
+protected:
+	CStrokeLog();
+
+	// Window size and camera the log starts from
+	void captureStartState();
+	void pushEvent(StrokeLogEventType type, int code, int action, int x, int y);
+	bool save(const string &logPath);
+	bool load(const string &logPath);
+	void finishReplay();
+
+private:
+	bool m_isRecording;
+	bool m_isReplaying;
+
+	string m_logPath;
+	string m_timingPath;
+	double m_startTime;
+
+	int m_winWidth, m_winHeight;
+	float m_camera[9];	// fov, near, far, head, pitch, radius, look at x, y, z
+
+	vector<StrokeLogEvent> m_eventVec;
+	int m_replayEventIdx;
+	int m_replayFirstStroke;
+	double m_replayStartTime;
+};
+
+}
@@ -29,7 +29,9 @@ std::map<std::string, TexelFormat>::value_type str2TexelFmtValues[] =
 	std::map<std::string, TexelFormat>::value_type("TEXELFMT_RGBA", TEXELFMT_RGBA),
 	std::map<std::string, TexelFormat>::value_type("TEXELFMT_BGRA", TEXELFMT_BGRA),
 	std::map<std::string, TexelFormat>::value_type("TEXELFMT_LUMILLANCE", TEXELFMT_LUMILLANCE),
-	std::map<std::string, TexelFormat>::value_type("TEXELFMT_LUMILLANCE_ALPHA", TEXELFMT_LUMILLANCE_ALPHA)
+	std::map<std::string, TexelFormat>::value_type("TEXELFMT_LUMILLANCE_ALPHA", TEXELFMT_LUMILLANCE_ALPHA),
+	std::map<std::string, TexelFormat>::value_type("TEXELFMT_RED_INTEGER", TEXELFMT_RED_INTEGER),
+	std::map<std::string, TexelFormat>::value_type("TEXELFMT_DEPTH_COMPONENT", TEXELFMT_DEPTH_COMPONENT)
 };
 
 std::map<std::string, TexelType>::value_type str2TexelTypeValues[] =
@@ -54,7 +56,9 @@ std::map<TexelFormat, int>::value_type texFmt2ChannelNumValues[] =
 	std::map<TexelFormat, int>::value_type(TEXELFMT_RGBA, 4),
 	std::map<TexelFormat, int>::value_type(TEXELFMT_BGRA, 4),
 	std::map<TexelFormat, int>::value_type(TEXELFMT_LUMILLANCE, 1),
-	std::map<TexelFormat, int>::value_type(TEXELFMT_LUMILLANCE_ALPHA, 1)
+	std::map<TexelFormat, int>::value_type(TEXELFMT_LUMILLANCE_ALPHA, 1),
+	std::map<TexelFormat, int>::value_type(TEXELFMT_RED_INTEGER, 1),
+	std::map<TexelFormat, int>::value_type(TEXELFMT_DEPTH_COMPONENT, 1)
 };
 
 std::map<TexelType, int>::value_type str2TexelByteNumValues[] =
@@ -71,7 +75,7 @@ std::map<TexelType, int>::value_type str2TexelByteNumValues[] =
 };
 
 std::map<std::string, TextureType> CTexturePropMap::s_str2TexType(str2TexTypeValues, str2TexTypeValues + 11);
-std::map<std::string, TexelFormat> CTexturePropMap::s_str2TexelFmt(str2TexelFmtValues, str2TexelFmtValues + 8);
-std::map<TexelFormat, int> CTexturePropMap::s_fmt2ChannelNum(texFmt2ChannelNumValues, texFmt2ChannelNumValues + 8);
+std::map<std::string, TexelFormat> CTexturePropMap::s_str2TexelFmt(str2TexelFmtValues, str2TexelFmtValues + 10);
+std::map<TexelFormat, int> CTexturePropMap::s_fmt2ChannelNum(texFmt2ChannelNumValues, texFmt2ChannelNumValues + 10);
 std::map<std::string, TexelType> CTexturePropMap::s_str2TexelType(str2TexelTypeValues, str2TexelTypeValues + 9);
 std::map<TexelType, int> CTexturePropMap::s_type2ByteNum(str2TexelByteNumValues, str2TexelByteNumValues + 9);
\ No newline at end of file
@@ -34,6 +34,8 @@ enum TexelFormat
 	TEXELFMT_BGRA = GL_BGRA,
 	TEXELFMT_LUMILLANCE = GL_LUMINANCE,
 	TEXELFMT_LUMILLANCE_ALPHA = GL_LUMINANCE_ALPHA,
+	TEXELFMT_RED_INTEGER = GL_RED_INTEGER,
+	TEXELFMT_DEPTH_COMPONENT = GL_DEPTH_COMPONENT,
 };
 
 enum TexelType
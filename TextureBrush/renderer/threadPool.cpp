@@ -0,0 +1,135 @@
+#include "threadPool.h"
+
+#include "traceRecorder.h"
+#include "renderSystemConfig.h"
+
+using namespace TextureSynthesis;
+
+CThreadPool* CThreadPool::Instance()
+{
+	static CThreadPool *s_pThreadPool = NULL;
+
+	// First created by the BVH build while loading, before the stroke worker starts
+	if (s_pThreadPool == NULL)
+	{
+		int pickSource, threadNum;
+		CRenderSystemConfig::getSysCfgInstance()->getSoftwarePick(pickSource, threadNum);
+		s_pThreadPool = new CThreadPool(threadNum);
+
+		cout << "Info: Shared thread pool of " << s_pThreadPool->getThreadNum() << " threads" << endl;
+	}
+
+	return s_pThreadPool;
+}
+
+CThreadPool::CThreadPool(int threadNum) : m_busy(false), m_pTask(NULL), m_taskNum(0), m_nextTaskIdx(0), m_generation(0), m_busyWorkerNum(0), m_stop(false)
+{
+	if (threadNum <= 0)
+	{
+		threadNum = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	for (int threadIdx = 1; threadIdx < threadNum; ++threadIdx)
+	{
+		m_workerVec.push_back(std::thread(&CThreadPool::workerLoop, this));
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeCond.notify_all();
+
+	for (int threadIdx = 0; threadIdx < m_workerVec.size(); ++threadIdx)
+	{
+		m_workerVec[threadIdx].join();
+	}
+}
+
+void CThreadPool::parallelFor(int taskNum, const std::function<void(int)> &task)
+{
+	if (taskNum <= 0)
+	{
+		return;
+	}
+
+	// Busy with another thread's tasks, or called from one of them
+	if (m_busy.exchange(true))
+	{
+		for (int taskIdx = 0; taskIdx < taskNum; ++taskIdx)
+		{
+			task(taskIdx);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pTask = &task;
+		m_taskNum = taskNum;
+		m_nextTaskIdx = 0;
+		m_busyWorkerNum = m_workerVec.size();
+		++m_generation;
+	}
+	m_wakeCond.notify_all();
+
+	runTasks();
+
+	// Workers may still hold the task after the last index is taken
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_busyWorkerNum > 0)
+	{
+		m_doneCond.wait(lock);
+	}
+	m_pTask = NULL;
+
+	m_busy = false;
+}
+
+void CThreadPool::workerLoop()
+{
+	TRACE_THREAD_NAME("pool worker");
+
+	unsigned int seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_stop && m_generation == seenGeneration)
+			{
+				m_wakeCond.wait(lock);
+			}
+
+			if (m_stop)
+			{
+				return;
+			}
+
+			seenGeneration = m_generation;
+		}
+
+		{
+			TRACE_SCOPE("poolTasks");
+			runTasks();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busyWorkerNum == 0)
+		{
+			m_doneCond.notify_one();
+		}
+	}
+}
+
+void CThreadPool::runTasks()
+{
+	int taskIdx;
+	while ((taskIdx = m_nextTaskIdx++) < m_taskNum)
+	{
+		(*m_pTask)(taskIdx);
+	}
+}
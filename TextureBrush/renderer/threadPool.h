@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../preHeader.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace TextureSynthesis
+{
+
+// Fixed set of worker threads running index ranges in parallel, the calling thread helps out.
+// One parallelFor at a time, a call made while the pool is busy runs on the calling thread alone.
+class CThreadPool
+{
+public:
+	// Shared by the BVH, the kd-tree and the software rasterizer, sized by the SoftwarePick thread number
+	static CThreadPool* Instance();
+
+	// 0 threads means one per hardware thread, the calling thread included
+	explicit CThreadPool(int threadNum = 0);
+	virtual ~CThreadPool();
+
+	// Run task(taskIdx) for every taskIdx in [0, taskNum), returns when all of them are done
+	void parallelFor(int taskNum, const std::function<void(int)> &task);
+
+	int getThreadNum(){ return m_workerVec.size() + 1; }
+
+private:
+	void workerLoop();
+	void runTasks();
+
+private:
+	vector<std::thread> m_workerVec;
+
+	// Set while a parallelFor runs
+	std::atomic<bool> m_busy;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCond;
+	std::condition_variable m_doneCond;
+
+	const std::function<void(int)> *m_pTask;
+	int m_taskNum;
+	std::atomic<int> m_nextTaskIdx;
+	unsigned int m_generation;
+	int m_busyWorkerNum;
+	bool m_stop;
+};
+
+}
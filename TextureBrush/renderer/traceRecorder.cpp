@@ -0,0 +1,202 @@
+#include "traceRecorder.h"
+
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace TextureSynthesis;
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+// Power of two, so slots are picked by masking the write count
+static const unsigned int s_traceBufferSize = 1 << 16;
+
+static TRACE_THREAD_LOCAL TraceThreadBuffer *s_pThreadBuffer = NULL;
+
+CTraceRecorder* CTraceRecorder::Instance()
+{
+	static CTraceRecorder *s_pTraceRecorder = NULL;
+
+	if (s_pTraceRecorder == NULL)
+	{
+		s_pTraceRecorder = new CTraceRecorder();
+	}
+
+	return s_pTraceRecorder;
+}
+
+CTraceRecorder::CTraceRecorder() : m_startTimeNs(getTimeNs()), m_dumpPath("trace.json")
+{
+}
+
+// Buffers outlive their threads so late dumps still see them
+CTraceRecorder::~CTraceRecorder()
+{
+	for (int bufferIdx = 0; bufferIdx < m_bufferVec.size(); ++bufferIdx)
+	{
+		SAFE_DELETE(m_bufferVec[bufferIdx]);
+	}
+}
+
+bool CTraceRecorder::isEnabled()
+{
+#ifdef TEXTUREBRUSH_TRACE
+	return true;
+#else
+	return false;
+#endif
+}
+
+unsigned long long CTraceRecorder::getTimeNs()
+{
+#ifdef _WIN32
+	// The standard clocks of older MSVC tick in milliseconds
+	static LARGE_INTEGER s_frequency = { 0 };
+	if (s_frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&s_frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	unsigned long long ticks = counter.QuadPart;
+	unsigned long long frequency = s_frequency.QuadPart;
+	return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The buffer is registered under the lock once per thread, recording itself never locks
+TraceThreadBuffer* CTraceRecorder::getThreadBuffer()
+{
+	if (s_pThreadBuffer == NULL)
+	{
+		TraceThreadBuffer *pBuffer = new TraceThreadBuffer();
+		pBuffer->eventVec.resize(s_traceBufferSize);
+		pBuffer->writeCount = 0;
+		pBuffer->threadName = NULL;
+
+		std::lock_guard<std::mutex> lock(m_bufferMutex);
+		pBuffer->threadIdx = m_bufferVec.size() + 1;
+		m_bufferVec.push_back(pBuffer);
+
+		s_pThreadBuffer = pBuffer;
+	}
+
+	return s_pThreadBuffer;
+}
+
+void CTraceRecorder::recordEvent(const char *name, TraceEventPhase phase)
+{
+	TraceThreadBuffer *pBuffer = getThreadBuffer();
+
+	unsigned long long writeCount = pBuffer->writeCount.load(std::memory_order_relaxed);
+
+	TraceEvent &event = pBuffer->eventVec[writeCount & (s_traceBufferSize - 1)];
+	event.name = name;
+	event.timeNs = getTimeNs();
+	event.phase = phase;
+
+	pBuffer->writeCount.store(writeCount + 1, std::memory_order_release);
+}
+
+void CTraceRecorder::setThreadName(const char *name)
+{
+	getThreadBuffer()->threadName = name;
+}
+
+bool CTraceRecorder::dump(const string &jsonPath)
+{
+	if (!isEnabled())
+	{
+		cout << "WARNING: Tracing isn't compiled in, define TEXTUREBRUSH_TRACE to record a trace!" << endl;
+		return false;
+	}
+
+	std::ofstream jsonFile(jsonPath.c_str());
+	if (!jsonFile)
+	{
+		cout << "ERROR: Can't write trace " << jsonPath << "!" << endl;
+		return false;
+	}
+
+	vector<TraceThreadBuffer*> bufferVec;
+	{
+		std::lock_guard<std::mutex> lock(m_bufferMutex);
+		bufferVec = m_bufferVec;
+	}
+
+	jsonFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+
+	const char *phaseNames[3] = { "B", "E", "i" };
+	char line[256];
+	bool firstLine = true;
+	int eventNum = 0;
+
+	for (int bufferIdx = 0; bufferIdx < bufferVec.size(); ++bufferIdx)
+	{
+		TraceThreadBuffer *pBuffer = bufferVec[bufferIdx];
+
+		unsigned long long endCount = pBuffer->writeCount.load(std::memory_order_acquire);
+		unsigned long long beginCount = endCount > s_traceBufferSize ? endCount - s_traceBufferSize : 0;
+
+		vector<TraceEvent> eventVec;
+		eventVec.reserve((size_t)(endCount - beginCount));
+		for (unsigned long long count = beginCount; count != endCount; ++count)
+		{
+			eventVec.push_back(pBuffer->eventVec[count & (s_traceBufferSize - 1)]);
+		}
+
+		// Slots the owner wrapped around to while they were copied are torn, skip them. That includes
+		// the slot of count writeCount, which the owner may be writing right now.
+		unsigned long long writeCount = pBuffer->writeCount.load(std::memory_order_acquire);
+		unsigned long long validCount = writeCount + 1 > s_traceBufferSize ? writeCount + 1 - s_traceBufferSize : 0;
+		int firstEvent = validCount > beginCount ? (int)std::min(validCount - beginCount, (unsigned long long)eventVec.size()) : 0;
+
+		if (pBuffer->threadName != NULL)
+		{
+			sprintf(line, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				firstLine ? "" : ",\n", pBuffer->threadIdx, pBuffer->threadName);
+			jsonFile << line;
+			firstLine = false;
+		}
+
+		// The window may start inside scopes, their end events have no begin to match
+		int depth = 0;
+		for (int eventIdx = firstEvent; eventIdx < eventVec.size(); ++eventIdx)
+		{
+			const TraceEvent &event = eventVec[eventIdx];
+			if (event.phase == TEP_END && depth == 0)
+			{
+				continue;
+			}
+			depth += event.phase == TEP_BEGIN ? 1 : (event.phase == TEP_END ? -1 : 0);
+
+			double timeUs = (event.timeNs >= m_startTimeNs ? event.timeNs - m_startTimeNs : 0) / 1000.0;
+			sprintf(line, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s}",
+				firstLine ? "" : ",\n", event.name, phaseNames[event.phase], timeUs, pBuffer->threadIdx,
+				event.phase == TEP_INSTANT ? ",\"s\":\"t\"" : "");
+			jsonFile << line;
+			firstLine = false;
+			++eventNum;
+		}
+	}
+
+	jsonFile << endl << "]}" << endl;
+
+	cout << "Info: " << eventNum << " trace events of " << bufferVec.size() << " threads written to " << jsonPath << endl;
+
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../preHeader.h"
+
+#include <atomic>
+#include <mutex>
+
+// Tracing is compiled in with TEXTUREBRUSH_TRACE, otherwise the macros expand to nothing.
+// Names must be string literals, only their pointers are recorded.
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TEXTUREBRUSH_TRACE
+#define TRACE_SCOPE(name) TextureSynthesis::CTraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(name) TextureSynthesis::CTraceRecorder::Instance()->recordEvent(name, TextureSynthesis::TEP_BEGIN)
+#define TRACE_END(name) TextureSynthesis::CTraceRecorder::Instance()->recordEvent(name, TextureSynthesis::TEP_END)
+#define TRACE_INSTANT(name) TextureSynthesis::CTraceRecorder::Instance()->recordEvent(name, TextureSynthesis::TEP_INSTANT)
+#define TRACE_THREAD_NAME(name) TextureSynthesis::CTraceRecorder::Instance()->setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+namespace TextureSynthesis
+{
+
+enum TraceEventPhase
+{
+	TEP_BEGIN = 0,
+	TEP_END,
+	TEP_INSTANT
+};
+
+struct TraceEvent
+{
+	const char *name;
+	unsigned long long timeNs;
+	int phase;
+};
+
+// Events of one thread. Only the owning thread writes, it publishes a slot by advancing
+// writeCount, so a dump can read the others' buffers without locking them. The count is 64 bit
+// so it never wraps and the dump can compare counts directly.
+struct TraceThreadBuffer
+{
+	vector<TraceEvent> eventVec;
+	std::atomic<unsigned long long> writeCount;
+	int threadIdx;
+	const char *threadName;
+};
+
+// Ring buffers of begin and end events per thread, written as a chrome://tracing JSON file on request.
+// A buffer keeps the latest 64K events of its thread, older ones are overwritten.
+class CTraceRecorder
+{
+public:
+	static CTraceRecorder* Instance();
+	virtual ~CTraceRecorder();
+
+	void recordEvent(const char *name, TraceEventPhase phase);
+	void setThreadName(const char *name);
+
+	// Events recorded so far, safe to call while other threads keep tracing
+	bool dump(const string &jsonPath);
+
+	// Target of dumps on request, trace.json unless set
+	void setDumpPath(const string &jsonPath){ m_dumpPath = jsonPath; }
+	const string& getDumpPath(){ return m_dumpPath; }
+
+	static bool isEnabled();
+
+protected:
+	CTraceRecorder();
+
+	TraceThreadBuffer* getThreadBuffer();
+	static unsigned long long getTimeNs();
+
+private:
+	std::mutex m_bufferMutex;
+	vector<TraceThreadBuffer*> m_bufferVec;
+
+	unsigned long long m_startTimeNs;
+	string m_dumpPath;
+};
+
+class CTraceScope
+{
+public:
+	explicit CTraceScope(const char *name) : m_name(name)
+	{
+		CTraceRecorder::Instance()->recordEvent(m_name, TEP_BEGIN);
+	}
+
+	~CTraceScope()
+	{
+		CTraceRecorder::Instance()->recordEvent(m_name, TEP_END);
+	}
+
+private:
+	const char *m_name;
+};
+
+}
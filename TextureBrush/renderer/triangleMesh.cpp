@@ -1,11 +1,14 @@
 #include "triangleMesh.h"
 
+#include <algorithm>
+
 using namespace TextureSynthesis;
 
 CTriangleMesh::CTriangleMesh(TriMeshShadeMode shadeMode) : m_shadeMode(shadeMode)
 {
 	m_numVers = 0;
 	m_numTris = 0;
+	m_geometryVersion = 0;
 
 	m_v = NULL;
 	m_n = NULL;
@@ -14,6 +17,9 @@ CTriangleMesh::CTriangleMesh(TriMeshShadeMode shadeMode) : m_shadeMode(shadeMode
 	m_texCoords = NULL;
 	m_idxMaterial = NULL;
 
+	m_verFaceOffset = NULL;
+	m_verFaceIdx = NULL;
+
 	m_tangent = NULL;
 	m_biTangent = NULL;
 
@@ -38,6 +44,7 @@ void CTriangleMesh::load(const std::string& strFile)
 		return;
 
 	m_strSceneFile = strFile;
+	++m_geometryVersion;
 
 	int tempNumPoints = 0;	// Number of x,y,z coordinate triples
 	int tempNumFaces = 0;	// Number of polygon sets
@@ -155,6 +162,7 @@ void CTriangleMesh::postProcess()
 	else
 	{
 		computeSmoothNormal();
+		buildVertexFaceAdjacency();
 	}
 }
 
@@ -275,6 +283,9 @@ void CTriangleMesh::unload()
 
 	SAFE_DELETE_ARRAY(m_idxMaterial);
 
+	SAFE_DELETE_ARRAY(m_verFaceOffset);
+	SAFE_DELETE_ARRAY(m_verFaceIdx);
+
 	SAFE_DELETE_ARRAY(m_tangent);
 	SAFE_DELETE_ARRAY(m_biTangent);
 
@@ -287,8 +298,14 @@ void CTriangleMesh::unload()
 
 	SAFE_DELETE_ARRAY(m_propUInt);
 
+	for (int channel = 0; channel < TMPC_TOTALNUM; ++channel)
+	{
+		clearPropDirty((TriMeshPropChannel)channel);
+	}
+
 	m_numVers = 0;
 	m_numTris = 0;
+	++m_geometryVersion;
 }
 
 void CTriangleMesh::setVertex(vec3* pVertices, int vNum)
@@ -302,6 +319,7 @@ void CTriangleMesh::setVertex(vec3* pVertices, int vNum)
 	m_numVers = vNum;
 	m_v = new vec3[vNum];
 	memcpy(m_v, pVertices, sizeof(vec3) * vNum);
+	++m_geometryVersion;
 }
 
 void CTriangleMesh::setVerNormal(vec3* pNormals, int vNum)
@@ -332,6 +350,7 @@ void CTriangleMesh::setIndices(ivec3* pIndices, int vNum)
 	m_numTris = vNum;
 	m_i = new ivec3[vNum];
 	memcpy(m_i, pIndices, sizeof(ivec3) * vNum);
+	++m_geometryVersion;
 }
 
 void CTriangleMesh::setTexcoords(vec3* pTexcoords, int vNum)
@@ -400,6 +419,110 @@ void CTriangleMesh::setPropFloat(float *pPropData, int vNum)
 
 	m_propFloat = new float[vNum];
 	memcpy(m_propFloat, pPropData, sizeof(float)* vNum);
+
+	markPropDirty(TMPC_FLOAT, 0, vNum);
+}
+
+void CTriangleMesh::updatePropFloat(const float *pPropData, int startIdx, int vNum)
+{
+	if (startIdx < 0 || startIdx + vNum > m_numVers)
+	{
+		std::cout << "ERROR: Float property update out of vertex range!" << std::endl;
+		return;
+	}
+
+	if (m_propFloat == NULL)
+	{
+		m_propFloat = new float[m_numVers];
+		memset(m_propFloat, 0, sizeof(float)* m_numVers);
+		markPropDirty(TMPC_FLOAT, 0, m_numVers);
+	}
+
+	// Only record runs of values which actually change
+	int runStart = -1;
+	float *pDst = m_propFloat + startIdx;
+	for (int idx = 0; idx < vNum; ++idx)
+	{
+		if (pDst[idx] != pPropData[idx])
+		{
+			pDst[idx] = pPropData[idx];
+			if (runStart < 0)
+			{
+				runStart = idx;
+			}
+		}
+		else if (runStart >= 0)
+		{
+			markPropDirty(TMPC_FLOAT, startIdx + runStart, startIdx + idx);
+			runStart = -1;
+		}
+	}
+
+	if (runStart >= 0)
+	{
+		markPropDirty(TMPC_FLOAT, startIdx + runStart, startIdx + vNum);
+	}
+}
+
+void CTriangleMesh::markPropDirty(TriMeshPropChannel channel, int startIdx, int endIdx)
+{
+	if (startIdx >= endIdx)
+	{
+		return;
+	}
+
+	vector<ivec2> &ranges = m_propDirtyRanges[channel];
+
+	// Extend the last range when ranges come in increasing order, which is the common case
+	if (!ranges.empty())
+	{
+		ivec2 &lastRange = ranges.back();
+		if (startIdx >= lastRange[0] && startIdx <= lastRange[1])
+		{
+			lastRange[1] = max(lastRange[1], endIdx);
+			return;
+		}
+	}
+
+	ranges.push_back(ivec2(startIdx, endIdx));
+}
+
+static bool compareRangeStart(const ivec2 &a, const ivec2 &b)
+{
+	return a[0] < b[0];
+}
+
+// Sort and merge dirty ranges, ranges closer than mergeGap elements are joined
+void CTriangleMesh::getMergedDirtyRanges(TriMeshPropChannel channel, vector<ivec2> &ranges, int mergeGap)
+{
+	ranges = m_propDirtyRanges[channel];
+	if (ranges.size() < 2)
+	{
+		return;
+	}
+
+	std::sort(ranges.begin(), ranges.end(), compareRangeStart);
+
+	int mergedNum = 0;
+	for (int idx = 1; idx < ranges.size(); ++idx)
+	{
+		if (ranges[idx][0] <= ranges[mergedNum][1] + mergeGap)
+		{
+			ranges[mergedNum][1] = max(ranges[mergedNum][1], ranges[idx][1]);
+		}
+		else
+		{
+			++mergedNum;
+			ranges[mergedNum] = ranges[idx];
+		}
+	}
+
+	ranges.resize(mergedNum + 1);
+}
+
+void CTriangleMesh::clearPropDirty(TriMeshPropChannel channel)
+{
+	m_propDirtyRanges[channel].clear();
 }
 
 void CTriangleMesh::setPropFloat2(vec2 *pPropData, int vNum)
@@ -412,11 +535,13 @@ void CTriangleMesh::setPropFloat2(vec2 *pPropData, int vNum)
 
 	if (m_propFloat2 != NULL)
 	{
-		SAFE_DELETE_ARRAY(m_propFloat);
+		SAFE_DELETE_ARRAY(m_propFloat2);
 	}
 
 	m_propFloat2 = new vec2[vNum];
 	memcpy(m_propFloat2, pPropData, sizeof(vec2)* vNum);
+
+	markPropDirty(TMPC_FLOAT2, 0, vNum);
 }
 
 void CTriangleMesh::setPropInt(int *pPropData, int vNum)
@@ -434,6 +559,8 @@ void CTriangleMesh::setPropInt(int *pPropData, int vNum)
 
 	m_propInt = new int[vNum];
 	memcpy(m_propInt, pPropData, sizeof(int)* vNum);
+
+	markPropDirty(TMPC_INT, 0, vNum);
 }
 
 void CTriangleMesh::setPropUInt(uint *pPropData, int vNum)
@@ -451,6 +578,8 @@ void CTriangleMesh::setPropUInt(uint *pPropData, int vNum)
 
 	m_propUInt = new uint[vNum];
 	memcpy(m_propUInt, pPropData, sizeof(uint)* vNum);
+
+	markPropDirty(TMPC_UINT, 0, vNum);
 }
 
 void CTriangleMesh::windTriVertexIdxOrder()
@@ -463,6 +592,8 @@ void CTriangleMesh::windTriVertexIdxOrder()
 
 void CTriangleMesh::normalize()
 {
+	++m_geometryVersion;
+
 	vec3 center = m_boundMin + m_boundMax;
 	center *= 0.5f;
 
@@ -573,6 +704,41 @@ void CTriangleMesh::computeSmoothNormal()
 	}
 }
 
+void CTriangleMesh::buildVertexFaceAdjacency()
+{
+	SAFE_DELETE_ARRAY(m_verFaceOffset);
+	SAFE_DELETE_ARRAY(m_verFaceIdx);
+
+	m_verFaceOffset = new int[m_numVers + 1];
+	m_verFaceIdx = new int[m_numTris * 3];
+	memset(m_verFaceOffset, 0, sizeof(int)* (m_numVers + 1));
+
+	// Count faces per vertex, then prefix sum into row offsets
+	for (int triIdx = 0; triIdx < m_numTris; ++triIdx)
+	{
+		m_verFaceOffset[m_i[triIdx][0] + 1]++;
+		m_verFaceOffset[m_i[triIdx][1] + 1]++;
+		m_verFaceOffset[m_i[triIdx][2] + 1]++;
+	}
+
+	for (int verIdx = 0; verIdx < m_numVers; ++verIdx)
+	{
+		m_verFaceOffset[verIdx + 1] += m_verFaceOffset[verIdx];
+	}
+
+	int *pFillPos = new int[m_numVers];
+	memcpy(pFillPos, m_verFaceOffset, sizeof(int)* m_numVers);
+
+	for (int triIdx = 0; triIdx < m_numTris; ++triIdx)
+	{
+		m_verFaceIdx[pFillPos[m_i[triIdx][0]]++] = triIdx;
+		m_verFaceIdx[pFillPos[m_i[triIdx][1]]++] = triIdx;
+		m_verFaceIdx[pFillPos[m_i[triIdx][2]]++] = triIdx;
+	}
+
+	SAFE_DELETE_ARRAY(pFillPos);
+}
+
 void CTriangleMesh::checkMatch(int vNum)
 {
 	if (m_shadeMode == TMSM_FLAT)
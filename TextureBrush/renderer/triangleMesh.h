@@ -12,6 +12,18 @@ enum TriMeshShadeMode
 	TMSM_SMOOTH = GL_SMOOTH
 };
 
+// Attached per-vertex property channels whose modified index ranges are tracked
+enum TriMeshPropChannel
+{
+	TMPC_FLOAT = 0,
+	TMPC_FLOAT2,
+	TMPC_FLOAT3,
+	TMPC_FLOAT4,
+	TMPC_INT,
+	TMPC_UINT,
+	TMPC_TOTALNUM
+};
+
 class CTriangleMesh
 {
 public:
@@ -34,6 +46,15 @@ public:
 	void setPropInt(int *pPropData, int vNum);
 	void setPropUInt(uint *pPropData, int vNum);
 
+	// Overwrite part of the float property in place, only changed values are marked dirty
+	void updatePropFloat(const float *pPropData, int startIdx, int vNum);
+
+	// Dirty index ranges [start, end) of attached properties, consumed by vertex buffer uploads
+	void markPropDirty(TriMeshPropChannel channel, int startIdx, int endIdx);
+	void getMergedDirtyRanges(TriMeshPropChannel channel, vector<ivec2> &ranges, int mergeGap = 0);
+	void clearPropDirty(TriMeshPropChannel channel);
+	bool isPropDirty(TriMeshPropChannel channel){ return !m_propDirtyRanges[channel].empty(); }
+
 	void setTangent(vec3* pTangents, int vNum);
 	void setBiTangent(vec3* pBiTangents, int vNum);
 
@@ -48,6 +69,8 @@ public:
 	const BasicMaterial& getMaterial(size_t idx) { return m_vecMaterials.at(idx); }
 	int getVerNum() { return m_numVers; }
 	int getTriNum() { return m_numTris; }
+	// Bumped whenever vertex positions or triangles change
+	uint getGeometryVersion() { return m_geometryVersion; }
 	vec3 getBoundMin() { return m_boundMin; }
 	vec3 getBoundMax() { return m_boundMax; }
 	vec3* getVertices()  { return m_v; }
@@ -66,11 +89,16 @@ public:
 	int* getPropIntData(){ return m_propInt; }
 	uint* getPropUIntData(){ return m_propUInt; }
 
+	// Faces around vertex v are m_verFaceIdx[m_verFaceOffset[v]] .. m_verFaceIdx[m_verFaceOffset[v + 1] - 1]
+	const int* getVerFaceOffsets(){ return m_verFaceOffset; }
+	const int* getVerFaceIndices(){ return m_verFaceIdx; }
+
 	void windTriVertexIdxOrder();
 	void normalize();
 	void computeBoundingBox();
 	void computeFlatNormal();
 	void computeSmoothNormal();
+	void buildVertexFaceAdjacency();
 
 private:
 	void checkMatch(int vNum);
@@ -90,6 +118,7 @@ protected:
 
 	int m_numVers;
 	int m_numTris;
+	uint m_geometryVersion;
 
 	vec3 m_boundMin;
 	vec3 m_boundMax;
@@ -108,6 +137,10 @@ protected:
 	// So at most three-dimensional textures are supported. 
 	vec3* m_texCoords;
 
+	// Vertex to face adjacency in compressed rows
+	int* m_verFaceOffset;
+	int* m_verFaceIdx;
+
 	// Tangent and Bitangent
 	vec3* m_tangent;
 	vec3* m_biTangent;
@@ -120,6 +153,9 @@ protected:
 
 	int *m_propInt;
 	uint *m_propUInt;
+
+	// Modified index ranges per property channel since last upload
+	vector<ivec2> m_propDirtyRanges[TMPC_TOTALNUM];
 };
 
 } // end namespace
\ No newline at end of file
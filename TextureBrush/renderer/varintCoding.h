@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../preHeader.h"
+
+namespace TextureSynthesis
+{
+
+// Little endian base 128 integers, seven bits per byte with the high bit flagging continuation
+inline void writeVarint(vector<unsigned char> &data, uint value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	data.push_back((unsigned char)value);
+}
+
+inline uint readVarint(const unsigned char *&pData)
+{
+	uint value = 0;
+	int shift = 0;
+
+	while (*pData & 0x80)
+	{
+		value |= (uint)(*pData++ & 0x7F) << shift;
+		shift += 7;
+	}
+	value |= (uint)(*pData++) << shift;
+
+	return value;
+}
+
+// Signed values interleaved so small magnitudes of either sign stay small
+inline uint zigzagEncode(int value)
+{
+	return ((uint)value << 1) ^ (uint)(value >> 31);
+}
+
+inline int zigzagDecode(uint value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+}
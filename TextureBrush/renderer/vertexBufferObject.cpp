@@ -1,5 +1,7 @@
 #include "vertexBufferObject.h"
 #include "triangleMesh.h"
+#include "traceRecorder.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
@@ -19,6 +21,7 @@ void CVertexBufferObject::setup()
 	{
 		m_buffers[vIdx] = 0;
 		m_bufferAttachPoints[vIdx] = -1;
+		m_bufferBytes[vIdx] = 0;
 		m_activeState[vIdx] = false;
 	}
 
@@ -40,12 +43,14 @@ void CVertexBufferObject::setup()
 
 	updateBuffer(m_bufferMask);
 
-	glBindVertexArray(0);
+	CGLStateCache::Instance()->bindVertexArray(0);
 }
 
 void CVertexBufferObject::updateBuffer(int bufMask)
 {
-	glBindVertexArray(m_VAO);
+	TRACE_SCOPE("vboUpload");
+
+	CGLStateCache::Instance()->bindVertexArray(m_VAO);
 
 	if (bufMask & VBOBM_VERTEX)
 	{
@@ -147,8 +152,9 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 				m_totalBufNumber++;
 			}
 
-			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBOIDX_PROPFLOAT]);
-			glBufferData(GL_ARRAY_BUFFER, m_verNum * sizeof(float), m_pGeometry->getPropFloatData(), GL_STATIC_DRAW_ARB);
+			allocateBufferStorage(VBOIDX_PROPFLOAT, GL_ARRAY_BUFFER, m_verNum * sizeof(float));
+			glBufferSubData(GL_ARRAY_BUFFER, 0, m_verNum * sizeof(float), m_pGeometry->getPropFloatData());
+			m_pGeometry->clearPropDirty(TMPC_FLOAT);
 			glEnableVertexAttribArray(m_bufferAttachPoints[VBOIDX_PROPFLOAT]);
 			glVertexAttribPointer(m_bufferAttachPoints[VBOIDX_PROPFLOAT], 1, GL_FLOAT, GL_FALSE, 0, 0);
 		}
@@ -160,7 +166,7 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 
 	if (bufMask & VBOBM_FLOAT2_PROP)
 	{
-		if (m_pGeometry->getPropFloatData() != NULL)
+		if (m_pGeometry->getPropFloat2Data() != NULL)
 		{
 			if (m_bufferAttachPoints[VBOIDX_PROPFLOAT2] < 0)
 			{
@@ -169,8 +175,9 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 				m_totalBufNumber++;
 			}
 
-			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBOIDX_PROPFLOAT2]);
-			glBufferData(GL_ARRAY_BUFFER, m_verNum * sizeof(float), m_pGeometry->getPropFloat2Data(), GL_STATIC_DRAW_ARB);
+			allocateBufferStorage(VBOIDX_PROPFLOAT2, GL_ARRAY_BUFFER, m_verNum * 2 * sizeof(float));
+			glBufferSubData(GL_ARRAY_BUFFER, 0, m_verNum * 2 * sizeof(float), m_pGeometry->getPropFloat2Data());
+			m_pGeometry->clearPropDirty(TMPC_FLOAT2);
 			glEnableVertexAttribArray(m_bufferAttachPoints[VBOIDX_PROPFLOAT2]);
 			glVertexAttribPointer(m_bufferAttachPoints[VBOIDX_PROPFLOAT2], 2, GL_FLOAT, GL_FALSE, 0, 0);
 		}
@@ -191,8 +198,9 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 				m_totalBufNumber++;
 			}
 
-			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBOIDX_PROPINT]);
-			glBufferData(GL_ARRAY_BUFFER, m_verNum * sizeof(int), m_pGeometry->getPropIntData(), GL_STATIC_DRAW_ARB);
+			allocateBufferStorage(VBOIDX_PROPINT, GL_ARRAY_BUFFER, m_verNum * sizeof(int));
+			glBufferSubData(GL_ARRAY_BUFFER, 0, m_verNum * sizeof(int), m_pGeometry->getPropIntData());
+			m_pGeometry->clearPropDirty(TMPC_INT);
 			glEnableVertexAttribArray(m_bufferAttachPoints[VBOIDX_PROPINT]);
 			glVertexAttribPointer(m_bufferAttachPoints[VBOIDX_PROPINT], 1, GL_INT, GL_FALSE, 0, 0);
 		}
@@ -213,8 +221,9 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 				m_totalBufNumber++;
 			}
 
-			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBOIDX_PROPUINT]);
-			glBufferData(GL_ARRAY_BUFFER, m_verNum * sizeof(uint), m_pGeometry->getPropUIntData(), GL_STATIC_DRAW_ARB);
+			allocateBufferStorage(VBOIDX_PROPUINT, GL_ARRAY_BUFFER, m_verNum * sizeof(uint));
+			glBufferSubData(GL_ARRAY_BUFFER, 0, m_verNum * sizeof(uint), m_pGeometry->getPropUIntData());
+			m_pGeometry->clearPropDirty(TMPC_UINT);
 			glEnableVertexAttribArray(m_bufferAttachPoints[VBOIDX_PROPUINT]);
 			glVertexAttribPointer(m_bufferAttachPoints[VBOIDX_PROPUINT], 1, GL_UNSIGNED_INT, GL_FALSE, 0, 0);
 		}
@@ -237,7 +246,82 @@ void CVertexBufferObject::updateBuffer(int bufMask)
 		}
 	}
 
-	glBindVertexArray(0);
+	CGLStateCache::Instance()->bindVertexArray(0);
+}
+
+// Property buffers are allocated once and then refreshed through glBufferSubData
+void CVertexBufferObject::allocateBufferStorage(int vIdx, GLenum target, GLsizeiptr byteNum)
+{
+	glBindBuffer(target, m_buffers[vIdx]);
+
+	if (m_bufferBytes[vIdx] != byteNum)
+	{
+		glBufferData(target, byteNum, NULL, GL_DYNAMIC_DRAW);
+		m_bufferBytes[vIdx] = byteNum;
+	}
+}
+
+void CVertexBufferObject::updateDirtyBuffer(int bufMask)
+{
+	TRACE_SCOPE("vboDirtyUpload");
+
+	// Spans closer than this many elements are uploaded as a single call
+	const int mergeGap = 64;
+
+	struct DirtyPropBuffer
+	{
+		VBOBufferMask mask;
+		VBOIndex vIdx;
+		TriMeshPropChannel channel;
+		int elemBytes;
+	};
+
+	static const DirtyPropBuffer s_dirtyPropBuffers[] =
+	{
+		{ VBOBM_FLOAT_PROP, VBOIDX_PROPFLOAT, TMPC_FLOAT, sizeof(float) },
+		{ VBOBM_FLOAT2_PROP, VBOIDX_PROPFLOAT2, TMPC_FLOAT2, 2 * sizeof(float) },
+		{ VBOBM_INT_PROP, VBOIDX_PROPINT, TMPC_INT, sizeof(int) },
+		{ VBOBM_UINT_PROP, VBOIDX_PROPUINT, TMPC_UINT, sizeof(uint) }
+	};
+
+	const void* pPropData[] =
+	{
+		m_pGeometry->getPropFloatData(),
+		m_pGeometry->getPropFloat2Data(),
+		m_pGeometry->getPropIntData(),
+		m_pGeometry->getPropUIntData()
+	};
+
+	vector<ivec2> dirtyRanges;
+	for (int bufIdx = 0; bufIdx < sizeof(s_dirtyPropBuffers) / sizeof(DirtyPropBuffer); ++bufIdx)
+	{
+		const DirtyPropBuffer &propBuf = s_dirtyPropBuffers[bufIdx];
+		if (!(bufMask & propBuf.mask) || !m_pGeometry->isPropDirty(propBuf.channel))
+		{
+			continue;
+		}
+
+		// Storage not created yet, fall back to a full upload
+		if (m_bufferBytes[propBuf.vIdx] == 0)
+		{
+			updateBuffer(propBuf.mask);
+			continue;
+		}
+
+		m_pGeometry->getMergedDirtyRanges(propBuf.channel, dirtyRanges, mergeGap);
+
+		const char* pData = (const char*)pPropData[bufIdx];
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[propBuf.vIdx]);
+		for (int rangeIdx = 0; rangeIdx < dirtyRanges.size(); ++rangeIdx)
+		{
+			GLintptr offset = (GLintptr)dirtyRanges[rangeIdx][0] * propBuf.elemBytes;
+			GLsizeiptr byteNum = (GLsizeiptr)(dirtyRanges[rangeIdx][1] - dirtyRanges[rangeIdx][0]) * propBuf.elemBytes;
+			glBufferSubData(GL_ARRAY_BUFFER, offset, byteNum, pData + offset);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_pGeometry->clearPropDirty(propBuf.channel);
+	}
 }
 
 void CVertexBufferObject::clean()
@@ -251,18 +335,24 @@ void CVertexBufferObject::clean()
 			glDeleteBuffers(1, &m_buffers[vIdx]);
 			m_buffers[vIdx] = 0;
 		}
+		m_bufferBytes[vIdx] = 0;
 		m_activeState[vIdx] = false;
 	}
+	CGLStateCache::Instance()->forgetVertexArray(m_VAO);
 	glDeleteVertexArrays(1, &m_VAO);
 }
 
+// The vertex array stays bound, the next display of the same VBO doesn't rebind it
 void CVertexBufferObject::display(VBORenderMode mode)
 {
-	glBindVertexArray(m_VAO);
+	CGLStateCache::Instance()->bindVertexArray(m_VAO);
 
 	glDrawElementsBaseVertex(mode, m_triNum * 3, GL_UNSIGNED_INT, (void*)0, 0);
+}
 
-	glBindVertexArray(0);
+void CVertexBufferObject::drawBound(VBORenderMode mode)
+{
+	glDrawElementsBaseVertex(mode, m_triNum * 3, GL_UNSIGNED_INT, (void*)0, 0);
 }
 
 void CVertexBufferObject::resetScene(CTriangleMesh* pScene)
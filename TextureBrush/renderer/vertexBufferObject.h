@@ -77,14 +77,22 @@ public:
 	void deactiveBuffer(int vIdx);
 
 	void display(VBORenderMode mode);
+	// Draw with the vertex array already bound by the caller, as the render graph does
+	void drawBound(VBORenderMode mode);
+	GLuint getVAO(){ return m_VAO; }
+
 	void resetScene(CTriangleMesh* pScene);
 
 	void updateBuffer(int bufMask);
+	// Upload only the dirty ranges recorded by the triangle mesh for property buffers
+	void updateDirtyBuffer(int bufMask);
 
 protected:
 	virtual void setup();
 	void clean();
 
+	void allocateBufferStorage(int vIdx, GLenum target, GLsizeiptr byteNum);
+
 protected:
 	CTriangleMesh* m_pGeometry;
 	int m_verNum;
@@ -95,6 +103,7 @@ protected:
 	GLuint m_VAO;
 	GLuint m_buffers[VBOIDX_TOTALIDXNUM];
 	int m_bufferAttachPoints[VBOIDX_TOTALIDXNUM];
+	GLsizeiptr m_bufferBytes[VBOIDX_TOTALIDXNUM];
 	GLboolean m_activeState[VBOIDX_TOTALIDXNUM];
 };
 
@@ -0,0 +1,474 @@
+#include "vertexKdTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+#include "triangleMesh.h"
+#include "threadPool.h"
+
+using namespace TextureSynthesis;
+
+#define KDTREE_LEAF_SIZE 16
+#define KDTREE_STACK_SIZE 64
+#define KDTREE_QUERY_BATCH_SIZE 64
+#define KDTREE_SERIAL_SPLIT_MIN_POINTS 16384
+#define KDTREE_JOBS_PER_THREAD 8
+
+namespace
+{
+
+struct KdRange
+{
+	int begin, end;
+	float disSq;	// Lower bound of the distance to any point in the range
+};
+
+struct NearestVisitor
+{
+	int verIdx;
+	float disSq;
+
+	float operator()(float pointDisSq, int pointIdx)
+	{
+		if (pointDisSq < disSq)
+		{
+			disSq = pointDisSq;
+			verIdx = pointIdx;
+		}
+		return disSq;
+	}
+};
+
+// Max heap of the k best candidates, the bound tightens once it is full
+struct KNearestVisitor
+{
+	vector<std::pair<float, int> > heap;
+	int k;
+	float maxDisSq;
+
+	float operator()(float pointDisSq, int pointIdx)
+	{
+		if (heap.size() < k)
+		{
+			heap.push_back(std::make_pair(pointDisSq, pointIdx));
+			std::push_heap(heap.begin(), heap.end());
+		}
+		else if (pointDisSq < heap.front().first)
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = std::make_pair(pointDisSq, pointIdx);
+			std::push_heap(heap.begin(), heap.end());
+		}
+		return heap.size() < k ? maxDisSq : heap.front().first;
+	}
+};
+
+struct RadiusVisitor
+{
+	vector<int> *pVerIdxVec;
+	float radiusSq;
+
+	float operator()(float pointDisSq, int pointIdx)
+	{
+		pVerIdxVec->push_back(pointIdx);
+		return radiusSq;
+	}
+};
+
+double benchmarkTime()
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+}
+
+CVertexKdTree::CVertexKdTree(CThreadPool *pThreadPool) : m_pMesh(NULL), m_geometryVersion(0), m_pointNum(0)
+{
+	m_pThreadPool = pThreadPool != NULL ? pThreadPool : CThreadPool::Instance();
+}
+
+CVertexKdTree::~CVertexKdTree()
+{
+
+}
+
+void CVertexKdTree::build(CTriangleMesh *pMesh)
+{
+	build(pMesh->getVertices(), pMesh->getVerNum());
+
+	m_pMesh = pMesh;
+	m_geometryVersion = pMesh->getGeometryVersion();
+}
+
+void CVertexKdTree::build(const vec3 *pPoints, int pointNum)
+{
+	m_pMesh = NULL;
+	m_pointNum = pointNum;
+
+	const int chunkNum = m_pThreadPool->getThreadNum() * KDTREE_JOBS_PER_THREAD;
+
+	m_buildPointVec.resize(pointNum);
+	m_splitAxisVec.assign(pointNum, 0);
+	m_splitValueVec.assign(pointNum, 0.0f);
+
+	m_pThreadPool->parallelFor(chunkNum, [&](int chunkIdx)
+	{
+		const int endIdx = (long long)pointNum * (chunkIdx + 1) / chunkNum;
+		for (int pointIdx = (long long)pointNum * chunkIdx / chunkNum; pointIdx < endIdx; ++pointIdx)
+		{
+			m_buildPointVec[pointIdx].pos = pPoints[pointIdx];
+			m_buildPointVec[pointIdx].verIdx = pointIdx;
+		}
+	});
+
+	// Split the top levels here until there are enough subtrees to keep every thread busy
+	vector<ivec2> rangeVec(1, ivec2(0, pointNum));
+	vector<ivec2> jobVec;
+	for (int rangeIdx = 0; rangeIdx < rangeVec.size(); ++rangeIdx)
+	{
+		ivec2 range = rangeVec[rangeIdx];
+		if (range[1] - range[0] < KDTREE_SERIAL_SPLIT_MIN_POINTS || jobVec.size() + rangeVec.size() - rangeIdx >= chunkNum)
+		{
+			jobVec.push_back(range);
+			continue;
+		}
+
+		int mid = splitRange(range[0], range[1]);
+		rangeVec.push_back(ivec2(range[0], mid));
+		rangeVec.push_back(ivec2(mid, range[1]));
+	}
+
+	m_pThreadPool->parallelFor(jobVec.size(), [&](int jobIdx)
+	{
+		buildRange(jobVec[jobIdx][0], jobVec[jobIdx][1]);
+	});
+
+	// Leaf scans load four lanes at a time, the padding keeps the last leaf's loads in bounds
+	m_xVec.resize(pointNum + 4, FLT_MAX);
+	m_yVec.resize(pointNum + 4, FLT_MAX);
+	m_zVec.resize(pointNum + 4, FLT_MAX);
+	m_indexVec.resize(pointNum);
+
+	m_pThreadPool->parallelFor(chunkNum, [&](int chunkIdx)
+	{
+		const int endIdx = (long long)pointNum * (chunkIdx + 1) / chunkNum;
+		for (int pointIdx = (long long)pointNum * chunkIdx / chunkNum; pointIdx < endIdx; ++pointIdx)
+		{
+			m_xVec[pointIdx] = m_buildPointVec[pointIdx].pos.x;
+			m_yVec[pointIdx] = m_buildPointVec[pointIdx].pos.y;
+			m_zVec[pointIdx] = m_buildPointVec[pointIdx].pos.z;
+			m_indexVec[pointIdx] = m_buildPointVec[pointIdx].verIdx;
+		}
+	});
+
+	vector<KdTreeBuildPoint>().swap(m_buildPointVec);
+}
+
+bool CVertexKdTree::isStale()
+{
+	return m_pMesh == NULL || m_pMesh->getGeometryVersion() != m_geometryVersion;
+}
+
+// Median split along the widest axis of the range
+int CVertexKdTree::splitRange(int begin, int end)
+{
+	vec3 boundMin(FLT_MAX), boundMax(-FLT_MAX);
+	for (int pointIdx = begin; pointIdx < end; ++pointIdx)
+	{
+		boundMin = glm::min(boundMin, m_buildPointVec[pointIdx].pos);
+		boundMax = glm::max(boundMax, m_buildPointVec[pointIdx].pos);
+	}
+
+	vec3 extent = boundMax - boundMin;
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	int mid = (begin + end) / 2;
+	KdTreeBuildPoint *pPoints = &m_buildPointVec[0];
+	std::nth_element(pPoints + begin, pPoints + mid, pPoints + end, [axis](const KdTreeBuildPoint &a, const KdTreeBuildPoint &b)
+	{
+		return a.pos[axis] < b.pos[axis];
+	});
+
+	// Subtrees reorder the point at mid, so the plane is kept on its own
+	m_splitAxisVec[mid] = axis;
+	m_splitValueVec[mid] = pPoints[mid].pos[axis];
+	return mid;
+}
+
+void CVertexKdTree::buildRange(int begin, int end)
+{
+	if (end - begin <= KDTREE_LEAF_SIZE)
+	{
+		return;
+	}
+
+	int mid = splitRange(begin, end);
+	buildRange(begin, mid);
+	buildRange(mid, end);
+}
+
+// Points left of the middle index are not above the split coordinate and points from it on are not below
+template <typename TVisitor>
+void CVertexKdTree::traverse(const vec3 &pos, float maxDisSq, TVisitor &visitor)
+{
+	if (m_pointNum == 0)
+	{
+		return;
+	}
+
+	const float *pCoords[3] = { &m_xVec[0], &m_yVec[0], &m_zVec[0] };
+	const __m128 posX = _mm_set1_ps(pos.x), posY = _mm_set1_ps(pos.y), posZ = _mm_set1_ps(pos.z);
+	const __m128i laneOffset = _mm_set_epi32(3, 2, 1, 0);
+
+	float boundSq = maxDisSq;
+
+	KdRange stack[KDTREE_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize].begin = 0;
+	stack[stackSize].end = m_pointNum;
+	stack[stackSize++].disSq = 0.0f;
+
+	while (stackSize > 0)
+	{
+		KdRange range = stack[--stackSize];
+		if (range.disSq > boundSq)
+		{
+			continue;
+		}
+
+		if (range.end - range.begin <= KDTREE_LEAF_SIZE)
+		{
+			for (int pointIdx = range.begin; pointIdx < range.end; pointIdx += 4)
+			{
+				__m128 dx = _mm_sub_ps(_mm_loadu_ps(pCoords[0] + pointIdx), posX);
+				__m128 dy = _mm_sub_ps(_mm_loadu_ps(pCoords[1] + pointIdx), posY);
+				__m128 dz = _mm_sub_ps(_mm_loadu_ps(pCoords[2] + pointIdx), posZ);
+				__m128 disSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				// Lanes past the leaf belong to the next one
+				__m128 inLeaf = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(pointIdx), laneOffset), _mm_set1_epi32(range.end)));
+				int candBits = _mm_movemask_ps(_mm_and_ps(inLeaf, _mm_cmple_ps(disSq, _mm_set1_ps(boundSq))));
+				if (candBits == 0)
+				{
+					continue;
+				}
+
+				float disLanes[4];
+				_mm_storeu_ps(disLanes, disSq);
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if ((candBits & (1 << lane)) && disLanes[lane] <= boundSq)
+					{
+						boundSq = visitor(disLanes[lane], m_indexVec[pointIdx + lane]);
+					}
+				}
+			}
+			continue;
+		}
+
+		int mid = (range.begin + range.end) / 2;
+		int axis = m_splitAxisVec[mid];
+		float diff = pos[axis] - m_splitValueVec[mid];
+
+		KdRange nearRange, farRange;
+		nearRange.begin = diff < 0.0f ? range.begin : mid;
+		nearRange.end = diff < 0.0f ? mid : range.end;
+		nearRange.disSq = range.disSq;
+		farRange.begin = diff < 0.0f ? mid : range.begin;
+		farRange.end = diff < 0.0f ? range.end : mid;
+		farRange.disSq = std::max(range.disSq, diff * diff);
+
+		if (farRange.disSq <= boundSq)
+		{
+			stack[stackSize++] = farRange;
+		}
+		stack[stackSize++] = nearRange;
+	}
+}
+
+int CVertexKdTree::nearestVertex(const vec3 &pos, float maxDis)
+{
+	NearestVisitor visitor;
+	visitor.verIdx = -1;
+	visitor.disSq = maxDis == FLT_MAX ? FLT_MAX : maxDis * maxDis;
+
+	traverse(pos, visitor.disSq, visitor);
+
+	return visitor.verIdx;
+}
+
+void CVertexKdTree::nearestVertices(const vector<vec3> &posVec, float maxDis, vector<int> &verIdxVec)
+{
+	const int posNum = posVec.size();
+	const int batchNum = (posNum + KDTREE_QUERY_BATCH_SIZE - 1) / KDTREE_QUERY_BATCH_SIZE;
+	verIdxVec.resize(posNum);
+
+	auto queryBatch = [&](int batchIdx)
+	{
+		const int endIdx = std::min((batchIdx + 1) * KDTREE_QUERY_BATCH_SIZE, posNum);
+		for (int posIdx = batchIdx * KDTREE_QUERY_BATCH_SIZE; posIdx < endIdx; ++posIdx)
+		{
+			verIdxVec[posIdx] = nearestVertex(posVec[posIdx], maxDis);
+		}
+	};
+
+	// The points of a stroke chunk are usually a single batch, not worth waking the pool for
+	if (batchNum <= 1)
+	{
+		for (int batchIdx = 0; batchIdx < batchNum; ++batchIdx)
+		{
+			queryBatch(batchIdx);
+		}
+	}
+	else
+	{
+		m_pThreadPool->parallelFor(batchNum, queryBatch);
+	}
+}
+
+void CVertexKdTree::kNearest(const vec3 &pos, int k, float maxDis, vector<int> &verIdxVec)
+{
+	KNearestVisitor visitor;
+	visitor.k = k;
+	visitor.maxDisSq = maxDis == FLT_MAX ? FLT_MAX : maxDis * maxDis;
+	visitor.heap.reserve(k);
+
+	traverse(pos, visitor.maxDisSq, visitor);
+
+	std::sort_heap(visitor.heap.begin(), visitor.heap.end());
+
+	verIdxVec.resize(visitor.heap.size());
+	for (int idx = 0; idx < visitor.heap.size(); ++idx)
+	{
+		verIdxVec[idx] = visitor.heap[idx].second;
+	}
+}
+
+void CVertexKdTree::kNearestBatch(const vector<vec3> &posVec, int k, float maxDis, vector<int> &verIdxVec)
+{
+	const int posNum = posVec.size();
+	const int batchNum = (posNum + KDTREE_QUERY_BATCH_SIZE - 1) / KDTREE_QUERY_BATCH_SIZE;
+	verIdxVec.assign(posNum * k, -1);
+
+	auto queryBatch = [&](int batchIdx)
+	{
+		vector<int> nearVec;
+		const int endIdx = std::min((batchIdx + 1) * KDTREE_QUERY_BATCH_SIZE, posNum);
+		for (int posIdx = batchIdx * KDTREE_QUERY_BATCH_SIZE; posIdx < endIdx; ++posIdx)
+		{
+			kNearest(posVec[posIdx], k, maxDis, nearVec);
+			std::copy(nearVec.begin(), nearVec.end(), verIdxVec.begin() + posIdx * k);
+		}
+	};
+
+	if (batchNum <= 1)
+	{
+		for (int batchIdx = 0; batchIdx < batchNum; ++batchIdx)
+		{
+			queryBatch(batchIdx);
+		}
+	}
+	else
+	{
+		m_pThreadPool->parallelFor(batchNum, queryBatch);
+	}
+}
+
+void CVertexKdTree::queryRadius(const vec3 &pos, float radius, vector<int> &verIdxVec)
+{
+	verIdxVec.clear();
+
+	RadiusVisitor visitor;
+	visitor.pVerIdxVec = &verIdxVec;
+	visitor.radiusSq = radius * radius;
+
+	traverse(pos, visitor.radiusSq, visitor);
+}
+
+void CVertexKdTree::benchmark(int pointNum, int queryNum, int threadNum)
+{
+	const int checkNum = 100;
+	const int k = 8;
+
+	cout << "Info: kd-tree benchmark of " << pointNum << " points and " << queryNum << " queries" << endl;
+
+	// Deterministic points in the unit cube, queries slightly off them like stroke points off the mesh
+	vector<vec3> pointVec(pointNum), queryVec(queryNum);
+	unsigned int seed = 12345;
+	for (int pointIdx = 0; pointIdx < pointNum; ++pointIdx)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			pointVec[pointIdx][axis] = (seed >> 8) / 16777216.0f;
+		}
+	}
+	for (int queryIdx = 0; queryIdx < queryNum; ++queryIdx)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			queryVec[queryIdx][axis] = (seed >> 8) / 16777216.0f;
+		}
+	}
+
+	CThreadPool threadPool(threadNum);
+	CVertexKdTree kdTree(&threadPool);
+
+	double startTime = benchmarkTime();
+	kdTree.build(&pointVec[0], pointNum);
+	double buildTime = benchmarkTime() - startTime;
+
+	vector<int> nearestVec, kNearestVec;
+	startTime = benchmarkTime();
+	kdTree.nearestVertices(queryVec, FLT_MAX, nearestVec);
+	double nearestTime = benchmarkTime() - startTime;
+
+	startTime = benchmarkTime();
+	kdTree.kNearestBatch(queryVec, k, FLT_MAX, kNearestVec);
+	double kNearestTime = benchmarkTime() - startTime;
+
+	// About k points per sphere
+	float radius = pow(k * 3.0f / (4.0f * MY_PI * pointNum), 1.0f / 3.0f);
+	vector<int> radiusVec;
+	int radiusHitNum = 0;
+	startTime = benchmarkTime();
+	for (int queryIdx = 0; queryIdx < queryNum; ++queryIdx)
+	{
+		kdTree.queryRadius(queryVec[queryIdx], radius, radiusVec);
+		radiusHitNum += radiusVec.size();
+	}
+	double radiusTime = benchmarkTime() - startTime;
+
+	int mismatchNum = 0;
+	for (int queryIdx = 0; queryIdx < std::min(checkNum, queryNum); ++queryIdx)
+	{
+		float bestDisSq = FLT_MAX;
+		for (int pointIdx = 0; pointIdx < pointNum; ++pointIdx)
+		{
+			vec3 diff = pointVec[pointIdx] - queryVec[queryIdx];
+			bestDisSq = std::min(bestDisSq, dot(diff, diff));
+		}
+
+		vec3 diff = pointVec[nearestVec[queryIdx]] - queryVec[queryIdx];
+		if (dot(diff, diff) != bestDisSq || kNearestVec[queryIdx * k] != nearestVec[queryIdx])
+		{
+			++mismatchNum;
+		}
+	}
+
+	cout << "Info: Built in " << buildTime * 1000.0 << " ms on " << threadPool.getThreadNum() << " threads" << endl;
+	cout << "Info: Nearest " << nearestTime * 1000000000.0 / queryNum << " ns, " << k << "-nearest "
+		<< kNearestTime * 1000000000.0 / queryNum << " ns, radius " << radiusTime * 1000000000.0 / queryNum
+		<< " ns per query with " << (float)radiusHitNum / queryNum << " points in range" << endl;
+
+	if (mismatchNum > 0)
+	{
+		cout << "ERROR: " << mismatchNum << " of " << checkNum << " nearest queries differ from brute force!" << endl;
+	}
+	else
+	{
+		cout << "Info: Nearest queries match brute force" << endl;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../preHeader.h"
+
+#include <cfloat>
+
+namespace TextureSynthesis
+{
+
+class CTriangleMesh;
+class CThreadPool;
+
+struct KdTreeBuildPoint
+{
+	vec3 pos;
+	int verIdx;
+};
+
+// Static kd-tree over mesh vertices without node pointers. Vertices are reordered so every range
+// [begin, end) splits at its middle index, where the split axis and coordinate are kept. Ranges of
+// at most KDTREE_LEAF_SIZE vertices are leaves, scanned four at a time with SSE from SoA arrays.
+class CVertexKdTree
+{
+public:
+	// Runs on the shared thread pool unless given one, which it doesn't own
+	explicit CVertexKdTree(CThreadPool *pThreadPool = NULL);
+	virtual ~CVertexKdTree();
+
+	void build(CTriangleMesh *pMesh);
+	void build(const vec3 *pPoints, int pointNum);
+
+	// The mesh changed since the build and the tree has to be rebuilt
+	bool isStale();
+
+	// Nearest vertex within maxDis, -1 if none
+	int nearestVertex(const vec3 &pos, float maxDis = FLT_MAX);
+	void nearestVertices(const vector<vec3> &posVec, float maxDis, vector<int> &verIdxVec);
+
+	// Up to k vertices within maxDis by increasing distance
+	void kNearest(const vec3 &pos, int k, float maxDis, vector<int> &verIdxVec);
+
+	// k entries per position, padded with -1
+	void kNearestBatch(const vector<vec3> &posVec, int k, float maxDis, vector<int> &verIdxVec);
+
+	void queryRadius(const vec3 &pos, float radius, vector<int> &verIdxVec);
+
+	int getPointNum(){ return m_pointNum; }
+
+	// Build and query times over random points, checked against brute force on a sample
+	static void benchmark(int pointNum, int queryNum = 100000, int threadNum = 0);
+
+protected:
+	void buildRange(int begin, int end);
+	int splitRange(int begin, int end);
+
+	// Squared distances of the leaf points to pos are offered to the visitor, which returns the new bound
+	template <typename TVisitor> void traverse(const vec3 &pos, float maxDisSq, TVisitor &visitor);
+
+private:
+	CThreadPool *m_pThreadPool;
+	CTriangleMesh *m_pMesh;
+	uint m_geometryVersion;
+
+	int m_pointNum;
+
+	// Tree order SoA coordinates and original indices, split plane at the middle of every inner range
+	vector<float> m_xVec, m_yVec, m_zVec;
+	vector<int> m_indexVec;
+	vector<unsigned char> m_splitAxisVec;
+	vector<float> m_splitValueVec;
+
+	// Build state, partitioned in place so subtrees own disjoint ranges
+	vector<KdTreeBuildPoint> m_buildPointVec;
+};
+
+}
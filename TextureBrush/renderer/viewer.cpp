@@ -4,6 +4,7 @@
 #include "renderSystem.h"
 #include "paintPathes.h"
 #include "brushGlobalRes.h"
+#include "glStateCache.h"
 
 using namespace TextureSynthesis;
 
@@ -14,6 +15,8 @@ CViewer::CViewer() : m_mouseDown(false), m_preWheelPos(0), m_startTumbling(false
 	CRenderSystemConfig::getSysCfgInstance()->getCameraAdjust(m_tumblingSpeed, m_zoomSpeed, m_moveSpeed);
 
 	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_LEFT_SHIFT, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_Z, this);
+	CEventManager::getEventManagerInstance()->registerKeyListener(GLFW_KEY_Y, this);
 	CEventManager::getEventManagerInstance()->registerMouseListener(GLFW_MOUSE_BUTTON_LEFT, this);
 	CEventManager::getEventManagerInstance()->registerMouseListener(GLFW_MOUSE_BUTTON_RIGHT, this);
 }
@@ -42,21 +45,14 @@ void CViewer::aim()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	int width, height;
-	glfwGetWindowSize(CRenderSystem::Instance()->getGLFWWindow(), &width, &height);
+	CRenderSystem::Instance()->getFrameSize(width, height);
 	height = height < 1 ? 1 : height;
 
 	glViewport(0, 0, width, height);
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	// Window aspect (assumes square pixels)
-	float aspectRatio = (float)width / (float)height;
-	// Set perspective view
-	gluPerspective(m_pCamera->m_fov, aspectRatio, m_pCamera->m_nearPlane, m_pCamera->m_farPlane);
+	m_pCamera->updateMatrices(width, height);
 
-	vec3 camPos(m_pCamera->m_lookX + m_pCamera->m_radius * std::cos(glm::radians(m_pCamera->m_head)) * std::sin(glm::radians(m_pCamera->m_pitch)),
-		m_pCamera->m_lookY + m_pCamera->m_radius * std::sin(glm::radians(m_pCamera->m_head)),
-		m_pCamera->m_lookZ + m_pCamera->m_radius * std::cos(glm::radians(m_pCamera->m_head)) * std::cos(glm::radians(m_pCamera->m_pitch)));
+	vec3 camPos = m_pCamera->getPosition();
 
 	m_forward = vec3(m_pCamera->m_lookX - camPos.x, m_pCamera->m_lookY - camPos.y, m_pCamera->m_lookZ - camPos.z);
 	m_forward = glm::normalize(m_forward);
@@ -64,24 +60,32 @@ void CViewer::aim()
 	m_side = glm::cross(m_forward, up);
 	m_up = glm::cross(m_side, m_forward);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	CGLStateCache::Instance()->setDepthTest(true);
+	CGLStateCache::Instance()->setDepthFunc(GL_LEQUAL);
 
-	// Set up model view matrix
+	// The fixed function helpers (axis, wire cube, HUD) still draw through the matrix stack, which is only written
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(&m_pCamera->getProjMat()[0][0]);
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	gluLookAt(camPos.x, camPos.y, camPos.z,
-		m_pCamera->m_lookX, m_pCamera->m_lookY, m_pCamera->m_lookZ,
-		up.x, up.y, up.z);
+	glLoadMatrixf(&m_pCamera->getModelviewMat()[0][0]);
 }
 
 bool CViewer::keyPressed(const KeyEvent &arg)
 {
 	if (arg.key == GLFW_KEY_LEFT_SHIFT)
 	{
+		CPaintPathes::Instance()->startSketch();
 		CBrushGlobalRes::s_newSketch = true;
 		m_isPaintingMode = true;
 	}
+	else if (arg.key == GLFW_KEY_Z)
+	{
+		CPaintPathes::Instance()->undoStroke();
+	}
+	else if (arg.key == GLFW_KEY_Y)
+	{
+		CPaintPathes::Instance()->redoStroke();
+	}
 
 	return true;
 }
@@ -91,7 +95,7 @@ bool CViewer::keyReleased(const KeyEvent &arg)
 	if (arg.key == GLFW_KEY_LEFT_SHIFT)
 	{
 		m_isPaintingMode = false;
-		CPaintPathes::Instance()->compute3dPath();
+		CPaintPathes::Instance()->finishSketch();
 	}
 
 	return true;
@@ -104,6 +108,7 @@ bool CViewer::mouseMoved(const MouseEvent &arg)
 		if (m_mouseDown)
 		{
 			CPaintPathes::Instance()->addPointToPath(ivec2(arg.state.xPos, arg.state.yPos));
+			CRenderSystem::Instance()->requestRedraw(RDF_INPUT | RDF_STROKE);
 		}
 	}
 	else
@@ -122,12 +127,14 @@ bool CViewer::mouseMoved(const MouseEvent &arg)
 		{
 			m_pCamera->m_head += dy * m_tumblingSpeed;
 			m_pCamera->m_pitch += dx * m_tumblingSpeed;
+			CRenderSystem::Instance()->requestRedraw(RDF_INPUT | RDF_CAMERA);
 		}
 		else if (m_mouseDown && m_zoomMode)
 		{
 			m_pCamera->m_lookX += (dy * m_up.x - dx * m_side.x) * m_moveSpeed;
 			m_pCamera->m_lookY += (dy * m_up.y - dx * m_side.y) * m_moveSpeed;
 			m_pCamera->m_lookZ += (dy * m_up.z - dx * m_side.z) * m_moveSpeed;
+			CRenderSystem::Instance()->requestRedraw(RDF_INPUT | RDF_CAMERA);
 		}
 	}
 
@@ -201,6 +208,8 @@ bool CViewer::mouseWheel(int vOffset)
 {
 	if (!m_isPaintingMode)
 	{
+		CRenderSystem::Instance()->requestRedraw(RDF_INPUT | RDF_CAMERA);
+
 		if (vOffset > 0)
 		{
 			m_pCamera->m_radius += vOffset * m_zoomSpeed;
@@ -30,6 +30,8 @@ public:
 		m_tumblingSpeed = tumbling;
 	}
 
+	CCamera* getCamera(){ return m_pCamera; }
+
 protected:
 	CViewer();
 	CCamera* m_pCamera;
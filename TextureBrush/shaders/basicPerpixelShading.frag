@@ -1,13 +1,14 @@
 #version 430 core
 
 uniform sampler2D u_sourceTex;
-//LIQILIQI
-uniform int is_line;
+uniform int u_showWireframe;
 
 in vec3 f_origPos;
 in vec4 f_posInEye;
 in vec4 f_normal;
 in float f_geoDis;
+in vec2 f_texcoord;
+noperspective in vec3 f_barycentric;
 
 vec3 lightPos = vec3(0.0, 0.0, 100.0);
 vec3 lightAmbi = vec3(0.2, 0.2, 0.2);
@@ -16,6 +17,9 @@ vec3 lightSpec = vec3(0.8, 0.8, 0.8);
 
 vec3 myColor = vec3(0.9, 0.9, 0.9);
 
+vec3 wireColor = vec3(0.0, 0.5, 0.0);
+float wireWidth = 1.0;
+
 layout(location = 0) out vec4 out_Color;
 
 void main()
@@ -46,11 +50,17 @@ void main()
 	float scale = 0.25;
 	//out_Color = vec4(f_triIdx * scale, f_triIdx * scale, f_triIdx * scale, 1.0);
 	float chColor = fract(f_geoDis * 30.0) < 0.1 ? (1.0) : f_geoDis * scale;
+	// Negative distance means outside every stroke band
+	if (f_geoDis < 0.0) chColor = 0.0;
 	
 	out_Color = vec4(chColor, 0, 0, 1.0);
 	//out_Color = vec4(finalColor.xyz, 1.0);
 
-	if (is_line == 1) {
-		out_Color = vec4(0, 0.5, 0, 0.5);
+	// Edges are where a barycentric coordinate goes to 0, fwidth keeps them wireWidth pixels wide
+	// and the smoothstep anti-aliases them
+	if (u_showWireframe == 1) {
+		vec3 edgeDis = f_barycentric / max(fwidth(f_barycentric), vec3(1e-6));
+		float edgeFactor = smoothstep(wireWidth - 0.5, wireWidth + 0.5, min(edgeDis.x, min(edgeDis.y, edgeDis.z)));
+		out_Color.xyz = mix(wireColor, out_Color.xyz, edgeFactor);
 	}
 }
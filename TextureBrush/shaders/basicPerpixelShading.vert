@@ -1,23 +1,31 @@
 #version 430 core
 
-uniform mat4 u_modelviewMatrix;
-uniform mat4 u_projMatrix;
+layout(std140) uniform FrameUniforms
+{
+	mat4 u_modelviewMatrix;
+	mat4 u_projMatrix;
+	mat4 u_mvpMatrix;
+	mat4 u_normalMatrix;
+};
 
 layout(location = 0) in vec3 v_position;
 layout(location = 1) in vec3 v_normal;
 layout(location = 2) in float v_geoDis;
+layout(location = 3) in vec2 v_texcoord;
 
-out vec3 f_origPos;
-out vec4 f_posInEye;
-out vec4 f_normal;
-out float f_geoDis;
+out vec3 g_origPos;
+out vec4 g_posInEye;
+out vec4 g_normal;
+out float g_geoDis;
+out vec2 g_texcoord;
 
 void main()
 {
-	f_geoDis = v_geoDis;
-	f_origPos = v_position;
-	f_posInEye = u_modelviewMatrix * vec4(v_position, 1.0);
-    f_normal = transpose(inverse(u_modelviewMatrix)) * vec4(v_normal, 0.0); // Inverse normal only for Bunny & Horse
+	g_geoDis = v_geoDis;
+	g_texcoord = v_texcoord;
+	g_origPos = v_position;
+	g_posInEye = u_modelviewMatrix * vec4(v_position, 1.0);
+    g_normal = u_normalMatrix * vec4(v_normal, 0.0); // Inverse normal only for Bunny & Horse
 
-    gl_Position = u_projMatrix * u_modelviewMatrix * vec4(v_position, 1.0);
+    gl_Position = u_mvpMatrix * vec4(v_position, 1.0);
 }
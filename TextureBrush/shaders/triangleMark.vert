@@ -1,7 +1,12 @@
 #version 430 core
 
-uniform mat4 u_modelviewMatrix;
-uniform mat4 u_projMatrix;
+layout(std140) uniform FrameUniforms
+{
+	mat4 u_modelviewMatrix;
+	mat4 u_projMatrix;
+	mat4 u_mvpMatrix;
+	mat4 u_normalMatrix;
+};
 
 layout(location = 0) in vec3 v_position;
 layout(location = 1) in float v_triMark;
@@ -14,5 +19,5 @@ void main()
 	f_triMark = v_triMark;
 	f_origPos = v_position;
 
-    gl_Position = u_projMatrix * u_modelviewMatrix * vec4(v_position, 1.0);
+    gl_Position = u_mvpMatrix * vec4(v_position, 1.0);
 }
@@ -1,8 +1,14 @@
 #version 430 core
 
+in vec3 f_barycentric;
+
 layout(location = 0) out uvec4 out_Color;
+layout(location = 1) out uvec4 out_Barycentric;
 
 void main()
 {
 	out_Color = uvec4(gl_PrimitiveID + 1, 0, 0, 0);
+
+	// Weights of the second and third corner, the first one is implied
+	out_Barycentric = uvec4(packUnorm2x16(f_barycentric.yz), 0, 0, 0);
 }
@@ -1,12 +1,23 @@
 #version 430 core
 
-uniform mat4 u_modelviewMatrix;
-uniform mat4 u_projMatrix;
+layout(std140) uniform FrameUniforms
+{
+	mat4 u_modelviewMatrix;
+	mat4 u_projMatrix;
+	mat4 u_mvpMatrix;
+	mat4 u_normalMatrix;
+};
 
 layout(location = 0) in vec3 v_position;
 layout(location = 1) in float v_mark;
 
+out vec3 f_barycentric;
+
 void main()
 {
-    gl_Position = u_projMatrix * u_modelviewMatrix * vec4(v_position, 1.0);
+    gl_Position = u_mvpMatrix * vec4(v_position, 1.0);
+
+    // Flat mesh vertices are not shared, so the corner of a vertex is its index modulo 3
+    int corner = gl_VertexID % 3;
+    f_barycentric = vec3(corner == 0, corner == 1, corner == 2);
 }